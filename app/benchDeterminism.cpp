@@ -0,0 +1,79 @@
+#include "sph.hpp"
+#include "smoothing.hpp"
+#include "parallel.hpp"
+#include "initialConditions.hpp"
+#include <tintoretto.hpp>
+
+
+/**
+ * Benchmarks the deterministic mode of Parallel (fixed blocks and pairwise folding in reduce, per particle pair sums in
+ * SphSolver) against the default chunked mode, and checks that it gives the same bits for any number of threads.
+ */
+
+double seconds(Task& task) {
+    return task.getTimeNs() * 1e-9;
+}
+
+
+int main() {
+    const int n = 100000;
+    const int repeats = 5;
+    const std::vector<int> thread_counts = {1, 2, 3, 4, 8};
+
+    ParticleSet ps = InitialConditions::plummer(n, 11);
+    QuarticKernel kernel(1.0);
+    SmoothingLengthSolver(kernel, 50).solve(ps);
+    NeighborList list(0.0);
+    list.update(ps, kernel);
+    SphSolver sph(kernel, 1.0, 5.0 / 3.0);
+
+    auto kineticEnergy = [&]() {
+        return Parallel::reduce<double>(n, 0.0, [&](int begin, int end) {
+            double e = 0;
+            for (int i = begin; i < end; i++) e += 0.5 * ps.get(i).mass * ps.get(i).velocity.squaredNorm();
+            return e;
+        }, [](double a, double b) {return a + b;});
+    };
+
+    // timings at the default number of threads
+    std::vector<double> t_sph, t_reduce;
+    for (bool deterministic : {false, true}) {
+        Parallel::setDeterministic(deterministic);
+        Message::mute();
+        Task sph_task("SPH");
+        for (int r = 0; r < repeats; r++) sph.accelerations(ps, list);
+        sph_task.complete();
+        Task reduce_task("Reduce");
+        for (int r = 0; r < 100 * repeats; r++) kineticEnergy();
+        reduce_task.complete();
+        Message::unmute();
+        t_sph.push_back(seconds(sph_task) / repeats);
+        t_reduce.push_back(seconds(reduce_task) / (100 * repeats));
+    }
+    Message::print(cstr("N = " + std::to_string(n) + ", " + std::to_string(Parallel::getThreads()) + " threads").blue());
+    Message::tab();
+    Message::print("- SPH density and forces: " + std::to_string(t_sph[0] * 1e3) + " ms chunked, " + std::to_string(t_sph[1] * 1e3) +
+                   " ms deterministic (" + std::to_string(100 * (t_sph[1] / t_sph[0] - 1)) + " % overhead)");
+    Message::print("- Reduction: " + std::to_string(t_reduce[0] * 1e6) + " us chunked, " + std::to_string(t_reduce[1] * 1e6) +
+                   " us deterministic (" + std::to_string(100 * (t_reduce[1] / t_reduce[0] - 1)) + " % overhead)");
+    Message::untab();
+
+    Test test("Deterministic mode gives the same bits for 1 to 8 threads");
+    Parallel::setDeterministic(true);
+    std::vector<Eigen::Vector3d> reference;
+    double reference_energy = 0;
+    bool identical = true;
+    for (int threads : thread_counts) {
+        Parallel::setThreads(threads);
+        std::vector<Eigen::Vector3d> acc = sph.accelerations(ps, list);
+        double energy = kineticEnergy();
+        if (reference.empty()) {
+            reference = acc;
+            reference_energy = energy;
+        }
+        identical = identical && acc == reference && energy == reference_energy;
+    }
+    test.complete(identical);
+
+    return 0;
+}
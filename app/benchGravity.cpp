@@ -0,0 +1,108 @@
+#include "gravity.hpp"
+#include "fmm.hpp"
+#include <tintoretto.hpp>
+#include <random>
+
+
+/**
+ * Benchmarks the three gravity solvers on uniform cubes of growing size and reports where the
+ * approximate solvers become faster than direct summation, and the FMM faster than the tree.
+ * Errors are measured against direct summation on a sample of targets. First, one full direct
+ * summation at N = 100000, the size up to which it is used as the reference.
+ */
+
+ParticleSet uniformCube(int n, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+    }
+    return ps;
+}
+
+double seconds(Task& task) {
+    return task.getTimeNs() * 1e-9;
+}
+
+
+int main() {
+    const double softening = 1e-4;
+    const double tree_theta = 0.4;
+    const int fmm_order = 3; // roughly the accuracy of the tree at theta = 0.4
+    const double fmm_theta = 0.5;
+    const int n_samples = 1000;
+    const int max_direct = 30000; // beyond that, the direct timing is extrapolated as N^2
+
+    std::vector<int> sizes = {1000, 3000, 10000, 30000, 100000, 300000};
+    std::vector<double> t_direct, t_tree, t_fmm;
+
+    DirectGravity direct(softening);
+    TreeGravity tree(softening, tree_theta);
+    FmmGravity fmm(softening, fmm_order, fmm_theta);
+
+    const int n_reference = 100000;
+    ParticleSet large = uniformCube(n_reference);
+    Task reference_task("Direct gravity, N = " + std::to_string(n_reference));
+    direct.accelerations(large);
+    reference_task.complete();
+    Message("Direct: " + std::to_string((double)n_reference * n_reference / seconds(reference_task) * 1e-9) + " billion interactions per second", "#");
+
+    for (int n : sizes) {
+        Message::print(cstr("N = " + std::to_string(n)).blue());
+        Message::tab();
+        ParticleSet ps = uniformCube(n);
+
+        // reference on a sample of the particles (the first ones are as random as any)
+        std::vector<Eigen::Vector3d> targets;
+        for (int i = 0; i < std::min(n, n_samples); i++) {
+            targets.push_back(ps.get(i).position);
+        }
+        std::vector<Eigen::Vector3d> reference = direct.accelerations(targets, ps);
+
+        Message::mute();
+        Task direct_task("Direct");
+        if (n <= max_direct) direct.accelerations(ps);
+        direct_task.complete();
+        Task tree_task("Tree");
+        std::vector<Eigen::Vector3d> acc_tree = tree.accelerations(ps);
+        tree_task.complete();
+        Task fmm_task("FMM");
+        std::vector<Eigen::Vector3d> acc_fmm = fmm.accelerations(ps);
+        fmm_task.complete();
+        Message::unmute();
+
+        if (n <= max_direct) {
+            t_direct.push_back(seconds(direct_task));
+        } else {
+            double previous_n = sizes[t_direct.size() - 1];
+            t_direct.push_back(t_direct.back() * (n / previous_n) * (n / previous_n));
+        }
+        t_tree.push_back(seconds(tree_task));
+        t_fmm.push_back(seconds(fmm_task));
+
+        acc_tree.resize(targets.size());
+        acc_fmm.resize(targets.size());
+        ForceError tree_error = ForceError::compare(reference, acc_tree);
+        ForceError fmm_error = ForceError::compare(reference, acc_fmm);
+
+        Message::print("- Direct: " + std::to_string(t_direct.back()) + " s" + (n > max_direct ? " (extrapolated)" : ""));
+        Message::print("- Tree (theta = " + std::to_string(tree_theta) + "): " + std::to_string(t_tree.back()) + " s, mean error " + std::to_string(tree_error.mean) + ", " + std::to_string(tree.getNodeInteractions() / n) + " nodes per particle");
+        Message::print("- FMM (order " + std::to_string(fmm_order) + "): " + std::to_string(t_fmm.back()) + " s, mean error " + std::to_string(fmm_error.mean) + ", " + std::to_string(fmm.getM2LInteractions()) + " M2L");
+        Message::untab();
+    }
+
+    // crossovers: first size at which the faster-scaling method wins
+    auto crossover = [&](const std::vector<double>& fast, const std::vector<double>& slow) {
+        for (int i = 0; i < (int)sizes.size(); i++) {
+            if (fast[i] < slow[i]) return "N = " + std::to_string(sizes[i]);
+        }
+        return std::string("beyond N = ") + std::to_string(sizes.back());
+    };
+    Message("Tree faster than direct from " + crossover(t_tree, t_direct), "#");
+    Message("FMM faster than direct from " + crossover(t_fmm, t_direct), "#");
+    Message("FMM faster than tree from " + crossover(t_fmm, t_tree), "#");
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "sph.hpp"
+#include "smoothing.hpp"
+#include "gravity.hpp"
+#include "checkpoint.hpp"
+#include <tintoretto.hpp>
+#include <random>
+#include <fstream>
+#include <algorithm>
+
+
+/**
+ * Runs the same self-gravitating gas in the build at hand (real = float with -DSINGLE_PRECISION=ON, double otherwise)
+ * and saves the first densities and accelerations and the final particles to precision_<float|double>.chk. Once both
+ * builds have run, the second one compares them: errors of the float run against the double one, and timings.
+ */
+
+/**
+ * @brief Uniform background and a dense clump, away from the origin (positions ~ 100 with separations ~ 1e-3).
+ */
+ParticleSet clusteredSet(int n, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(99.0, 101.0);
+    std::uniform_real_distribution<double> v(-0.5, 0.5);
+    std::normal_distribution<double> clump(0.0, 0.05);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        if (i % 2) ps.add(Particle({u(rng), u(rng), u(rng), v(rng), v(rng), v(rng), 1.0 / n}));
+        else ps.add(Particle({100 + clump(rng), 100 + clump(rng), 100 + clump(rng), v(rng), v(rng), v(rng), 1.0 / n}));
+    }
+    return ps;
+}
+
+std::vector<double> flatten(const std::vector<Eigen::Vector3d>& vectors) {
+    std::vector<double> values;
+    values.reserve(3 * vectors.size());
+    for (const Eigen::Vector3d& vector : vectors) values.insert(values.end(), vector.data(), vector.data() + 3);
+    return values;
+}
+
+/**
+ * @brief Sorted relative errors of a against the reference b, in groups of `dimension` values.
+ */
+std::vector<double> relativeErrors(const std::vector<double>& a, const std::vector<double>& b, int dimension) {
+    std::vector<double> errors(b.size() / dimension);
+    for (size_t i = 0; i < errors.size(); i++) {
+        double error = 0, norm = 0;
+        for (int d = 0; d < dimension; d++) {
+            error += std::pow(a[dimension * i + d] - b[dimension * i + d], 2);
+            norm += std::pow(b[dimension * i + d], 2);
+        }
+        errors[i] = std::sqrt(error / norm);
+    }
+    std::sort(errors.begin(), errors.end());
+    return errors;
+}
+
+std::string summary(const std::vector<double>& errors) {
+    double mean = 0;
+    for (double e : errors) mean += e / errors.size();
+    return "mean " + std::to_string(mean * 1e6) + ", 99%: " + std::to_string(errors[errors.size() * 99 / 100] * 1e6) +
+           ", max: " + std::to_string(errors.back() * 1e6) + " ppm";
+}
+
+
+int main() {
+    const int n = 50000, steps = 10;
+    const double dt = 1e-3, K = 0.1, gamma = 5.0 / 3.0;
+    const std::string build = sizeof(real) < sizeof(double) ? "float" : "double";
+    const std::string other = sizeof(real) < sizeof(double) ? "double" : "float";
+
+    ParticleSet ps = clusteredSet(n);
+    QuarticKernel kernel(1.0);
+    SmoothingLengthSolver smoothing(kernel, 50);
+    NeighborList list(0.0);
+    SphSolver sph(kernel, K, gamma, 1.0, 2.0);
+    TreeGravity gravity(1e-3, 0.5);
+    gravity.setMultipoleOrder(2);
+
+    // kick-drift-kick leapfrog, every force in the precision of the build
+    auto forces = [&]() {
+        smoothing.solve(ps);
+        list.build(ps, kernel);
+        std::vector<Eigen::Vector3d> acc = sph.accelerations(ps, list);
+        std::vector<Eigen::Vector3d> g = gravity.accelerations(ps);
+        for (int i = 0; i < n; i++) acc[i] += g[i];
+        return acc;
+    };
+    Task task("Run of " + std::to_string(steps) + " steps in " + build);
+    std::vector<Eigen::Vector3d> acc = forces();
+    std::vector<double> first_densities = sph.getDensities();
+    std::vector<Eigen::Vector3d> first_acc = acc;
+    for (int step = 0; step < steps; step++) {
+        for (int i = 0; i < n; i++) {
+            Particle& p = ps.get(i);
+            p.velocity += 0.5 * dt * acc[i];
+            p.position += dt * p.velocity;
+        }
+        acc = forces();
+        for (int i = 0; i < n; i++) ps.get(i).velocity += 0.5 * dt * acc[i];
+    }
+    task.complete();
+
+    Checkpoint checkpoint;
+    checkpoint.setParticles(ps);
+    checkpoint.setValues("densities", first_densities);
+    checkpoint.setValues("accelerations", flatten(first_acc));
+    checkpoint.setValue("seconds", task.getTimeNs() * 1e-9);
+    checkpoint.write("precision_" + build + ".chk");
+
+    if (!std::ifstream("precision_" + other + ".chk")) {
+        Message("Saved precision_" + build + ".chk: run the " + other + " build (SINGLE_PRECISION=" +
+                (other == "float" ? "ON" : "OFF") + ") in the same directory to compare the two.");
+        return 0;
+    }
+    const Checkpoint previous = Checkpoint::read("precision_" + other + ".chk");
+    const Checkpoint& floats = build == "float" ? checkpoint : previous;
+    const Checkpoint& doubles = build == "float" ? previous : checkpoint;
+
+    ParticleSet end_float = floats.restoreParticles(), end_double = doubles.restoreParticles();
+    double drift = 0, mean_h = 0;
+    for (int i = 0; i < n; i++) {
+        drift = std::max(drift, (end_float.get(i).position - end_double.get(i).position).norm());
+        mean_h += end_double.get(i).smoothing_length / n;
+    }
+    std::vector<double> rho_errors = relativeErrors(floats.getValues<double>("densities"), doubles.getValues<double>("densities"), 1);
+    std::vector<double> acc_errors = relativeErrors(floats.getValues<double>("accelerations"), doubles.getValues<double>("accelerations"), 3);
+    const double t_float = floats.getValue<double>("seconds"), t_double = doubles.getValue<double>("seconds");
+
+    Message("Densities, float against double: " + summary(rho_errors));
+    Message("Accelerations (SPH and tree gravity), float against double: " + summary(acc_errors));
+    Message("After " + std::to_string(steps) + " steps, largest position difference: " + std::to_string(drift / mean_h) + " mean smoothing lengths");
+    Message("Run time: " + std::to_string(t_double) + " s in double, " + std::to_string(t_float) + " s in float (" + std::to_string(t_double / t_float) + "x)");
+
+    Test test("Float densities within 10 ppm of double on 99% of the particles");
+    test.complete(rho_errors[n * 99 / 100] < 1e-5);
+    Test test2("Float accelerations within 100 ppm of double on 99% of the particles");
+    test2.complete(acc_errors[n * 99 / 100] < 1e-4);
+    Test test3("Float trajectories within 1% of a smoothing length of double");
+    test3.complete(drift < 0.01 * mean_h);
+}
@@ -1,4 +1,5 @@
 #include "frame.hpp"
+#include "random.hpp"
 #include <Eigen/Dense>
 
 
@@ -49,17 +50,20 @@ class BouncingParticle {
         std::cout << "Particle at " << position[0] << ", " << position[1] << " with velocity " << velocity[0] << ", " << velocity[1] << std::endl;
     }
 
-    static BouncingParticle random() {
+    // the i-th particle is always the same, see random.hpp
+    static BouncingParticle random(uint64_t i) {
+        static const Philox rng(42);
+        RandomStream random(rng, i);
         BouncingParticle particle;
         particle.position = Eigen::Vector2d(
-            box[0] + (rand() % 1000) / 1000.0 * (box[1] - box[0]),
-            box[2] + (rand() % 1000) / 1000.0 * (box[3] - box[2])
+            random.uniform(box[0], box[1]),
+            random.uniform(box[2], box[3])
         );
         particle.velocity = Eigen::Vector2d(
-            (rand() % 1000 - 500) / 100.0,
-            (rand() % 1000 - 500) / 100.0
+            random.uniform(-5.0, 5.0),
+            random.uniform(-5.0, 5.0)
         );
-        particle.color = Eigen::Vector3i(rand() % 256, rand() % 256, rand() % 256);
+        particle.color = Eigen::Vector3i(int(random.uniform() * 256), int(random.uniform() * 256), int(random.uniform() * 256));
 
         return particle;
     }
@@ -146,7 +150,7 @@ int main() {
     int n_particles = 1000;
 
     for (int i = 0; i < n_particles; i++) {
-        particles.push_back(BouncingParticle::random());
+        particles.push_back(BouncingParticle::random(i));
         particles[i].print();
     }
 
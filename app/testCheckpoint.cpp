@@ -0,0 +1,135 @@
+#include "checkpoint.hpp"
+#include "gravity.hpp"
+#include <tintoretto.hpp>
+#include <random>
+#include <fstream>
+#include <cstdio>
+
+
+ParticleSet randomSet(int n, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        ps.add(Particle({u(rng), u(rng), u(rng), u(rng) - 0.5, u(rng) - 0.5, u(rng) - 0.5, 1.0 / n}));
+    }
+    return ps;
+}
+
+/**
+ * @brief Leapfrog steps with a random kick: the trajectory depends on the particles, their times and the engine.
+ */
+void evolve(ParticleSet& ps, std::mt19937_64& rng, int steps) {
+    const double dt = 1e-3;
+    DirectGravity gravity(0.05);
+    std::normal_distribution<double> noise(0.0, 1e-3);
+    for (int step = 0; step < steps; step++) {
+        std::vector<Eigen::Vector3d> acc = gravity.accelerations(ps);
+        for (int i = 0; i < ps.size(); i++) {
+            Particle& p = ps.get(i);
+            p.velocity += dt * acc[i] + Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+            p.position += dt * p.velocity;
+        }
+        ps.updateCurrentTime(dt);
+    }
+}
+
+bool identical(const ParticleSet& a, const ParticleSet& b, bool same_ids = true) {
+    if (a.size() != b.size()) return false;
+    for (int i = 0; i < a.size(); i++) {
+        const Particle& p = a.get(i);
+        const Particle& q = b.get(i);
+        if (p.position != q.position || p.velocity != q.velocity || p.mass != q.mass || p.current_time != q.current_time || (same_ids && !(p == q))) return false;
+    }
+    return true;
+}
+
+
+int main() {
+    const std::string filename = "/tmp/testCheckpoint.chk";
+
+    Test test("CRC-32 of the standard check string");
+    test.complete(Checkpoint::crc32("123456789", 9) == 0xCBF43926u);
+
+    Test test2("Round trip of particles, box, values and random engine");
+    std::mt19937_64 rng(42);
+    ParticleSet ps = randomSet(1000, rng);
+    ps.setPeriodicBox(PeriodicBox(1.0));
+    ps.updateCurrentTime(0.25);
+    Checkpoint checkpoint;
+    const int64_t previous_id = Particle().getId();
+    checkpoint.setParticles(ps);
+    const bool blocks_kept = Particle().getId() == previous_id + 1; // storing particles leaves the ids alone
+    checkpoint.saveIdCounter();
+    checkpoint.setRandomEngine("rng", rng);
+    checkpoint.setValue("step", 17);
+    checkpoint.write(filename);
+    int64_t counter = Particle::getIdCounter();
+    const int64_t next_id = Particle().getId(); // moves the id counter forward
+    Checkpoint restart = Checkpoint::read(filename);
+    ParticleSet restored = restart.restoreParticles();
+    restart.restoreIdCounter();
+    test2.complete(
+        identical(ps, restored) && blocks_kept &&
+        restored.isPeriodic() && restored.getPeriodicBox()->side == 1.0 &&
+        Particle::getIdCounter() == counter && Particle().getId() == next_id &&
+        restart.getRandomEngine<std::mt19937_64>("rng") == rng &&
+        restart.getValue<int>("step") == 17
+    );
+
+    // run 20 steps in one go, or 10 steps, a checkpoint, a restart and 10 more steps
+    Test test3("A restart reproduces the trajectory bitwise");
+    std::mt19937_64 rng_a(7), rng_b(7);
+    ParticleSet a = randomSet(500, rng_a), b = randomSet(500, rng_b);
+    evolve(a, rng_a, 20);
+    evolve(b, rng_b, 10);
+    Checkpoint middle;
+    middle.setParticles(b);
+    middle.setRandomEngine("rng", rng_b);
+    middle.write(filename);
+    Checkpoint resumed = Checkpoint::read(filename);
+    ParticleSet c = resumed.restoreParticles();
+    std::mt19937_64 rng_c = resumed.getRandomEngine<std::mt19937_64>("rng");
+    evolve(c, rng_c, 10);
+    test3.complete(identical(a, c, false)); // a and b were created apart => different ids
+
+    Test test4("A corrupted checkpoint is rejected");
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(4096 + 100); // inside the first section
+        file.put('?');
+    }
+    bool rejected = false;
+    try {
+        Checkpoint::read(filename);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(8 + 2 * 4 + Checkpoint::max_name_length + 1 + 8); // size of the first section: huge
+        for (int i = 0; i < 8; i++) file.put((char)0x7F);
+    }
+    bool rejected_table = false;
+    try {
+        Checkpoint::read(filename);
+    } catch (const std::runtime_error& error) {
+        rejected_table = std::string(error.what()).find("corrupted header") != std::string::npos;
+    }
+    test4.complete(rejected && rejected_table);
+
+    Test test5("Write and read 2 million particles");
+    ParticleSet large = randomSet(2000000, rng);
+    Checkpoint big;
+    big.setParticles(large);
+    Task write_task("Writing");
+    big.write(filename);
+    write_task.complete();
+    Task read_task("Reading");
+    ParticleSet large_restored = Checkpoint::read(filename).restoreParticles();
+    read_task.complete();
+    double megabytes = large.size() * 80.0 / 1e6;
+    Message("Write: " + std::to_string(megabytes / (write_task.getTimeNs() / 1e9)) + " MB/s, read: " + std::to_string(megabytes / (read_task.getTimeNs() / 1e9)) + " MB/s");
+    test5.complete(identical(large, large_restored));
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,109 @@
+#include "decomposition.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <random>
+#include <algorithm>
+
+
+const int n_ranks = 4;
+const int n_total = 8000;
+
+/**
+ * @brief The same global set on every rank: half uniform, half in a clump (=> an equal split along the curve
+ * is not an equal split of space).
+ */
+ParticleSet globalSet() {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::normal_distribution<double> clump(0.0, 0.1);
+    ParticleSet ps;
+    ps.reserve(n_total);
+    for (int i = 0; i < n_total; i++) {
+        if (i % 2) ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n_total}));
+        else ps.add(Particle({0.5 + clump(rng), 0.3 + clump(rng), -0.4 + clump(rng), 0.0, 0.0, 0.0, 1.0 / n_total}));
+    }
+    return ps;
+}
+
+
+int main() {
+    Parallel::setThreads(4); // the pool runs before the fork: every child must start its own
+    ParticleSet global = globalSet();
+    std::vector<Eigen::Vector3d> reference = DirectGravity(0.01).accelerations(global);
+    double single_p99 = ForceError::compare(reference, TreeGravity(0.01, 0.5).accelerations(global)).p99; // one process
+
+    Communicator::run(n_ranks, [&](Communicator& comm) {
+        if (comm.getRank() != 0) Message::mute();
+        auto all = [&](bool ok) {return comm.allreduce((int)ok, [](int a, int b) {return a * b;}) == 1;};
+
+        // badly balanced start: rank r takes a contiguous slice of the global set, rank 0 the largest
+        ParticleSet local;
+        int begin = comm.getRank() == 0 ? 0 : n_total / 2 + (comm.getRank() - 1) * n_total / 6;
+        int end = comm.getRank() == 0 ? n_total / 2 : std::min(n_total, begin + n_total / 6);
+        if (comm.getRank() == n_ranks - 1) end = n_total;
+        local.add(global.view(begin, end));
+
+        Test test("Balancing keeps every particle and evens the counts");
+        Decomposition domain(comm, 0.05);
+        domain.balance(local);
+        bool owned = true;
+        for (int i = 0; i < local.size(); i++) {
+            owned = owned && domain.owner(domain.key(local.get(i).position)) == comm.getRank();
+        }
+        test.complete(all(owned) && domain.globalCount(local) == n_total && domain.getImbalance() < 1.1);
+
+        Test test2("A second balance without motion migrates nothing");
+        int sent = domain.balance(local);
+        test2.complete(comm.allreduce(sent, [](int a, int b) {return a + b;}) == 0);
+
+        Test test3("Costs move the boundaries");
+        std::vector<double> costs(local.size());
+        for (int i = 0; i < local.size(); i++) {
+            costs[i] = local.get(i).position.x() > 0 ? 5.0 : 1.0; // the right half of the box is 5 times as expensive
+        }
+        domain.balance(local, costs);
+        double load = 0;
+        for (double c : costs) load += c;
+        double total = comm.allreduce(load, [](double a, double b) {return a + b;});
+        double largest = comm.allreduce(load, [](double a, double b) {return std::max(a, b);});
+        test3.complete(largest < 1.1 * total / n_ranks && domain.globalCount(local) == n_total);
+
+        // every neighbor of a local particle is either local or a ghost
+        Test test4("Halo exchange provides every neighbor");
+        const double radius = 0.1;
+        ParticleSet ghosts = domain.exchangeHalos(local, radius);
+        ParticleSet both(local);
+        both.add(ghosts);
+        Octree tree(both), global_tree(global);
+        std::vector<int> found, expected;
+        bool complete = true;
+        for (int i = 0; i < local.size(); i += 7) {
+            tree.neighbors(local.get(i).position, radius, found);
+            global_tree.neighbors(local.get(i).position, radius, expected);
+            complete = complete && found.size() == expected.size();
+        }
+        test4.complete(all(complete));
+
+        Test test5("Distributed tree gravity is about as accurate as a single tree");
+        TreeGravity gravity(0.01, 0.5);
+        std::vector<Eigen::Vector3d> acc = domain.accelerations(local, gravity, costs);
+        std::vector<Eigen::Vector3d> expected_acc(local.size());
+        for (int i = 0; i < local.size(); i++) {
+            int g = std::find(global.particles.begin(), global.particles.end(), local.get(i)) - global.particles.begin(); // same id
+            expected_acc[i] = reference[g];
+        }
+        ForceError error = ForceError::compare(expected_acc, acc);
+        double p99 = comm.allreduce(error.p99, [](double a, double b) {return std::max(a, b);});
+        test5.complete(p99 < 2 * single_p99 && (int)costs.size() == local.size());
+
+        Test test6("Imported sources draw no ids, and costs stay per local particle");
+        const int64_t before = Particle().getId();
+        ParticleSet sources = domain.importGravitySources(local, 0.5);
+        bool anonymous = true;
+        for (int i = 0; i < sources.size(); i++) anonymous = anonymous && sources.get(i).getId() == -1;
+        domain.balance(local, costs);
+        std::vector<Eigen::Vector3d> again = domain.accelerations(local, gravity, costs);
+        const int64_t after = Particle().getId();
+        test6.complete(all(anonymous && sources.size() > 0 && after == before + 1 && (int)costs.size() == local.size() && (int)again.size() == local.size()));
+    });
+}
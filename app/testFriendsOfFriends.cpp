@@ -0,0 +1,157 @@
+#include "friendsOfFriends.hpp"
+#include "initialConditions.hpp"
+#include "parallel.hpp"
+#include "random.hpp"
+#include <tintoretto.hpp>
+#include <algorithm>
+#include <cmath>
+
+
+/**
+ * @brief Plummer clumps of decreasing size at the given centers, in a sparse uniform background.
+ */
+ParticleSet clumps(const std::vector<Eigen::Vector3d>& centers, int per_clump, int background, double box = 10.0) {
+    ParticleSet ps;
+    for (int c = 0; c < (int)centers.size(); c++) {
+        ParticleSet clump = InitialConditions::plummer(per_clump >> c, 10 + c, 0.05, 4.0);
+        for (const Particle& p : clump.particles) {
+            Particle q = p;
+            q.position += centers[c];
+            q.velocity += Eigen::Vector3d(c, 0, 0);
+            ps.add(q);
+        }
+    }
+    ParticleSet uniform = InitialConditions::uniformCube(background, 99, box);
+    for (const Particle& p : uniform.particles) ps.add(p);
+    return ps;
+}
+
+/**
+ * @brief Labels of the groups by brute force: a breadth first search over all pairs closer than b.
+ */
+std::vector<int> bruteForce(const ParticleSet& ps, double b) {
+    const int n = ps.size();
+    std::vector<int> root(n, -1);
+    for (int i = 0; i < n; i++) {
+        if (root[i] >= 0) continue;
+        std::vector<int> queue = {i};
+        root[i] = i;
+        for (size_t q = 0; q < queue.size(); q++) {
+            for (int j = 0; j < n; j++) {
+                if (root[j] < 0 && (ps.get(queue[q]).position - ps.get(j).position).norm() <= b) {
+                    root[j] = i;
+                    queue.push_back(j);
+                }
+            }
+        }
+    }
+    return root;
+}
+
+
+int main() {
+    Parallel::setThreads(4);
+
+    Test test("Concurrent union-find: the same sets as serial unions, smallest element as root");
+    const int n_elements = 200000;
+    std::vector<int> first(n_elements), second(n_elements);
+    RandomStream random(Philox(5), 0);
+    for (int k = 0; k < n_elements; k++) {
+        first[k] = random.uniform() * n_elements;
+        second[k] = std::min(n_elements - 1, first[k] + (int)(random.uniform() * 100)); // chains of neighbouring elements
+    }
+    ConcurrentUnionFind concurrent(n_elements);
+    Parallel::forDynamic(n_elements, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) concurrent.unite(first[k], second[k]);
+    }, 16);
+    ConcurrentUnionFind serial(n_elements);
+    for (int k = 0; k < n_elements; k++) serial.unite(first[k], second[k]);
+    bool same = true;
+    for (int i = 0; i < n_elements; i++) {
+        const int root = concurrent.find(i);
+        same = same && root == serial.find(i) && root <= i && concurrent.find(root) == root;
+    }
+    test.complete(same);
+
+    Test test2("Groups match a brute force friends-of-friends");
+    const std::vector<Eigen::Vector3d> centers = {{2, 2, 2}, {7, 3, 5}, {4, 8, 7}};
+    ParticleSet ps = clumps(centers, 1600, 1000);
+    const double b = 0.05;
+    FriendsOfFriends fof(b, 10);
+    const std::vector<FofGroup>& groups = fof.find(ps);
+    const std::vector<int> reference = bruteForce(ps, b);
+    std::vector<int> sizes(ps.size(), 0);
+    for (int i = 0; i < ps.size(); i++) sizes[reference[i]]++;
+    bool match = true;
+    for (int i = 0; i < ps.size(); i++) {
+        // the root of the search is the smallest index of the group
+        const int label = fof.getLabels()[i];
+        if (label >= 0) match = match && groups[label].first == reference[i] && groups[label].members == sizes[reference[i]];
+        else match = match && sizes[reference[i]] < 10;
+    }
+    Message("Groups: " + std::to_string(groups.size()) + ", largest: " + std::to_string(groups.empty() ? 0 : groups[0].members) + " particles");
+    test2.complete(match && groups.size() >= 3 && std::is_sorted(groups.begin(), groups.end(), [](const FofGroup& x, const FofGroup& y) {return x.members > y.members;}));
+
+    Test test3("Catalog: mass, center of mass and velocity dispersion");
+    bool consistent = true;
+    for (int g = 0; g < std::min<int>(3, groups.size()); g++) {
+        double mass = 0;
+        Eigen::Vector3d com = Eigen::Vector3d::Zero(), momentum = Eigen::Vector3d::Zero();
+        for (int i = 0; i < ps.size(); i++) {
+            if (fof.getLabels()[i] != g) continue;
+            mass += ps.get(i).mass;
+            com += ps.get(i).mass * ps.get(i).position;
+            momentum += ps.get(i).mass * ps.get(i).velocity;
+        }
+        const Eigen::Vector3d velocity = momentum / mass;
+        double dispersion = 0;
+        for (int i = 0; i < ps.size(); i++) {
+            if (fof.getLabels()[i] == g) dispersion += ps.get(i).mass * (ps.get(i).velocity - velocity).squaredNorm();
+        }
+        dispersion = std::sqrt(dispersion / (3 * mass));
+        consistent = consistent && std::abs(groups[g].mass - mass) < 1e-12 &&
+                     (groups[g].center_of_mass - com / mass).norm() < 1e-12 &&
+                     (groups[g].velocity - velocity).norm() < 1e-12 && std::abs(groups[g].velocity_dispersion - dispersion) < 1e-12;
+        // every clump moves at its own speed, and is found at its center
+        consistent = consistent && (groups[g].center_of_mass - centers[g]).norm() < 0.05 && std::abs(groups[g].velocity.x() - g) < 0.1;
+    }
+    test3.complete(consistent);
+
+    Test test4("Periodic: a clump across the boundary is one group, centered inside the box");
+    ParticleSet periodic = clumps({{0.01, 5, 5}}, 1600, 1000);
+    periodic.setPeriodicBox(PeriodicBox(10.0));
+    periodic.wrap();
+    FriendsOfFriends periodic_fof(b, 10);
+    const std::vector<FofGroup>& periodic_groups = periodic_fof.find(periodic);
+    test4.complete(!periodic_groups.empty() && periodic_groups[0].members > 1400 &&
+                   (PeriodicBox(10.0).minimumImage(periodic_groups[0].center_of_mass - Eigen::Vector3d(0.01, 5, 5))).norm() < 0.05 &&
+                   periodic_groups[0].center_of_mass.minCoeff() >= 0);
+
+    Test test5("The catalog does not depend on the number of threads");
+    auto catalog = [&](int threads) {
+        Parallel::setThreads(threads);
+        FriendsOfFriends f(b, 10);
+        f.find(ps);
+        return std::make_pair(f.getLabels(), f.getGroups().size());
+    };
+    test5.complete(catalog(1) == catalog(4));
+
+    // 100 clumps on a grid and a background, a million particles
+    Parallel::setThreads(0);
+    ParticleSet large = InitialConditions::uniformCube(500000, 3, 100.0);
+    for (int c = 0; c < 100; c++) {
+        ParticleSet clump = InitialConditions::plummer(5000, 100 + c, 0.3, 4.0);
+        const Eigen::Vector3d center(10 + (c % 5) * 20, 10 + (c / 5 % 5) * 20, 10 + c / 25 * 25);
+        for (Particle p : clump.particles) {
+            p.position += center;
+            large.add(p);
+        }
+    }
+    FriendsOfFriends halos(FriendsOfFriends::linkingLength(large, 0.2), 32);
+    Parallel::resetPhases();
+    Task timing("Friends-of-friends on a million particles");
+    halos.find(large);
+    timing.complete();
+    Message(std::to_string(halos.getGroups().size()) + " groups of 32 particles or more");
+    Parallel::report();
+}
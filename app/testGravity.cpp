@@ -0,0 +1,110 @@
+#include "gravity.hpp"
+#include "fmm.hpp"
+#include <tintoretto.hpp>
+#include <random>
+
+
+ParticleSet uniformCube(int n, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+    }
+    return ps;
+}
+
+
+int main() {
+    // two bodies: the acceleration is known exactly
+    Test test("Direct gravity, two bodies with softening");
+    ParticleSet pair = {Particle({0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 2.0}), Particle({3.0, 4.0, 0.0, 0.0, 0.0, 0.0, 1.0})};
+    DirectGravity softened(1.0, 0.5);
+    std::vector<Eigen::Vector3d> acc = softened.accelerations(pair);
+    Eigen::Vector3d expected = 0.5 * 1.0 * Eigen::Vector3d(3.0, 4.0, 0.0) / std::pow(25.0 + 1.0, 1.5);
+    test.complete(
+        (acc[0] - expected).norm() < 1e-12 &&
+        (acc[1] + 2.0 * expected).norm() < 1e-12
+    );
+
+    // total momentum is conserved => sum of m a vanishes
+    Test test2("Direct gravity conserves momentum");
+    ParticleSet cube = uniformCube(5000);
+    DirectGravity direct(0.01);
+    acc = direct.accelerations(cube);
+    Eigen::Vector3d force = Eigen::Vector3d::Zero();
+    double scale = 0;
+    for (int i = 0; i < cube.size(); i++) {
+        force += cube.get(i).mass * acc[i];
+        scale += cube.get(i).mass * acc[i].norm();
+    }
+    test2.complete(force.norm() < 1e-10 * scale);
+
+    Test test3("Force error of the reference against itself");
+    ForceError error = ForceError::compare(acc, acc);
+    test3.complete(error.max == 0.0 && error.count == cube.size());
+
+    Test test4("Tree: quadrupoles beat monopoles at the same opening angle");
+    TreeGravity monopole(0.01, 0.6);
+    TreeGravity quadrupole(0.01, 0.6);
+    quadrupole.setMultipoleOrder(2);
+    ForceError error_monopole = ForceError::compare(acc, monopole.accelerations(cube));
+    ForceError error_quadrupole = ForceError::compare(acc, quadrupole.accelerations(cube));
+    test4.complete(error_quadrupole.mean < 0.5 * error_monopole.mean);
+
+    Test test5("Tree: every opening criterion reaches 0.1% on 99% of the particles");
+    bool all_accurate = true;
+    for (OpeningCriterion criterion : {OpeningCriterion::Relative, OpeningCriterion::SalmonWarren}) {
+        TreeGravity tree(0.01);
+        tree.setMultipoleOrder(2);
+        tree.setOpeningCriterion(criterion, 0.0005);
+        all_accurate = all_accurate && ForceError::compare(acc, tree.accelerations(cube)).p99 < 1e-3;
+    }
+    TreeGravity geometric(0.01, 0.3);
+    geometric.setMultipoleOrder(2);
+    test5.complete(all_accurate && ForceError::compare(acc, geometric.accelerations(cube)).p99 < 1e-3);
+
+    Test test6("FMM converges with the expansion order");
+    double previous_error = 1.0;
+    bool converges = true;
+    for (int order : {2, 4, 6}) {
+        FmmGravity fmm(0.01, order, 0.5);
+        double error = ForceError::compare(acc, fmm.accelerations(cube)).mean;
+        converges = converges && error < 0.5 * previous_error;
+        previous_error = error;
+    }
+    test6.complete(converges);
+
+    Test test7("Tree: group walks are as accurate, with far fewer traversals");
+    TreeGravity single(0.01, 0.5), grouped(0.01, 0.5);
+    single.setMultipoleOrder(2);
+    grouped.setMultipoleOrder(2);
+    grouped.setGroupSize(32);
+    Task single_task("One walk per particle");
+    ForceError error_single = ForceError::compare(acc, single.accelerations(cube));
+    single_task.complete();
+    Task grouped_task("One walk per group of 32");
+    ForceError error_grouped = ForceError::compare(acc, grouped.accelerations(cube));
+    grouped_task.complete();
+    Message("Walks: " + std::to_string(single.getWalks()) + " against " + std::to_string(grouped.getWalks()) +
+            ", 99% error: " + std::to_string(error_single.p99) + " against " + std::to_string(error_grouped.p99));
+    test7.complete(error_grouped.p99 <= error_single.p99 && 8 * grouped.getWalks() < single.getWalks());
+
+    // the other particles are in the tree, but do not walk it
+    Test test8("Tree: only the targets walk the tree");
+    TreeGravity all_walk(0.01, 0.5), target_walk(0.01, 0.5), group_walk(0.01, 0.5);
+    group_walk.setGroupSize(32);
+    std::vector<Eigen::Vector3d> acc_all = all_walk.accelerations(cube);
+    std::vector<Eigen::Vector3d> acc_targets = target_walk.accelerations(cube, 1000);
+    std::vector<Eigen::Vector3d> acc_groups = group_walk.accelerations(cube, 1000);
+    acc_all.resize(1000);
+    std::vector<Eigen::Vector3d> reference(acc.begin(), acc.begin() + 1000);
+    test8.complete(
+        acc_targets.size() == 1000 && target_walk.getCosts().size() == 1000 && acc_targets == acc_all &&
+        4 * target_walk.getNodeInteractions() < all_walk.getNodeInteractions() &&
+        ForceError::compare(reference, acc_groups).p99 < 2 * ForceError::compare(reference, acc_all).p99
+    );
+
+    return 0;
+}
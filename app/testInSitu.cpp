@@ -0,0 +1,140 @@
+#include "analysis.hpp"
+#include "initialConditions.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cmath>
+
+
+/**
+ * @brief Records the steps it ran at and the mean x of their snapshots, slowly enough for the next steps to overlap it.
+ */
+class SlowAnalysis : public Analysis {
+    public:
+        std::vector<int> steps;
+        std::vector<double> mean_x; // of the snapshot it was given
+        std::atomic<bool> busy{false};
+
+        std::string getName() const override {return "slow";}
+        AnalysisTable compute(const ParticleSnapshot& snapshot, int step, double) override {
+            busy = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            double x = 0;
+            for (int i = 0; i < snapshot.size(); i++) x += snapshot.get(i).position.x() / snapshot.size();
+            steps.push_back(step);
+            mean_x.push_back(x);
+            busy = false;
+            return {{"mean_x"}, {{x}}};
+        }
+};
+
+class FailingAnalysis : public Analysis {
+    public:
+        std::string getName() const override {return "failing";}
+        AnalysisTable compute(const ParticleSnapshot&, int, double) override {throw std::runtime_error("no luck");}
+};
+
+int lines(const std::string& filename) {
+    std::ifstream file(filename);
+    std::string line;
+    int count = 0;
+    while (std::getline(file, line)) count++;
+    return count;
+}
+
+
+int main() {
+    Parallel::setThreads(4);
+    ParticleSet cluster = InitialConditions::plummer(100000, 17);
+
+    // Plummer: rho(r) = 3 M / (4 pi a^3) (1 + r^2 / a^2)^(-5/2), with M = a = 1
+    Test test("Radial profile of a Plummer sphere");
+    RadialProfile profile(20, 0.1, 5.0);
+    AnalysisTable shells = profile.compute(cluster.snapshot(), 0, 0.0);
+    double worst = 0, mass = 0;
+    for (const std::vector<double>& row : shells.rows) {
+        const double r = std::sqrt(row[0] * row[1]);
+        const double expected = 3 / (4 * M_PI) * std::pow(1 + r * r, -2.5);
+        if (row[2] > 500) worst = std::max(worst, std::abs(row[4] / expected - 1)); // shells with little noise
+        mass += row[3];
+    }
+    Message("Worst density error: " + std::to_string(worst * 100) + " %");
+    test.complete(shells.rows.size() == 20 && shells.columns.size() == shells.rows[0].size() && worst < 0.1 && mass < 1.0 && mass > 0.9);
+
+    // W = -3 pi / 32 G M^2 / a for a Plummer sphere, in virial equilibrium
+    Test test2("Energy budget of a Plummer sphere");
+    AnalysisTable budget = EnergyBudget(0.001, 0.5).compute(cluster.snapshot(), 0, 0.0);
+    const double kinetic = budget.rows[0][0], potential = budget.rows[0][1];
+    Message("K = " + std::to_string(kinetic) + ", W = " + std::to_string(potential) + " (" + std::to_string(-3 * M_PI / 32) + "), 2K / |W| = " + std::to_string(budget.rows[0][3]));
+    test2.complete(std::abs(kinetic - cluster.getStatistics().kinetic_energy) < 1e-12 && std::abs(potential / (-3 * M_PI / 32) - 1) < 0.02 &&
+                   std::abs(budget.rows[0][3] - 1) < 0.05);
+
+    Test test3("Projected map: all the mass inside the square, none outside");
+    ParticleSet cube = InitialConditions::uniformCube(20000, 3, 1.0);
+    AnalysisTable map = ProjectedMap(16, 1.0, Eigen::Vector3d(0.5, 0.5, 0.5), 2).compute(cube.snapshot(), 0, 0.0);
+    const double pixel_area = (2.0 / 16) * (2.0 / 16);
+    double projected = 0;
+    bool empty_outside = true;
+    for (const std::vector<double>& row : map.rows) {
+        projected += row[2] * pixel_area;
+        if (row[0] < -0.07 || row[0] > 1.07 || row[1] < -0.07 || row[1] > 1.07) empty_outside = empty_outside && row[2] == 0;
+    }
+    test3.complete(map.rows.size() == 256 && std::abs(projected - 1) < 1e-12 && empty_outside);
+
+    // a toy run: drift every particle each step while the analyses of the previous steps run
+    Test test4("Analyses run on their own lanes, on the particles of their step");
+    const std::string prefix = "/tmp/testInSitu_";
+    ParticleSet ps = InitialConditions::uniformCube(20000, 5, 1.0);
+    std::vector<double> expected_x;
+    SlowAnalysis* slow = new SlowAnalysis();
+    int overlapped = 0, snapshots = 0;
+    double step_seconds = 0;
+    {
+        InSitu in_situ(2, 2);
+        int slow_index = in_situ.add(std::unique_ptr<Analysis>(slow), 2, prefix + "slow.csv");
+        in_situ.add(std::make_unique<EnergyBudget>(0.01), 5, prefix + "energy.csv");
+        in_situ.add(std::make_unique<RadialProfile>(8, 0.01, 2.0, Eigen::Vector3d::Constant(0.5)), 10, prefix + "profile.csv");
+        for (int step = 0; step < 20; step++) {
+            if (step % 2 == 0) expected_x.push_back(ps.getStatistics().center_of_mass.x());
+            if (step % 2 == 0 || step % 5 == 0) snapshots++;
+            const auto start = std::chrono::steady_clock::now();
+            in_situ.step(ps, step, 0.1 * step);
+            step_seconds = std::max(step_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            Parallel::forRange(ps.size(), [&](int begin, int end) {
+                for (int i = begin; i < end; i++) ps.particles[i].position.x() += 0.01;
+            });
+            ps.invalidate();
+            overlapped += slow->busy;
+        }
+        in_situ.wait();
+        test4.complete(
+            slow->steps == std::vector<int>({0, 2, 4, 6, 8, 10, 12, 14, 16, 18}) && overlapped > 0 &&
+            std::equal(expected_x.begin(), expected_x.end(), slow->mean_x.begin(), [](double a, double b) {return std::abs(a - b) < 1e-12;}) &&
+            in_situ.getLast(slow_index).rows[0][0] == slow->mean_x.back()
+        );
+
+        Test test5("Only the small results are written");
+        const long long snapshot_bytes = snapshots * sizeof(Particle) * (long long)ps.size(); // had they been written out
+        Message("Written: " + std::to_string(in_situ.getBytesWritten()) + " bytes, against " + std::to_string(snapshot_bytes) + " for the snapshots");
+        test5.complete(lines(prefix + "slow.csv") == 1 + 10 && lines(prefix + "energy.csv") == 1 + 4 && lines(prefix + "profile.csv") == 1 + 2 * 8 &&
+                       in_situ.getBytesWritten() < snapshot_bytes / 1000);
+    }
+    Message("Longest step() call: " + std::to_string(step_seconds * 1e3) + " ms");
+
+    Test test6("Errors of an analysis come back to the simulation");
+    bool caught = false;
+    {
+        InSitu in_situ;
+        in_situ.add(std::make_unique<FailingAnalysis>(), 1, prefix + "failing.csv");
+        in_situ.step(ps, 0, 0.0);
+        try {
+            in_situ.wait();
+        } catch (const std::runtime_error& e) {
+            caught = std::string(e.what()) == "no luck";
+        }
+    }
+    test6.complete(caught);
+}
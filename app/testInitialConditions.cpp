@@ -0,0 +1,107 @@
+#include "initialConditions.hpp"
+#include "gravity.hpp"
+#include "neighborSearch.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <functional>
+#include <algorithm>
+
+
+/**
+ * @brief Same positions and velocities, bit for bit.
+ */
+bool identical(const ParticleSet& a, const ParticleSet& b) {
+    if (a.size() != b.size()) return false;
+    for (int i = 0; i < a.size(); i++) {
+        if (a.particles[i].position != b.particles[i].position || a.particles[i].velocity != b.particles[i].velocity) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 2K / |W|, 1 for a system in virial equilibrium. W = sum m x.a holds for pairwise Newtonian forces.
+ */
+double virialRatio(const ParticleSet& ps) {
+    std::vector<Eigen::Vector3d> acc = DirectGravity(1e-3).accelerations(ps);
+    double kinetic = 0, potential = 0;
+    for (int i = 0; i < ps.size(); i++) {
+        const Particle& p = ps.particles[i];
+        kinetic += 0.5 * p.mass * p.velocity.squaredNorm();
+        potential += p.mass * p.position.dot(acc[i]);
+    }
+    return 2 * kinetic / std::abs(potential);
+}
+
+
+int main() {
+    Test test("Philox4x32-10 known answers");
+    std::array<uint32_t, 4> zeros = Philox(0)({0, 0, 0, 0});
+    std::array<uint32_t, 4> ones = Philox(~0ull)({~0u, ~0u, ~0u, ~0u});
+    test.complete(zeros == std::array<uint32_t, 4>{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8} &&
+                  ones == std::array<uint32_t, 4>{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd});
+
+    Test test2("Bit for bit the same set on 1 and 4 threads");
+    std::vector<std::function<ParticleSet()>> generators = {
+        [] {return InitialConditions::uniformCube(20000, 1);},
+        [] {return InitialConditions::uniformSphere(20000, 2);},
+        [] {return InitialConditions::plummer(20000, 3);},
+        [] {return InitialConditions::hernquist(20000, 4);},
+        [] {return InitialConditions::glass(8000, 5, 1.0, 10);}
+    };
+    bool reproducible = true;
+    for (const std::function<ParticleSet()>& generate : generators) {
+        Parallel::setThreads(1);
+        ParticleSet serial = generate();
+        Parallel::setThreads(4);
+        ParticleSet parallel = generate();
+        reproducible = reproducible && identical(serial, parallel);
+    }
+    Parallel::setThreads(0);
+    test2.complete(reproducible && !identical(ParticleSet::random(1000, 1), ParticleSet::random(1000, 2)) &&
+                   identical(ParticleSet::random(1000, 1), InitialConditions::uniformCube(1000, 1)));
+
+    Test test3("Uniform profiles");
+    ParticleSet cube = ParticleSet::random(100000, 7);
+    ParticleSet sphere = ParticleSet::random_sphere(100000, 7);
+    double inside = 0, r3 = 0;
+    for (int i = 0; i < sphere.size(); i++) {
+        double r = sphere.particles[i].position.norm();
+        inside += r <= 1.0;
+        r3 += r * r * r / sphere.size();
+    }
+    test3.complete((cube.getStatistics().center_of_mass - Eigen::Vector3d::Constant(0.5)).norm() < 0.005 &&
+                   cube.getStatistics().bbox_min.minCoeff() >= 0 && cube.getStatistics().bbox_max.maxCoeff() < 1 &&
+                   inside == sphere.size() && std::abs(r3 - 0.5) < 0.005 && std::abs(cube.getStatistics().total_mass - 1.0) < 1e-9);
+
+    Test test4("Plummer and Hernquist spheres are in virial equilibrium");
+    double plummer = virialRatio(InitialConditions::plummer(10000, 11));
+    double hernquist = virialRatio(InitialConditions::hernquist(10000, 12));
+    Message("2K / |W|: Plummer " + std::to_string(plummer) + ", Hernquist " + std::to_string(hernquist));
+    test4.complete(std::abs(plummer - 1) < 0.05 && std::abs(hernquist - 1) < 0.1);
+
+    // a glass has no close pairs, unlike a random set
+    Test test5("Glass is more regular than a random set");
+    auto closest = [](const ParticleSet& ps) {
+        const double spacing = 1.0 / std::cbrt(ps.size());
+        CellGrid grid(ps, spacing);
+        std::vector<int> found;
+        double d_min = spacing;
+        for (int i = 0; i < ps.size(); i++) {
+            grid.neighbors(ps.particles[i].position, spacing, found);
+            for (int j : found) {
+                if (j != i) d_min = std::min(d_min, ps.getPeriodicBox()->minimumImage(ps.particles[i].position - ps.particles[j].position).norm());
+            }
+        }
+        return d_min / spacing;
+    };
+    ParticleSet random = InitialConditions::uniformCube(32768, 9);
+    random.setPeriodicBox(PeriodicBox(1.0));
+    double random_closest = closest(random);
+    double glass_closest = closest(InitialConditions::glass(32768, 9));
+    Message("Closest pair, in mean spacings: " + std::to_string(random_closest) + " random, " + std::to_string(glass_closest) + " glass");
+    test5.complete(glass_closest > 0.5 && glass_closest > 10 * random_closest);
+
+    Task timing("Plummer sphere, N = 1000000");
+    ParticleSet large = InitialConditions::plummer(1000000, 13);
+    timing.complete();
+}
@@ -3,7 +3,7 @@
 #include <typeinfo>
 
 
-void testKernel(Kernel& kernel, std::string className) { // you need to pass addres here since Kernel can't be constructed or copied => it's virtual
+void testKernel(BasicKernel<double>& kernel, std::string className) { // you need to pass addres here since Kernel can't be constructed or copied => it's virtual
     
     // let's compute the integral of the kernel
     Test test(className + " integral = 1");
@@ -36,14 +36,41 @@ void testKernel(Kernel& kernel, std::string className) { // you need to pass add
     test2.complete(
         (grad - grad_custom).norm() < 1e-6
     );
+
+    Test test3(className + " with a per pair smoothing radius");
+    double h2 = 0.5 * h;
+    Eigen::Vector3d r2 = 0.3 * r;
+    test3.complete(
+        std::abs(kernel(r, h) - kernel(r)) < 1e-15 &&
+        std::abs(kernel(r2, h2) - 8 * kernel(2 * r2)) < 1e-12 * kernel(r2, h2) &&
+        (kernel.gradient(r2, h2) - 16 * kernel.gradient(2 * r2)).norm() < 1e-12 * kernel.gradient(r2, h2).norm()
+    );
+
+    Test test4(className + " derivative w.r.t. h");
+    double dh = 1e-6 * h;
+    double dh_custom = (kernel(r.norm(), h + dh) - kernel(r.norm(), h - dh)) / (2 * dh);
+    test4.complete(
+        std::abs(kernel.dh(r.norm(), h) - dh_custom) < 1e-6 * std::abs(dh_custom)
+    );
+
+    Test test5(className + " fused sample");
+    KernelSample<double> s = kernel.sample(r2.squaredNorm(), h2);
+    KernelSample<double> outside = kernel.sample(1.01 * h2 * h2, h2);
+    test5.complete(
+        std::abs(s.value - kernel(r2, h2)) < 1e-12 * kernel(r2, h2) &&
+        (s.gradient(r2) - kernel.gradient(r2, h2)).norm() < 1e-12 * kernel.gradient(r2, h2).norm() &&
+        std::abs(s.dh - kernel.dh(r2.norm(), h2)) < 1e-12 * std::abs(kernel.dh(r2.norm(), h2)) &&
+        outside.value == 0 && outside.gradient_factor == 0 && outside.dh == 0 &&
+        kernel.sample(0, h).gradient_factor == 0
+    );
 }
 
 
 int main() {
-    double h = 10.0;
-    LinearKernel lkernel(h);
+    double h = 10.0; // the kernels in double whatever the build (see precision.hpp): the tolerances are those of double
+    BasicLinearKernel<double> lkernel(h);
     testKernel(lkernel, "LinearKernel");
-    QuarticKernel qkernel(h);
+    BasicQuarticKernel<double> qkernel(h);
     testKernel(qkernel, "QuarticKernel");
 }
 
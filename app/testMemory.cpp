@@ -0,0 +1,107 @@
+#include "memory.hpp"
+#include "parallel.hpp"
+#include "particleSet.hpp"
+#include <tintoretto.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+
+/**
+ * @brief Triad a = b + s c over the whole arrays, in parallel: a bandwidth bound loop.
+ */
+template <typename Vector>
+void triad(Vector& a, const Vector& b, const Vector& c, int repeats) {
+    for (int r = 0; r < repeats; r++) {
+        Parallel::forRange(a.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) a[i] = b[i] + 0.5 * c[i];
+        });
+    }
+}
+
+
+int main() {
+    Test test("Arrays come zeroed and cache line aligned");
+    NumaVector<double> x(1000000);
+    NumaVector<Particle> particles(1000);
+    test.complete(
+        std::all_of(x.begin(), x.end(), [](double v) {return v == 0.0;}) &&
+        (uintptr_t)x.data() % Memory::alignment == 0 && (uintptr_t)particles.data() % Memory::alignment == 0
+    );
+
+    Test test2("Large arrays are aligned on huge pages");
+    Memory::setHugePages(true);
+    NumaVector<double> large(1 << 20); // 8 MB
+    NumaVector<double> small(100);
+    Memory::setHugePages(false);
+    test2.complete((uintptr_t)large.data() % Memory::huge_page_size == 0 && (uintptr_t)small.data() % Memory::alignment == 0);
+
+    Test test3("Placed arrays come zeroed, without loops for small ones");
+    Parallel::setThreads(4);
+    Parallel::resetPhases();
+    NumaVector<double> placed = Memory::array<double>(Parallel::chunkBounds(1 << 20)); // 8 MB: one loop
+    NumaVector<float> tiny = Memory::array<float>(Parallel::chunkBounds(100)); // none
+    std::map<std::string, Parallel::PhaseStats> phases = Parallel::getPhases();
+    test3.complete(
+        placed.size() == (1 << 20) && std::all_of(placed.begin(), placed.end(), [](double v) {return v == 0.0;}) &&
+        tiny.size() == 100 && std::all_of(tiny.begin(), tiny.end(), [](float v) {return v == 0.0f;}) &&
+        phases.size() == 1 && phases["first touch"].loops == 1
+    );
+
+#ifdef __linux__
+    // first touch only places pages well if a chunk always runs on the same core
+    Test test4("Pinned chunks always run on the same core of the affinity mask");
+    cpu_set_t mask;
+    sched_getaffinity(0, sizeof(mask), &mask);
+    std::vector<int> cores;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &mask)) cores.push_back(c);
+    }
+    Parallel::setPinning(true);
+    bool pinned = true;
+    for (int repeat = 0; repeat < 3; repeat++) {
+        Parallel::forChunks(4 * Parallel::min_chunk, [&](int chunk, int, int) {
+            if (sched_getcpu() != cores[chunk % cores.size()]) pinned = false;
+        });
+    }
+    cpu_set_t after;
+    sched_getaffinity(0, sizeof(after), &after);
+    Parallel::setPinning(false);
+    Parallel::setThreads(0);
+    test4.complete(pinned && CPU_EQUAL(&mask, &after)); // the calling thread got its mask back
+#endif
+
+    Test test5("Particle sets are placed when filled, reserved and grown");
+    Parallel::setThreads(4);
+    Parallel::resetPhases();
+    const int n_particles = 2 * Memory::huge_page_size / sizeof(Particle);
+    ParticleSet set;
+    set.reserve(n_particles); // one loop
+    for (int i = 0; i < n_particles + 1; i++) set.add(Particle({double(i), 0.0, 0.0, 0.0, 0.0, 0.0, 1.0})); // one, growing
+    ParticleSet copy(set); // one
+    bool kept = copy.size() == n_particles + 1 && (uintptr_t)copy.particles.data() % Memory::alignment == 0;
+    for (int i = 0; i < copy.size(); i++) kept = kept && copy.particles[i].position.x() == i;
+    ParticleSet few = {Particle({0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0})}; // none
+    phases = Parallel::getPhases();
+    Parallel::setThreads(0);
+    test5.complete(kept && phases.size() == 1 && phases["first touch"].loops == 3);
+
+    // on a single NUMA node both are the same, on several the first touched arrays should win
+    const int n = 1 << 22;
+    std::vector<double> a(n), b(n, 1.0), c(n, 2.0);
+    NumaVector<double> a_numa = Memory::array<double>(Parallel::chunkBounds(n));
+    NumaVector<double> b_numa = Memory::array<double>(Parallel::chunkBounds(n)), c_numa = Memory::array<double>(Parallel::chunkBounds(n));
+    std::fill(b_numa.begin(), b_numa.end(), 1.0);
+    std::fill(c_numa.begin(), c_numa.end(), 2.0);
+    Task serial("Triad, serially touched arrays, 4M doubles x 20");
+    triad(a, b, c, 20);
+    serial.complete();
+    Task numa("Triad, first touched arrays, 4M doubles x 20");
+    triad(a_numa, b_numa, c_numa, 20);
+    numa.complete();
+    Message("Bandwidth: " + std::to_string(20 * 24.0 * n / serial.getTimeNs()) + " GB/s serially touched, " +
+            std::to_string(20 * 24.0 * n / numa.getTimeNs()) + " GB/s first touched");
+}
@@ -0,0 +1,74 @@
+#include "neighborList.hpp"
+#include "smoothing.hpp"
+#include <tintoretto.hpp>
+#include <random>
+
+
+ParticleSet uniformCube(int n, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+    }
+    return ps;
+}
+
+void shake(ParticleSet& ps, double amplitude, std::mt19937& rng) {
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    for (Particle& p : ps.particles) {
+        Eigen::Vector3d d(u(rng), u(rng), u(rng));
+        p.position += amplitude * d / std::max(d.norm(), 1.0);
+    }
+    ps.invalidate();
+}
+
+/**
+ * @brief Every pair closer than h_i is in the list of i.
+ */
+bool complete(const ParticleSet& ps, const NeighborList& list) {
+    Octree tree(ps);
+    std::vector<int> found;
+    for (int i = 0; i < ps.size(); i += 13) {
+        tree.neighbors(ps.get(i).position, ps.get(i).smoothing_length, found);
+        NeighborRange range = list.neighbors(i);
+        for (int j : found) {
+            if (std::find(range.begin(), range.end(), j) == range.end()) return false;
+        }
+    }
+    return true;
+}
+
+
+int main() {
+    ParticleSet ps = uniformCube(20000);
+    QuarticKernel kernel(1.0);
+    SmoothingLengthSolver(kernel, 40).solve(ps);
+    double h = ps.get(0).smoothing_length;
+    NeighborList list(0.2 * h);
+    std::mt19937 rng(1);
+
+    Test test("Built lists hold every neighbor, in CSR layout");
+    bool rebuilt = list.update(ps, kernel);
+    Message("Memory: " + std::to_string(list.getMemory() / 1e6) + " MB for " + std::to_string(list.getIndices().size()) + " entries");
+    test.complete(rebuilt && list.size() == ps.size() && list.getOffsets().back() == (int)list.getIndices().size() && complete(ps, list));
+
+    Test test2("Small moves keep the lists, which stay complete");
+    bool kept = true;
+    for (int step = 0; step < 4; step++) {
+        shake(ps, 0.02 * h, rng); // 4 * 0.02 h < half of the skin
+        kept = kept && !list.update(ps, kernel);
+    }
+    test2.complete(kept && list.getReuses() == 4 && complete(ps, list));
+
+    Test test3("A large move triggers a rebuild");
+    shake(ps, 0.2 * h, rng);
+    rebuilt = list.update(ps, kernel);
+    test3.complete(rebuilt && list.getRebuilds() == 2 && complete(ps, list));
+
+    Test test4("Growing smoothing lengths trigger a rebuild");
+    for (Particle& p : ps.particles) p.smoothing_length *= 1.3;
+    ps.invalidate();
+    test4.complete(list.update(ps, kernel) && complete(ps, list));
+}
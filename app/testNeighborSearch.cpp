@@ -0,0 +1,94 @@
+#include "neighborSearch.hpp"
+#include "octree.hpp"
+#include <tintoretto.hpp>
+#include <random>
+#include <algorithm>
+
+
+ParticleSet uniformCube(int n, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+    }
+    return ps;
+}
+
+/**
+ * @brief Half of the particles in a uniform cube, half in a small clump at its center.
+ */
+ParticleSet clumpedCube(int n, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::normal_distribution<double> clump(0.5, 0.03);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        if (i % 2) ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+        else ps.add(Particle({clump(rng), clump(rng), clump(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+    }
+    return ps;
+}
+
+/**
+ * @brief Both indices return the same particles for queries around every 7th particle.
+ */
+bool sameNeighbors(const NeighborSearch& a, const NeighborSearch& b, const ParticleSet& ps, double radius) {
+    std::vector<int> found_a, found_b;
+    for (int i = 0; i < ps.size(); i += 7) {
+        a.neighbors(ps.get(i).position, radius, found_a);
+        b.neighbors(ps.get(i).position, radius, found_b);
+        std::sort(found_a.begin(), found_a.end());
+        std::sort(found_b.begin(), found_b.end());
+        if (found_a != found_b || found_a.empty()) return false;
+    }
+    return true;
+}
+
+
+int main() {
+    const int n = 200000;
+    ParticleSet uniform = uniformCube(n);
+    const double h = std::cbrt(40.0 / (4.0 / 3.0 * M_PI * n)); // about 40 neighbors
+
+    Test test("Grid and tree find the same neighbors");
+    CellGrid grid(uniform, h);
+    Octree tree(uniform);
+    test.complete(sameNeighbors(grid, tree, uniform, h) && sameNeighbors(grid, tree, uniform, 2.5 * h));
+
+    Test test2("Same across periodic boundaries");
+    ParticleSet periodic = uniformCube(20000, 3);
+    periodic.setPeriodicBox(PeriodicBox(1.0));
+    test2.complete(sameNeighbors(CellGrid(periodic, 0.05), Octree(periodic), periodic, 0.05) &&
+                   sameNeighbors(CellGrid(periodic, 0.05), Octree(periodic), periodic, 0.3));
+
+    Test test3("The grid is chosen for uniform sets only");
+    ParticleSet clumped = clumpedCube(n);
+    double contrast_uniform = NeighborSearch::densityContrast(uniform, h);
+    double contrast_clumped = NeighborSearch::densityContrast(clumped, h);
+    Message("Density contrast: " + std::to_string(contrast_uniform) + " uniform, " + std::to_string(contrast_clumped) + " clumped");
+    test3.complete(NeighborSearch::choose(uniform, h) == NeighborMethod::Grid && NeighborSearch::choose(clumped, h) == NeighborMethod::Tree);
+
+    // build and query every particle, as a neighbor list build would
+    auto queryAll = [&](const NeighborSearch& index) {
+        std::vector<int> found;
+        long long total = 0;
+        for (int i = 0; i < n; i++) {
+            index.neighbors(uniform.get(i).position, h, found);
+            total += found.size();
+        }
+        return total;
+    };
+    Task grid_task("Grid: build and query, uniform set");
+    long long grid_found = queryAll(CellGrid(uniform, h));
+    grid_task.complete();
+    Task tree_task("Tree: build and query, uniform set");
+    long long tree_found = queryAll(Octree(uniform));
+    tree_task.complete();
+    Message("Grid " + std::to_string(grid_task.getTimeNs() * 1e-6) + " ms, tree " + std::to_string(tree_task.getTimeNs() * 1e-6) + " ms");
+
+    Test test4("The grid beats the tree on a uniform set");
+    test4.complete(grid_found == tree_found && grid_task.getTimeNs() < tree_task.getTimeNs());
+}
@@ -0,0 +1,109 @@
+#include "particleSet.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <algorithm>
+#include <utility>
+#include <thread>
+
+
+ParticleSet makeSet(int n) {
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        ps.add(Particle({
+            std::cos(i), std::sin(i), (i % 17) / 17.0,
+            1.0, 0.5 * (i % 3), 0.0,
+            1.0 + (i % 5)
+        }));
+    }
+    return ps;
+}
+
+
+int main() {
+    ParticleSet ps = makeSet(10000);
+
+    // the fused reduction must agree with a naive sum
+    Test test("Statistics match naive sums");
+    double mass = 0, kinetic_energy = 0;
+    Eigen::Vector3d com = Eigen::Vector3d::Zero();
+    for (int i = 0; i < ps.size(); i++) {
+        const Particle& p = std::as_const(ps).get(i);
+        mass += p.mass;
+        com += p.mass * p.position;
+        kinetic_energy += 0.5 * p.mass * p.velocity.squaredNorm();
+    }
+    com /= mass;
+    const ParticleSetStatistics& stats = ps.getStatistics();
+    test.complete(
+        std::abs(stats.total_mass - mass) < 1e-9 * mass &&
+        (stats.center_of_mass - com).norm() < 1e-9 &&
+        std::abs(stats.kinetic_energy - kinetic_energy) < 1e-9 * kinetic_energy
+    );
+
+    Test test2("Statistics are invalidated on modification");
+    ps.com();
+    test2.complete(
+        ps.getStatistics().center_of_mass.norm() < 1e-9 &&
+        ps.getStatistics().momentum.norm() < 1e-9
+    );
+
+    Test test3("Snapshots share the blocks the set did not modify");
+    ParticleSnapshot a = ps.snapshot();
+    ParticleSnapshot b = ps.snapshot();
+    ps.get(0).position.x() += 1.0;
+    ParticleSnapshot c = ps.snapshot();
+    ps.get(1).position.x() += 1.0;
+    std::vector<ParticleSnapshot> concurrent(4); // taken by readers at once: a single copy
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) readers.emplace_back([&, t] {concurrent[t] = std::as_const(ps).snapshot();});
+    for (std::thread& reader : readers) reader.join();
+    test3.complete(
+        a.getBlocks() == 3 && a.sharesDataWith(b) && !a.sharesDataWith(c) && a.sharedBlocks(c) == 2 &&
+        c.get(0).position.x() == a.get(0).position.x() + 1.0 && c.get(9999) == ps.get(9999) &&
+        std::all_of(concurrent.begin(), concurrent.end(), [&](const ParticleSnapshot& s) {return s.sharesDataWith(concurrent[0]);}) &&
+        concurrent[0].sharedBlocks(c) == 2 && ParticleSet(c).size() == ps.size()
+    );
+
+    Test test4("Views and time groups");
+    for (Particle& p : ps.view(5000)) p.current_time = 1.0;
+    std::vector<ConstParticleView> groups = std::as_const(ps).splitViews();
+    ParticleSet moved = ps.slice(100);
+    moved.add(ps.slice(100, -1));
+    test4.complete(
+        groups.size() == 2 && groups[0].size() == 5000 && groups[1].get(0).current_time == 1.0 &&
+        moved.size() == ps.size() && moved.get(9999) == ps.get(9999)
+    );
+
+    // past 2^31, from several threads at once
+    Test test5("Particles created concurrently get unique 64 bit ids");
+    const int64_t counter = Particle::getIdCounter();
+    Particle::setIdCounter(int64_t(1) << 32);
+    Parallel::setThreads(4);
+    std::vector<int64_t> ids(200000);
+    Parallel::forRange(ids.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) ids[i] = Particle().getId();
+    }, 1000);
+    Parallel::setThreads(0);
+    std::sort(ids.begin(), ids.end());
+    const int64_t reserved = Particle::reserveIds(10);
+    Particle::setIdCounter(counter);
+    test5.complete(
+        std::adjacent_find(ids.begin(), ids.end()) == ids.end() &&
+        ids.front() >= (int64_t(1) << 32) && reserved > ids.back() &&
+        Particle().getId() == counter
+    );
+
+    // the storage of the set grows under the view being appended
+    Test test6("A set can be appended to itself");
+    ParticleSet doubled = makeSet(1000);
+    doubled.particles.shrink_to_fit();
+    doubled.add(doubled);
+    doubled.add(std::as_const(doubled).view(10, 20));
+    test6.complete(
+        doubled.size() == 2010 && doubled.get(1000) == doubled.get(0) && doubled.get(1999) == doubled.get(999) &&
+        doubled.get(2000) == doubled.get(10) && doubled.get(2009) == doubled.get(19)
+    );
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "gravity.hpp"
+#include "fmm.hpp"
+#include "octree.hpp"
+#include "periodic.hpp"
+#include <tintoretto.hpp>
+#include <random>
+#include <algorithm>
+
+
+ParticleSet periodicCube(int n, double side, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, side);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+    }
+    ps.setPeriodicBox(PeriodicBox(side));
+    return ps;
+}
+
+
+int main() {
+    Test test("Wrapping and minimum image");
+    PeriodicBox box(2.0, Eigen::Vector3d(-1.0, -1.0, -1.0));
+    Eigen::Vector3d wrapped = box.wrap(Eigen::Vector3d(1.5, -3.5, 0.25));
+    Eigen::Vector3d image = box.minimumImage(Eigen::Vector3d(1.5, -0.5, 3.9));
+    test.complete(
+        (wrapped - Eigen::Vector3d(-0.5, 0.5, 0.25)).norm() < 1e-12 &&
+        (image - Eigen::Vector3d(-0.5, -0.5, -0.1)).norm() < 1e-12
+    );
+
+    Test test2("Ewald table: odd symmetry and agreement with the direct Ewald sum");
+    const EwaldTable& ewald = EwaldTable::get();
+    Eigen::Vector3d x(0.17, -0.31, 0.08);
+    Eigen::Vector3d exact = EwaldTable::ewaldAcceleration(x) + x / std::pow(x.norm(), 3);
+    test2.complete(
+        (ewald.correction(x, 1.0) + ewald.correction(-x, 1.0)).norm() < 1e-14 &&
+        (ewald.correction(x, 1.0) - exact).norm() < 1e-3 * exact.norm() &&
+        (ewald.correction(2 * x, 2.0) - exact / 4).norm() < 1e-3 * exact.norm()
+    );
+
+    // neighbors found across the faces of the box, against a brute force minimum image search
+    Test test3("Periodic neighbor search matches brute force");
+    ParticleSet ps = periodicCube(4000, 1.0);
+    Octree tree(ps);
+    bool same = true;
+    std::vector<int> found;
+    for (Eigen::Vector3d center : {Eigen::Vector3d(0.01, 0.5, 0.99), Eigen::Vector3d(0.0, 0.0, 0.0), Eigen::Vector3d(0.5, 0.97, 0.5)}) {
+        tree.neighbors(center, 0.1, found);
+        std::sort(found.begin(), found.end());
+        std::vector<int> expected;
+        for (int i = 0; i < ps.size(); i++) {
+            if (ps.getPeriodicBox()->minimumImage(ps.get(i).position - center).norm() <= 0.1) expected.push_back(i);
+        }
+        same = same && found == expected && !expected.empty();
+    }
+    test3.complete(same);
+
+    // two equal masses half a box apart: pulled equally both ways
+    Test test4("Periodic gravity vanishes at half a box");
+    ParticleSet pair = {Particle({0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0}), Particle({0.5, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0})};
+    pair.setPeriodicBox(PeriodicBox(1.0));
+    std::vector<Eigen::Vector3d> acc = DirectGravity(0.0).accelerations(pair);
+    test4.complete(acc[0].norm() < 1e-3 && acc[1].norm() < 1e-3);
+
+    // half of the mass in a clump across a corner of the box: a uniform box alone has almost no net force
+    Test test5("Periodic tree agrees with periodic direct summation");
+    ParticleSet cube = periodicCube(1000, 1.0, 7);
+    std::mt19937 rng(7);
+    std::normal_distribution<double> clump(0.0, 0.05);
+    for (int i = 0; i < 1000; i++) {
+        cube.add(Particle({0.95 + clump(rng), 0.6 + clump(rng), 0.02 + clump(rng), 0.0, 0.0, 0.0, 1.0 / 1000}));
+    }
+    std::vector<Eigen::Vector3d> reference = DirectGravity(0.01).accelerations(cube);
+    TreeGravity periodic_tree(0.01, 0.5);
+    periodic_tree.setMultipoleOrder(2);
+    ForceError error = ForceError::compare(reference, periodic_tree.accelerations(cube));
+    error.display("periodic tree");
+    test5.complete(error.p99 < 1e-2);
+
+    Test test6("FMM refuses periodic boxes");
+    bool thrown = false;
+    try {
+        FmmGravity(0.01).accelerations(cube);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    test6.complete(thrown);
+}
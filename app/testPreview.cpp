@@ -0,0 +1,48 @@
+#include "preview.hpp"
+#include "gravity.hpp"
+#include "initialConditions.hpp"
+#include <tintoretto.hpp>
+#include <chrono>
+#include <cmath>
+
+
+int main() {
+    Test test("slice_m keeps the total mass and scales smoothing lengths");
+    ParticleSet ps = InitialConditions::plummer(100000, 1);
+    for (int i = 0; i < ps.size(); i++) {
+        ps.particles[i].mass *= 1.0 + (i % 3); // uneven masses
+        ps.particles[i].smoothing_length = 0.01;
+    }
+    ps.invalidate();
+    ParticleSet coarse = ps.slice_m(1562); // about 1/64
+    double mass = ps.getStatistics().total_mass;
+    test.complete(
+        coarse.size() == 1562 && std::abs(coarse.getStatistics().total_mass - mass) < 1e-12 * mass &&
+        std::abs(coarse.get(0).smoothing_length - 0.01 * std::cbrt(100000.0 / 1562)) < 1e-12 &&
+        coarse.get(1) == ps.get(64) && ps.slice_m(0).size() == 0 && ps.slice_m(200000).size() == ps.size()
+    );
+
+    // a tree code on a Plummer sphere: the projection from 1/64 and 1/8 should land near the real cost
+    auto step = [](ParticleSet& set, int factor) {
+        TreeGravity gravity(0.01 * std::cbrt(factor), 0.7);
+        gravity.accelerations(set);
+    };
+    ParticleSet full = InitialConditions::plummer(65536, 2);
+    Task preview_task("Preview at 1/64 and 1/8");
+    PreviewReport report = Preview(step).run(full);
+    preview_task.complete();
+    report.print();
+
+    Task full_task("Full run, 65536 particles");
+    step(full, 1);
+    full_task.complete();
+    double actual = full_task.getTimeNs() * 1e-9;
+    Message("Projected " + std::to_string(report.seconds) + " s, actual " + std::to_string(actual) + " s");
+
+    Test test2("The projection is within a factor 2 of the real cost, and rejects a tight budget");
+    test2.complete(
+        report.runs.size() == 2 && report.runs[0].factor == 64 && report.phases.count("gravity walk") &&
+        report.seconds > 0.5 * actual && report.seconds < 2 * actual && report.exponent > 0.8 && report.exponent < 1.6 &&
+        report.fits(10 * actual) && !report.fits(0.1 * actual)
+    );
+}
@@ -0,0 +1,94 @@
+#include "parallel.hpp"
+#include "gravity.hpp"
+#include "initialConditions.hpp"
+#include <tintoretto.hpp>
+#include <atomic>
+#include <algorithm>
+
+
+int main() {
+    Parallel::setThreads(4);
+
+    Test test("Work stealing loops run every item exactly once");
+    std::vector<int> hits(100000, 0);
+    Parallel::forDynamic(hits.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) hits[i]++;
+    }, 37);
+    Parallel::forTasks(hits.size(), [&](int task) {hits[task]++;});
+    // a complete binary tree in heap numbering, split down to its leaves
+    const int leaves = 1 << 14;
+    std::vector<std::atomic<int>> leaf_hits(leaves);
+    Parallel::forTree({1}, [&](int node, std::vector<int>& spawn) {
+        if (node >= leaves) leaf_hits[node - leaves]++;
+        else spawn = {2 * node, 2 * node + 1};
+    });
+    test.complete(
+        std::all_of(hits.begin(), hits.end(), [](int h) {return h == 2;}) &&
+        std::all_of(leaf_hits.begin(), leaf_hits.end(), [](const std::atomic<int>& h) {return h == 1;})
+    );
+
+    Test test2("Cost weighted partition");
+    std::vector<double> costs(10000);
+    for (int i = 0; i < (int)costs.size(); i++) costs[i] = i < 1000 ? 50.0 : 1.0; // an expensive clump
+    std::vector<int> bounds = Parallel::partition(costs, 16);
+    double total = 59000, worst = 0;
+    for (int p = 0; p < 16; p++) {
+        double cost = 0;
+        for (int i = bounds[p]; i < bounds[p + 1]; i++) cost += costs[i];
+        worst = std::max(worst, cost);
+    }
+    test2.complete(bounds.front() == 0 && bounds.back() == (int)costs.size() && std::is_sorted(bounds.begin(), bounds.end()) &&
+                   worst <= total / 16 + 50);
+
+    // walks are independent per particle (or group): how they are scheduled must not change anything
+    Test test3("Work stealing does not change the accelerations");
+    ParticleSet cluster = InitialConditions::plummer(20000, 3);
+    auto run = [&](int threads, int group_size) {
+        Parallel::setThreads(threads);
+        TreeGravity gravity(0.01, 0.6);
+        gravity.setMultipoleOrder(2);
+        gravity.setGroupSize(group_size);
+        std::vector<Eigen::Vector3d> first = gravity.accelerations(cluster);
+        return gravity.accelerations(cluster); // the second call is balanced with the costs of the first
+    };
+    test3.complete(run(1, 1) == run(4, 1) && run(1, 16) == run(4, 16));
+
+    Task timing("Tree gravity on a Plummer sphere, 4 workers, 3 steps");
+    Parallel::setThreads(4);
+    Parallel::resetPhases();
+    TreeGravity gravity(0.01, 0.6);
+    gravity.setMultipoleOrder(2);
+    for (int step = 0; step < 3; step++) gravity.accelerations(cluster);
+    timing.complete();
+    Parallel::report();
+
+    Test test4("Phases are accounted for");
+    std::map<std::string, Parallel::PhaseStats> phases = Parallel::getPhases();
+    test4.complete(
+        phases.count("tree build") && phases.count("gravity walk") && phases["gravity walk"].tasks >= 3 * 32 &&
+        phases["gravity walk"].efficiency() > 0 && phases["gravity walk"].efficiency() <= 1.0 + 1e-9
+    );
+
+    Test test5("A throwing task stops the loop, and the pool still runs in parallel after it");
+    Parallel::setThreads(2);
+    bool caught = false;
+    std::atomic<int> ran(0);
+    try {
+        Parallel::forTasks(1000, [&](int task) {
+            ran++;
+            if (task == 10) throw std::runtime_error("task 10");
+        });
+    } catch (const std::runtime_error& e) {
+        caught = std::string(e.what()) == "task 10";
+    }
+    bool serial_caught = false;
+    try {
+        Parallel::Phase phase("throwing"); // a single chunk, run serially through the pool's entry
+        Parallel::forChunks(10, [&](int, int, int) {throw std::runtime_error("serial");});
+    } catch (const std::runtime_error&) {
+        serial_caught = true;
+    }
+    std::atomic<int> workers_seen(0);
+    Parallel::forChunks(4 * Parallel::min_chunk, [&](int, int, int) {workers_seen |= 1 << Parallel::worker();});
+    test5.complete(caught && serial_caught && ran <= 1000 && workers_seen == 3);
+}
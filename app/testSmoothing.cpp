@@ -0,0 +1,84 @@
+#include "smoothing.hpp"
+#include <tintoretto.hpp>
+#include <random>
+#include <algorithm>
+
+
+/**
+ * @brief Half of the particles spread uniformly, half in a dense clump: densities over 3 orders of magnitude.
+ */
+ParticleSet clusteredSet(int n, int seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::normal_distribution<double> clump(0.0, 0.05);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        if (i % 2) ps.add(Particle({u(rng), u(rng), u(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+        else ps.add(Particle({clump(rng), clump(rng), clump(rng), 0.0, 0.0, 0.0, 1.0 / n}));
+    }
+    return ps;
+}
+
+
+int main() {
+    const int n_neighbors = 50;
+    ParticleSet ps = clusteredSet(20000);
+    QuarticKernel kernel(1.0);
+    SmoothingLengthSolver solver(kernel, n_neighbors);
+
+    Test test("Every smoothing length converges");
+    Octree tree(ps);
+    solver.solve(ps, tree);
+    Message("Mean iterations: " + std::to_string(solver.getMeanIterations()) + ", neighbor queries: " + std::to_string(solver.getNeighborQueries()));
+    test.complete(solver.getFailures() == 0);
+
+    // away from the edges of the uniform part, the kernel holds about n_neighbors particles
+    Test test2("Neighbor counts stay close to the target while h adapts");
+    std::vector<int> neighbors;
+    double h_min = 1e30, h_max = 0, mean_count = 0;
+    int counted = 0;
+    for (int i = 0; i < ps.size(); i++) {
+        const Particle& p = ps.particles[i];
+        h_min = std::min(h_min, p.smoothing_length);
+        h_max = std::max(h_max, p.smoothing_length);
+        if (p.position.cwiseAbs().maxCoeff() > 0.7) continue;
+        tree.neighbors(p.position, p.smoothing_length, neighbors);
+        mean_count += neighbors.size();
+        counted++;
+    }
+    mean_count /= counted;
+    Message("Mean neighbors: " + std::to_string(mean_count) + ", h from " + std::to_string(h_min) + " to " + std::to_string(h_max));
+    test2.complete(std::abs(mean_count - n_neighbors) < 0.2 * n_neighbors && h_max > 5 * h_min);
+
+    Test test3("Density matches the enclosed mass condition");
+    bool consistent = true;
+    for (int i = 0; i < ps.size(); i += 97) {
+        double h = ps.particles[i].smoothing_length;
+        double mass = 4.0 / 3.0 * M_PI * h * h * h * solver.getDensities()[i];
+        consistent = consistent && std::abs(mass - n_neighbors * ps.particles[i].mass) < 2e-3 * n_neighbors * ps.particles[i].mass;
+    }
+    test3.complete(consistent);
+
+    Test test4("A warm start from the previous h needs fewer iterations");
+    double cold = solver.getMeanIterations();
+    solver.solve(ps, tree);
+    Message("Mean iterations: " + std::to_string(solver.getMeanIterations()));
+    test4.complete(solver.getMeanIterations() < cold && solver.getFailures() == 0);
+
+    // stopped early, h is not converged but the density is still the SPH sum at that h
+    Test test5("Without convergence, h and the density stay consistent");
+    ParticleSet fresh = clusteredSet(5000, 7);
+    Octree fresh_tree(fresh);
+    SmoothingLengthSolver hurried(kernel, n_neighbors, 1e-3, 2);
+    hurried.solve(fresh, fresh_tree);
+    bool matches = true;
+    for (int i = 0; i < fresh.size(); i += 31) {
+        const Particle& p = fresh.particles[i];
+        fresh_tree.neighbors(p.position, p.smoothing_length, neighbors);
+        double rho = 0;
+        for (int j : neighbors) rho += fresh.particles[j].mass * kernel.sample((fresh.particles[j].position - p.position).squaredNorm(), p.smoothing_length).value;
+        matches = matches && std::abs(rho - hurried.getDensities()[i]) < 1e-9 * rho;
+    }
+    test5.complete(hurried.getFailures() > 0 && matches);
+}
@@ -0,0 +1,143 @@
+#include "sph.hpp"
+#include "smoothing.hpp"
+#include "gravity.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <random>
+#include <algorithm>
+
+
+/**
+ * @brief A Gaussian clump in a uniform background, with random velocities so that the viscosity acts.
+ */
+ParticleSet clumpedSet(int n, int seed = 7) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::normal_distribution<double> clump(0.0, 0.1);
+    ParticleSet ps;
+    ps.reserve(n);
+    for (int i = 0; i < n; i++) {
+        if (i % 3) ps.add(Particle({clump(rng), clump(rng), clump(rng), u(rng), u(rng), u(rng), 1.0 / n}));
+        else ps.add(Particle({u(rng), u(rng), u(rng), u(rng), u(rng), u(rng), 1.0 / n}));
+    }
+    return ps;
+}
+
+
+int main() {
+    const double K = 1.0, gamma = 5.0 / 3.0, alpha = 1.0, beta = 2.0;
+    Parallel::setThreads(4); // several chunks, each with its own buffers, whatever the machine
+    ParticleSet ps = clumpedSet(4000);
+    QuarticKernel kernel(1.0);
+    BasicQuarticKernel<double> exact(1.0); // the reference stays in double whatever the build
+    const bool float_build = sizeof(real) < sizeof(double);
+    SmoothingLengthSolver(kernel, 40).solve(ps);
+    NeighborList list(0.02);
+    list.update(ps, kernel);
+
+    SphSolver sph(kernel, K, gamma, alpha, beta);
+    Task task("Symmetric density and force passes");
+    std::vector<Eigen::Vector3d> acc = sph.accelerations(ps, list);
+    task.complete();
+
+    // reference: every ordered pair on its own, straight from the definitions
+    const int n = ps.size();
+    std::vector<double> rho(n, 0.0);
+    long long evaluations = 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            const Particle& pi = ps.particles[i];
+            const Particle& pj = ps.particles[j];
+            double hij = 0.5 * (pi.smoothing_length + pj.smoothing_length);
+            double r = (pi.position - pj.position).norm();
+            if (r >= hij) continue;
+            rho[i] += pj.mass * exact(r, hij);
+            evaluations++;
+        }
+    }
+    std::vector<Eigen::Vector3d> reference(n, Eigen::Vector3d::Zero());
+    for (int i = 0; i < n; i++) {
+        const Particle& pi = ps.particles[i];
+        double ci = std::sqrt(gamma * K * std::pow(rho[i], gamma - 1));
+        for (int j = 0; j < n; j++) {
+            const Particle& pj = ps.particles[j];
+            double hij = 0.5 * (pi.smoothing_length + pj.smoothing_length);
+            Eigen::Vector3d d = pi.position - pj.position;
+            if (j == i || d.norm() >= hij) continue;
+            double cj = std::sqrt(gamma * K * std::pow(rho[j], gamma - 1));
+            double vr = (pi.velocity - pj.velocity).dot(d);
+            double visc = 0;
+            if (vr < 0) {
+                double mu = hij * vr / (d.squaredNorm() + 0.01 * hij * hij);
+                visc = (-alpha * 0.5 * (ci + cj) * mu + beta * mu * mu) / (0.5 * (rho[i] + rho[j]));
+            }
+            double term = K * std::pow(rho[i], gamma - 2) + K * std::pow(rho[j], gamma - 2) + visc;
+            reference[i] -= pj.mass * term * exact.gradient(d, hij);
+        }
+    }
+
+    Test test("Densities match the pair by pair sum");
+    double max_error = 0;
+    for (int i = 0; i < n; i++) {
+        max_error = std::max(max_error, std::abs(sph.getDensities()[i] - rho[i]) / rho[i]);
+    }
+    test.complete(max_error < (float_build ? 1e-5 : 1e-10));
+
+    Test test2("Accelerations match the pair by pair sum");
+    max_error = 0;
+    for (int i = 0; i < n; i++) {
+        max_error = std::max(max_error, (acc[i] - reference[i]).norm() / reference[i].norm());
+    }
+    Message("Max relative error: " + std::to_string(max_error));
+    test2.complete(max_error < (float_build ? 1e-4 : 1e-9));
+
+    Test test3("Total momentum is conserved");
+    Eigen::Vector3d momentum = Eigen::Vector3d::Zero();
+    double scale = 0;
+    for (int i = 0; i < n; i++) {
+        momentum += ps.particles[i].mass * acc[i];
+        scale += ps.particles[i].mass * acc[i].norm();
+    }
+    Message("|sum m a| / sum m |a| = " + std::to_string(momentum.norm() / scale));
+    test3.complete(momentum.norm() < (float_build ? 1e-6 : 1e-12) * scale);
+
+    Test test4("One kernel evaluation per pair");
+    double ratio = double(sph.getKernelEvaluations()) / evaluations;
+    Message("Kernel evaluations: " + std::to_string(sph.getKernelEvaluations()) + " against " + std::to_string(evaluations) + " per particle and neighbor");
+    test4.complete(std::abs(ratio - 0.5) < 0.05);
+
+    // self-gravitating gas: one walk for gravity and neighbors, against a walk and a neighbor search
+    Test test5("Combined gravity and neighbor walk");
+    TreeGravity gravity(0.01, 0.5);
+    NeighborList combined(0.02);
+    Task separate_task("Gravity walk, then neighbor search");
+    std::vector<Eigen::Vector3d> separate_acc = gravity.accelerations(ps);
+    list.build(ps, kernel);
+    separate_task.complete();
+    Task combined_task("Gravity walk gathering the neighbors");
+    std::vector<Eigen::Vector3d> combined_acc = gravity.accelerations(ps, kernel, combined);
+    combined_task.complete();
+    bool same = combined.getOffsets() == list.getOffsets() && combined.getIndices() == list.getIndices();
+    for (int i = 0; i < n; i++) {
+        same = same && (combined_acc[i] - separate_acc[i]).norm() <= 1e-12 * separate_acc[i].norm();
+    }
+    same = same && sph.accelerations(ps, combined) == sph.accelerations(ps, list);
+    test5.complete(same);
+
+    // the chunks only find the pairs: any number of threads gives the same bits
+    Test test6("Deterministic mode does not depend on the number of threads");
+    Parallel::setDeterministic(true);
+    auto run = [&](int threads) {
+        Parallel::setThreads(threads);
+        std::vector<Eigen::Vector3d> a = sph.accelerations(ps, list);
+        return std::make_pair(a, sph.getDensities());
+    };
+    auto single = run(1);
+    bool identical = run(2) == single && run(3) == single && run(4) == single;
+    Parallel::setDeterministic(false);
+    std::vector<Eigen::Vector3d> chunked = run(4).first;
+    for (int i = 0; i < n; i++) {
+        identical = identical && (chunked[i] - single.first[i]).norm() <= (float_build ? 1e-5 : 1e-12) * chunked[i].norm();
+    }
+    test6.complete(identical);
+}
@@ -0,0 +1,146 @@
+#include "taskGraph.hpp"
+#include "gravity.hpp"
+#include "sph.hpp"
+#include "smoothing.hpp"
+#include "checkpoint.hpp"
+#include "initialConditions.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <stdexcept>
+
+
+/**
+ * @brief State of a self-gravitating gas, advanced by the step pipeline below.
+ */
+struct Gas {
+    ParticleSet ps;
+    std::unique_ptr<Octree> tree;
+    NeighborList list = NeighborList(0.02);
+    QuarticKernel kernel = QuarticKernel(1.0);
+    TreeGravity gravity = TreeGravity(0.01, 0.6);
+    SphSolver sph = SphSolver(kernel);
+    std::vector<Eigen::Vector3d> gravity_acc, sph_acc;
+    std::vector<double> kinetic; // per step
+};
+
+/**
+ * @brief Adds `steps` leapfrog steps to graph. Diagnostics and snapshot output of a step read a snapshot of the
+ * particles, so they overlap with the rest of the step and with the next one.
+ */
+void addSteps(TaskGraph& graph, Gas& gas, int steps, const std::string& filename, std::vector<int>& outputs, std::vector<int>& forces) {
+    const double dt = 1e-3;
+    gas.kinetic.assign(steps, 0.0);
+    for (int step = 0; step < steps; step++) {
+        const std::string snapshot = "snapshot " + std::to_string(step);
+        auto particles = std::make_shared<ParticleSnapshot>();
+
+        graph.add("tree", [&] {gas.tree = std::make_unique<Octree>(gas.ps);}, {"positions"}, {"tree"});
+        graph.add("neighbors", [&] {gas.list.update(gas.ps, gas.kernel);}, {"positions"}, {"list"});
+        forces.push_back(graph.add("gravity", [&] {gas.gravity_acc = gas.tree->toSetOrder(gas.gravity.accelerations(*gas.tree));}, {"tree"}, {"gravity"}));
+        forces.push_back(graph.add("sph", [&] {gas.sph_acc = gas.sph.accelerations(gas.ps, gas.list);}, {"positions", "velocities", "list"}, {"sph"}));
+        graph.add("kick drift", [&, dt] {
+            Parallel::forRange(gas.ps.size(), [&](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    Particle& p = gas.ps.particles[i];
+                    p.velocity += dt * (gas.gravity_acc[i] + gas.sph_acc[i]);
+                    p.position += dt * p.velocity;
+                }
+            });
+            gas.ps.invalidate();
+        }, {"gravity", "sph"}, {"positions", "velocities"});
+        graph.add("snapshot", [&, particles] {*particles = gas.ps.snapshot();}, {"positions", "velocities"}, {snapshot});
+        graph.add("diagnostics", [&, particles, step] {
+            gas.kinetic[step] = Parallel::reduce<double>(particles->size(), 0.0, [&](int begin, int end) {
+                double sum = 0;
+                for (int i = begin; i < end; i++) sum += 0.5 * particles->get(i).mass * particles->get(i).velocity.squaredNorm();
+                return sum;
+            }, [](double a, double b) {return a + b;});
+        }, {snapshot}, {"kinetic"});
+        outputs.push_back(graph.add("output", [&, particles, filename] {
+            Checkpoint checkpoint;
+            checkpoint.setParticles(ParticleSet(*particles));
+            checkpoint.write(filename);
+        }, {snapshot}, {"file"}));
+    }
+}
+
+void makeGas(Gas& gas, int n) {
+    gas.ps = InitialConditions::plummer(n, 5, 0.2);
+    for (Particle& p : gas.ps.particles) p.velocity *= 0.5;
+    SmoothingLengthSolver(gas.kernel, 40).solve(gas.ps);
+}
+
+
+int main() {
+    Parallel::setThreads(4);
+
+    Test test("Dependencies follow the data");
+    TaskGraph graph;
+    int write_a = graph.add("write a", [] {}, {}, {"a"});
+    int read_a = graph.add("read a", [] {}, {"a"}, {"b"});
+    int read_a_too = graph.add("read a too", [] {}, {"a"}, {"c"});
+    int rewrite_a = graph.add("rewrite a", [] {}, {}, {"a"});
+    int read_b = graph.add("read b", [] {}, {"b"}, {});
+    test.complete(
+        graph.getDependencies(write_a).empty() &&
+        graph.getDependencies(read_a) == std::vector<int>{write_a} &&
+        graph.getDependencies(read_a_too) == std::vector<int>{write_a} &&
+        graph.getDependencies(rewrite_a) == std::vector<int>{write_a, read_a, read_a_too} && // waits for its readers
+        graph.getDependencies(read_b) == std::vector<int>{read_a}
+    );
+
+    Test test2("Independent tasks overlap");
+    TaskGraph sleepers;
+    auto sleep = [] {std::this_thread::sleep_for(std::chrono::milliseconds(50));};
+    int first = sleepers.add("first", sleep, {}, {"x"});
+    int second = sleepers.add("second", sleep, {}, {"y"});
+    int both = sleepers.add("both", sleep, {"x", "y"}, {});
+    Task sleepers_task("Two independent 50 ms tasks, then one after both");
+    sleepers.run();
+    sleepers_task.complete();
+    test2.complete(sleepers.ranConcurrently(first, second) && !sleepers.ranConcurrently(first, both) && sleepers_task.getTimeNs() < 140e6);
+
+    Test test3("A failing task stops its dependents");
+    TaskGraph failing;
+    bool dependent_ran = false;
+    failing.add("fails", [] {throw std::runtime_error("on purpose");}, {}, {"x"});
+    failing.add("dependent", [&] {dependent_ran = true;}, {"x"}, {});
+    bool thrown = false;
+    try {
+        failing.run();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    test3.complete(thrown && !dependent_ran);
+
+    // the graph gives the same result as the tasks in order, one at a time
+    Test test4("Step pipeline: same particles on 1 and 4 lanes, output overlapping the next step");
+    const std::string filename = "/tmp/testTaskGraph.chk";
+    Gas serial, overlapped;
+    makeGas(serial, 5000);
+    makeGas(overlapped, 5000);
+    std::vector<int> outputs, forces, ignored;
+    TaskGraph serial_steps, steps;
+    addSteps(serial_steps, serial, 3, filename, ignored, ignored);
+    addSteps(steps, overlapped, 3, filename, outputs, forces);
+    serial_steps.run(1);
+    Task pipeline("3 steps of gravity and SPH, 5000 particles, 4 lanes");
+    steps.run(4);
+    pipeline.complete();
+    steps.printTimeline();
+    bool same = serial.kinetic == overlapped.kinetic;
+    for (int i = 0; i < serial.ps.size(); i++) {
+        same = same && serial.ps.particles[i].position == overlapped.ps.particles[i].position;
+    }
+    bool overlap = false;
+    for (int s = 0; s < (int)outputs.size(); s++) {
+        for (int f = 2 * (s + 1); f < (int)forces.size(); f++) overlap = overlap || steps.ranConcurrently(outputs[s], forces[f]);
+    }
+    Message(std::string("Output ") + (overlap ? "overlapped" : "did not overlap") + " the forces of a later step");
+    test4.complete(same && overlap);
+    std::remove(filename.c_str());
+}
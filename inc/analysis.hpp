@@ -0,0 +1,217 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <string>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+
+
+// --------------------- //
+// !-- Analysis Base --! //
+// --------------------- //
+
+/**
+ * @brief Result of an analysis: a small table, one value per column in every row.
+ */
+struct AnalysisTable {
+    std::vector<std::string> columns;
+    std::vector<std::vector<double>> rows;
+};
+
+
+/**
+ * @brief Interface of the in-situ analyses (see InSitu): a computation on a read-only snapshot of the particles whose
+ * result is a small table, instead of a full snapshot written out for post-processing.
+ *
+ * compute() runs on a background thread, concurrently with the next steps of the simulation: it may only read the
+ * snapshot and its own members. Calls on the same analysis never overlap, and come in step order.
+ */
+class Analysis {
+    public:
+        virtual ~Analysis() {};
+
+        /**
+         * @brief Name of the analysis, also its phase in Parallel::getPhases().
+         */
+        virtual std::string getName() const = 0;
+
+        virtual AnalysisTable compute(const ParticleSnapshot& snapshot, int step, double time) = 0;
+};
+
+
+
+// ---------------------- //
+// !-- Radial Profile --! //
+// ---------------------- //
+
+/**
+ * @brief Spherically averaged profiles in logarithmic shells between r_min and r_max around a center (the center of
+ * mass of the snapshot by default): one row per shell with its bounds, particles, mass, density, mean radial velocity
+ * and one dimensional velocity dispersion, velocities being taken relative to the center of mass.
+ * ```cpp
+ * in_situ.add(std::make_unique<RadialProfile>(32, 0.01, 10.0), 100, "profiles.csv");
+ * ```
+ */
+class RadialProfile : public Analysis {
+    private:
+        int bins;
+        double r_min, r_max;
+        bool fixed_center;
+        Eigen::Vector3d center;
+
+    public:
+        RadialProfile(int bins = 32, double r_min = 0.01, double r_max = 10.0);
+        RadialProfile(int bins, double r_min, double r_max, const Eigen::Vector3d& center);
+
+        std::string getName() const override {return "radial profile";}
+        AnalysisTable compute(const ParticleSnapshot& snapshot, int step, double time) override;
+};
+
+
+
+// --------------------- //
+// !-- Energy Budget --! //
+// --------------------- //
+
+/**
+ * @brief One row of global budgets: kinetic, potential (Plummer softened, from a monopole tree walk with opening angle
+ * theta) and total energy, virial ratio 2K / |W|, momentum and angular momentum about the origin.
+ */
+class EnergyBudget : public Analysis {
+    private:
+        double softening;
+        double theta;
+        double G;
+
+    public:
+        EnergyBudget(double softening = 0.01, double theta = 0.5, double G = 1.0);
+
+        std::string getName() const override {return "energy budget";}
+        AnalysisTable compute(const ParticleSnapshot& snapshot, int step, double time) override;
+};
+
+
+
+// --------------------- //
+// !-- Projected Map --! //
+// --------------------- //
+
+/**
+ * @brief Surface density map along an axis (0, 1 or 2): the square of side 2 half_width around center, projected on
+ * the other two axes, in pixels x pixels (cloud in cell deposit). One row per pixel: its center, and the surface density.
+ */
+class ProjectedMap : public Analysis {
+    private:
+        int pixels;
+        double half_width;
+        Eigen::Vector3d center;
+        int axis;
+
+    public:
+        ProjectedMap(int pixels = 128, double half_width = 1.0, const Eigen::Vector3d& center = Eigen::Vector3d::Zero(), int axis = 2);
+
+        std::string getName() const override {return "projected map";}
+        AnalysisTable compute(const ParticleSnapshot& snapshot, int step, double time) override;
+};
+
+
+
+// --------------- //
+// !-- In Situ --! //
+// --------------- //
+
+/**
+ * @brief Runs analyses during a simulation, every so many steps, on background lanes (threads) concurrently with the
+ * next steps. step() takes a snapshot of the particles (shared by every analysis due at that step, see ParticleSnapshot),
+ * queues the analyses and returns; each analysis appends its table to its own csv file, every row prefixed with the
+ * step and the time. Parallel loops inside analyses run serially on their lane: the worker pool stays with the
+ * simulation, so spare cores are best left to the lanes (Parallel::setThreads(cores - lanes)).
+ *
+ * At most max_pending analyses wait in the queue: past that, step() waits for the lanes, so that slow analyses do not
+ * pile up snapshots. An exception thrown by an analysis is rethrown by the next step() or wait().
+ * ```cpp
+ * InSitu in_situ(2);
+ * in_situ.add(std::make_unique<EnergyBudget>(0.01), 10, "energy.csv");
+ * in_situ.add(std::make_unique<RadialProfile>(), 100, "profiles.csv");
+ * for (int step = 0; step < steps; step++) {
+ *     in_situ.step(ps, step, t); // returns at once
+ *     leapfrog(ps, dt); // while the analyses of this step run
+ * }
+ * in_situ.wait();
+ * ```
+ */
+class InSitu {
+    private:
+        struct Plugin {
+            std::unique_ptr<Analysis> analysis;
+            int every;
+            std::string filename;
+            bool running = false;
+            bool header_written = false;
+            long long bytes = 0;
+            AnalysisTable last;
+        };
+        struct Job {
+            int plugin;
+            ParticleSnapshot snapshot;
+            int step;
+            double time;
+        };
+
+        std::vector<std::unique_ptr<Plugin>> plugins;
+        std::deque<Job> queue;
+        std::vector<std::thread> lanes;
+        int max_pending;
+        int running = 0;
+        bool stop = false;
+        std::exception_ptr error;
+        mutable std::mutex mutex;
+        std::condition_variable changed;
+
+        void lane();
+        long long write(Plugin& plugin, const AnalysisTable& table, int step, double time); // returns the bytes written
+        void rethrow(); // with mutex held
+
+    public:
+        InSitu(int lanes = 1, int max_pending = 4);
+
+        /**
+         * @brief Waits for the analyses still queued or running.
+         */
+        ~InSitu();
+        InSitu(const InSitu&) = delete;
+        InSitu& operator=(const InSitu&) = delete;
+
+        /**
+         * @brief Runs analysis at every step multiple of `every`, its results going to filename (overwritten). Returns its
+         * index.
+         */
+        int add(std::unique_ptr<Analysis> analysis, int every, const std::string& filename);
+
+        /**
+         * @brief Queues the analyses due at this step, on a snapshot of ps, and returns without waiting for them.
+         */
+        void step(const ParticleSet& ps, int step, double time);
+
+        /**
+         * @brief Waits until every queued analysis is done.
+         */
+        void wait();
+
+        /**
+         * @brief Table of the last completed run of an analysis.
+         */
+        AnalysisTable getLast(int plugin) const;
+
+        /**
+         * @brief Bytes written so far by all analyses.
+         */
+        long long getBytesWritten() const;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+
+/**
+ * @brief Complete simulation state, saved in a compact binary file to restart bitwise identically.
+ *
+ * The state is a set of named sections of raw bytes. setParticles() fills the particle sections (positions,
+ * velocities, masses, current times, smoothing lengths, ids and periodic box), and saveIdCounter() the id counter of
+ * Particle; anything else (random engines, time step bins, solver state...) is added under its own name.
+ *
+ * The file is cut into blocks written and read in parallel, each with its CRC-32, so that a corrupted or truncated
+ * file is detected at read time (std::runtime_error). It is first written next to the target and then renamed:
+ * a job killed while writing leaves the previous checkpoint intact.
+ * ```cpp
+ * Checkpoint checkpoint;
+ * checkpoint.setParticles(ps);
+ * checkpoint.saveIdCounter(); // on the thread running the simulation
+ * checkpoint.setRandomEngine("rng", rng);
+ * checkpoint.setValue("step", step);
+ * checkpoint.write("run.chk");
+ *
+ * Checkpoint restart = Checkpoint::read("run.chk");
+ * ParticleSet ps = restart.restoreParticles();
+ * restart.restoreIdCounter();
+ * std::mt19937_64 rng = restart.getRandomEngine<std::mt19937_64>("rng");
+ * int step = restart.getValue<int>("step");
+ * ```
+ */
+class Checkpoint {
+    private:
+        std::map<std::string, std::vector<char>> sections;
+
+    public:
+        static inline const int version = 2; // 2: smoothing lengths
+        static inline const size_t block_size = 1 << 20; // bytes per checksummed block, the unit of parallel I/O
+        static inline const int max_name_length = 31;
+
+        /**
+         * @brief Stores the particles and their periodic box. Leaves the id counter of Particle alone, so it may run on
+         * any thread (e.g. a background output task).
+         */
+        void setParticles(const ParticleSet& ps);
+
+        /**
+         * @brief The stored particles, with their ids.
+         */
+        ParticleSet restoreParticles() const;
+
+        /**
+         * @brief Stores the id counter of Particle, and makes every thread start a new block of ids from it, so that the
+         * run goes on with the ids a restart from this checkpoint gets. Like Particle::setIdCounter(), not to be called
+         * while other threads create particles.
+         */
+        void saveIdCounter();
+
+        /**
+         * @brief Sets the id counter of Particle back to the stored one (see saveIdCounter()).
+         */
+        void restoreIdCounter() const;
+
+        void set(const std::string& name, std::vector<char> bytes);
+        const std::vector<char>& get(const std::string& name) const;
+        bool has(const std::string& name) const {return sections.count(name) > 0;}
+        std::vector<std::string> names() const;
+
+        template <typename T>
+        void setValues(const std::string& name, const std::vector<T>& values) {
+            static_assert(std::is_trivially_copyable<T>::value, "Checkpoint::setValues: values must be trivially copyable.");
+            std::vector<char> bytes(values.size() * sizeof(T));
+            if (!values.empty()) std::memcpy(bytes.data(), values.data(), bytes.size());
+            set(name, std::move(bytes));
+        }
+
+        template <typename T>
+        std::vector<T> getValues(const std::string& name) const {
+            static_assert(std::is_trivially_copyable<T>::value, "Checkpoint::getValues: values must be trivially copyable.");
+            const std::vector<char>& bytes = get(name);
+            std::vector<T> values(bytes.size() / sizeof(T));
+            if (!values.empty()) std::memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+            return values;
+        }
+
+        template <typename T>
+        void setValue(const std::string& name, const T& value) {setValues(name, std::vector<T>{value});}
+
+        template <typename T>
+        T getValue(const std::string& name) const {
+            std::vector<T> values = getValues<T>(name);
+            if (values.size() != 1) throw std::runtime_error("Checkpoint::getValue: section " + name + " does not hold one value.");
+            return values[0];
+        }
+
+        /**
+         * @brief Any standard random engine, through its (exact) text representation.
+         */
+        template <typename Engine>
+        void setRandomEngine(const std::string& name, const Engine& engine) {
+            std::ostringstream stream;
+            stream << engine;
+            std::string text = stream.str();
+            set(name, std::vector<char>(text.begin(), text.end()));
+        }
+
+        template <typename Engine>
+        Engine getRandomEngine(const std::string& name) const {
+            const std::vector<char>& bytes = get(name);
+            std::istringstream stream(std::string(bytes.begin(), bytes.end()));
+            Engine engine;
+            stream >> engine;
+            return engine;
+        }
+
+        /**
+         * @brief Writes every section to filename (through filename.tmp, renamed once complete).
+         */
+        void write(const std::string& filename) const;
+
+        /**
+         * @brief Reads a checkpoint, checking every block. Throws std::runtime_error if the file is not a
+         * checkpoint or is corrupted.
+         */
+        static Checkpoint read(const std::string& filename);
+
+        /**
+         * @brief CRC-32 (IEEE 802.3 polynomial) of size bytes, continuing from a previous crc.
+         */
+        static uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+};
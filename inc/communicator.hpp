@@ -0,0 +1,95 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+
+
+/**
+ * @brief Message passing between local processes, for multi-process runs on a single Linux machine without MPI.
+ *
+ * run() forks the processes, every pair of them being connected by a Unix socket pair, and calls the same
+ * function in each one with its own communicator (rank 0 being the calling process). Messages are raw bytes;
+ * pack() and unpack() convert vectors of trivially copyable values.
+ *
+ * Every communication is collective: all processes must call it, in the same order.
+ * ```cpp
+ * Communicator::run(4, [](Communicator& comm) {
+ *     double local = comm.getRank();
+ *     double total = comm.allreduce(local, [](double a, double b) {return a + b;}); // 0 + 1 + 2 + 3
+ * });
+ * ```
+ */
+class Communicator {
+    private:
+        int rank;
+        int n_ranks;
+        std::vector<int> sockets; // sockets[r] connects to rank r, -1 for this rank
+
+        Communicator(int rank, int n_ranks, std::vector<int> sockets) : rank(rank), n_ranks(n_ranks), sockets(sockets) {};
+
+    public:
+        Communicator(const Communicator&) = delete;
+        Communicator& operator=(const Communicator&) = delete;
+        ~Communicator();
+
+        /**
+         * @brief Runs f in n_processes processes and returns once they are all done. Throws std::runtime_error
+         * if f throws or the process dies in any of them (the others then fail as soon as they talk to it).
+         */
+        static void run(int n_processes, const std::function<void(Communicator&)>& f);
+
+        int getRank() const {return rank;}
+        int getSize() const {return n_ranks;}
+
+        /**
+         * @brief All to all exchange: outgoing[r] is sent to rank r, and the returned incoming[r] was sent by rank r.
+         * Sends and receives are interleaved (poll), so messages of any size cannot deadlock.
+         */
+        std::vector<std::vector<char>> exchange(const std::vector<std::vector<char>>& outgoing);
+
+        /**
+         * @brief The data of every rank, in rank order.
+         */
+        std::vector<std::vector<char>> allgather(const std::vector<char>& data);
+
+        void barrier();
+
+        /**
+         * @brief Element-wise reduction of equally sized vectors, combined in rank order (same result on every rank).
+         */
+        template <typename T, typename Combine>
+        std::vector<T> allreduce(const std::vector<T>& local, Combine combine) {
+            std::vector<std::vector<char>> all = allgather(pack(local));
+            std::vector<T> result = unpack<T>(all[0]);
+            for (int r = 1; r < n_ranks; r++) {
+                std::vector<T> other = unpack<T>(all[r]);
+                for (int i = 0; i < (int)result.size(); i++) {
+                    result[i] = combine(result[i], other[i]);
+                }
+            }
+            return result;
+        }
+
+        template <typename T, typename Combine>
+        T allreduce(const T& local, Combine combine) {
+            return allreduce(std::vector<T>{local}, combine)[0];
+        }
+
+        template <typename T>
+        static std::vector<char> pack(const std::vector<T>& values) {
+            static_assert(std::is_trivially_copyable<T>::value, "Communicator::pack: values must be trivially copyable.");
+            std::vector<char> bytes(values.size() * sizeof(T));
+            if (!values.empty()) std::memcpy(bytes.data(), values.data(), bytes.size());
+            return bytes;
+        }
+
+        template <typename T>
+        static std::vector<T> unpack(const std::vector<char>& bytes) {
+            static_assert(std::is_trivially_copyable<T>::value, "Communicator::unpack: values must be trivially copyable.");
+            std::vector<T> values(bytes.size() / sizeof(T));
+            if (!values.empty()) std::memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+            return values;
+        }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "communicator.hpp"
+#include "particleSet.hpp"
+#include "octree.hpp"
+#include "gravity.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+
+/**
+ * @brief A cell of the global top tree: the bounding box and monopole of a top-level subtree of one rank.
+ */
+struct DomainCell {
+    Eigen::Vector3d min = Eigen::Vector3d::Zero(); // axis aligned bounding box of the particles of the cell
+    Eigen::Vector3d max = Eigen::Vector3d::Zero();
+    double mass = 0;
+    Eigen::Vector3d com = Eigen::Vector3d::Zero();
+    int rank = 0; // owner of the particles
+
+    /**
+     * @brief Distance between x and the box (nearest image if a periodic box is given), 0 inside.
+     */
+    double distance(const Eigen::Vector3d& x, const std::optional<PeriodicBox>& box) const;
+};
+
+
+/**
+ * @brief Splits particles between the processes of a Communicator along the Morton space filling curve.
+ *
+ * Each rank owns a contiguous range of the curve, chosen so that every rank gets the same total cost (e.g. the number
+ * of interactions of each particle at the previous step, see accelerations()). Ranges only move when the load
+ * imbalance exceeds the tolerance, and then only the particles whose owner changed migrate.
+ *
+ * Other ranks are seen through the global top tree: the few top-level cells of every rank (DomainCell). They decide
+ * which particles are sent as SPH halos, and which part of the local tree is sent to each rank for gravity
+ * (locally essential tree: accepted nodes as point masses, opened leaves as particles).
+ * ```cpp
+ * Communicator::run(4, [](Communicator& comm) {
+ *     ParticleSet local = ...; // any initial split
+ *     std::vector<double> costs(local.size(), 1.0);
+ *     Decomposition domain(comm);
+ *     TreeGravity gravity(0.01, 0.5);
+ *     for (int step = 0; step < n_steps; step++) {
+ *         domain.balance(local, costs);
+ *         std::vector<Eigen::Vector3d> acc = domain.accelerations(local, gravity, costs); // costs of the next balance
+ *         ParticleSet ghosts = domain.exchangeHalos(local, 2 * h);
+ *         ...
+ *     }
+ * });
+ * ```
+ */
+class Decomposition {
+    public:
+        static inline const int bin_level = 6; // costs are histogrammed over the 2^(3 * 6) cells of that level of the curve
+        static inline const int cells_per_rank = 16; // top tree cells sent by each rank
+
+        Decomposition(Communicator& comm, double tolerance = 0.05) : comm(comm), tolerance(tolerance) {};
+
+        /**
+         * @brief Moves particles (and their costs) to the rank owning their part of the curve, after moving the
+         * boundaries if the imbalance is above the tolerance. Returns the number of particles sent by this rank.
+         */
+        int balance(ParticleSet& local, std::vector<double>& costs);
+
+        /**
+         * @brief balance() with the same cost for every particle.
+         */
+        int balance(ParticleSet& local);
+
+        /**
+         * @brief The particles of the other ranks within radius of the cells of this one, shifted to their nearest
+         * image in a periodic box. Builds the top tree.
+         */
+        ParticleSet exchangeHalos(const ParticleSet& local, double radius);
+
+        /**
+         * @brief The locally essential tree of the other ranks for this one: point masses standing for the remote nodes
+         * that pass the geometric opening criterion for every cell of this rank, and the particles of the remote leaves
+         * that do not. Builds the top tree.
+         */
+        ParticleSet importGravitySources(const ParticleSet& local, double theta);
+
+        /**
+         * @brief Gravity on the local particles from all ranks: the solver builds its tree over the local particles plus
+         * the imported sources, and walks it for the local particles only. costs receives the interactions of each local particle, the weights of the next balance();
+         * given as they come back from balance(), they also balance the walk. The previous accelerations and costs the
+         * solver keeps are those of the local particles only.
+         */
+        std::vector<Eigen::Vector3d> accelerations(const ParticleSet& local, TreeGravity& solver, std::vector<double>& costs);
+
+        /**
+         * @brief Rank owning a Morton key of the current key space.
+         */
+        int owner(uint64_t key) const;
+
+        /**
+         * @brief Morton key of x in the key space of the last balance().
+         */
+        uint64_t key(const Eigen::Vector3d& x) const {return Octree::mortonKey(x, origin, side);}
+
+        /**
+         * @brief Largest cost of a rank over the mean cost, after the last balance() (1 is a perfect balance).
+         */
+        double getImbalance() const {return imbalance;}
+        const std::vector<DomainCell>& getTopTree() const {return top_tree;}
+
+        /**
+         * @brief Sum of the local counts of every rank.
+         */
+        long long globalCount(const ParticleSet& local);
+
+    private:
+        Communicator& comm;
+        double tolerance;
+        Eigen::Vector3d origin = Eigen::Vector3d::Zero(); // key space: the cube [origin, origin + side)^3
+        double side = 0;
+        std::vector<uint64_t> splits; // rank r owns the bins [splits[r], splits[r + 1])
+        double imbalance = 0;
+        std::vector<DomainCell> top_tree;
+        std::vector<Eigen::Vector3d> previous_acc; // of the local particles at the last accelerations(), in their order
+
+        /**
+         * @brief Gathers the top-level cells of every rank, those of this rank being the subtrees of its local tree.
+         */
+        void buildTopTree(const Octree& tree);
+};
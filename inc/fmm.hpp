@@ -0,0 +1,62 @@
+#pragma once
+
+#include "gravity.hpp"
+#include "multipole.hpp"
+#include "octree.hpp"
+
+
+/**
+ * @brief Fast multipole method on the Octree, with Cartesian Taylor expansions of configurable order (see Expansion).
+ *
+ * 1. upward pass: multipole moments of the leaves (P2M), then of their parents (M2M), see Octree::computeMultipoles()
+ * 2. dual tree walk: two nodes A (target) and B (source) are well separated if r_A + r_B < theta * |com_A - com_B|,
+ *    in which case B is turned into a local expansion around A (M2L). Otherwise the larger of the two is opened,
+ *    and two leaves that are too close are summed directly (P2P).
+ * 3. downward pass: local expansions are passed down to the children (L2L) and evaluated at the particles (L2P)
+ *
+ * Cell-cell interactions make the cost O(N) at fixed accuracy, instead of O(N log N) for a Barnes-Hut walk.
+ * Periodic boxes are not supported (std::invalid_argument): use TreeGravity.
+ * ```cpp
+ * FmmGravity fmm(0.01, 5, 0.5); // softening, order, theta
+ * std::vector<Eigen::Vector3d> acc = fmm.accelerations(ps);
+ * ```
+ */
+class FmmGravity : public GravitySolver {
+    private:
+        Expansion expansion;
+        double theta;
+        int leaf_size;
+        long long m2l_interactions = 0; // counters of the last call
+        long long p2p_interactions = 0;
+
+    public:
+        FmmGravity(double softening, int order = 4, double theta = 0.5, double G = 1.0, int leaf_size = 32);
+
+        std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps);
+
+        /**
+         * @brief Accelerations of the particles of an already built tree, in tree order. Computes the multipole
+         * moments of the tree if needed.
+         */
+        std::vector<Eigen::Vector3d> accelerations(Octree& tree);
+
+        int getOrder() const {return expansion.getOrder();}
+        double getTheta() const {return theta;}
+        long long getM2LInteractions() const {return m2l_interactions;}
+        long long getP2PInteractions() const {return p2p_interactions;}
+
+    private:
+        // coefficients of node i are stored at [i * count, (i+1) * count)
+        struct Workspace {
+            const Octree& tree;
+            std::vector<double> locals;
+            std::vector<Eigen::Vector3d> acc; // near field, then total, in tree order
+        };
+
+        /**
+         * @brief Interaction of source node b onto target node a. Returns the number of (M2L, P2P) interactions.
+         */
+        std::pair<long long, long long> interact(Workspace& w, int a, int b) const;
+
+        void downwardPass(Workspace& w, int node) const;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include "octree.hpp"
+#include <Eigen/Dense>
+#include <atomic>
+#include <vector>
+#include <string>
+
+
+/**
+ * @brief Union-find (disjoint sets) over [0, n) that many threads can update at once, without locks: unite() only ever
+ * links a root under a smaller root with a compare and swap, and find() halves the paths it walks. The root of a set is
+ * thus always its smallest element, whatever the order in which the unions ran.
+ * ```cpp
+ * ConcurrentUnionFind sets(n);
+ * Parallel::forRange(n_pairs, [&](int begin, int end) {
+ *     for (int k = begin; k < end; k++) sets.unite(a[k], b[k]);
+ * });
+ * bool same = sets.find(x) == sets.find(y);
+ * ```
+ */
+class ConcurrentUnionFind {
+    private:
+        std::vector<std::atomic<int>> parent;
+
+    public:
+        explicit ConcurrentUnionFind(int n);
+
+        int size() const {return parent.size();}
+
+        /**
+         * @brief Root (smallest element) of the set of i.
+         */
+        int find(int i) {
+            while (true) {
+                int p = parent[i].load(std::memory_order_relaxed);
+                if (p == i) return i;
+                int grandparent = parent[p].load(std::memory_order_relaxed);
+                if (grandparent != p) parent[i].compare_exchange_weak(p, grandparent, std::memory_order_relaxed);
+                i = grandparent;
+            }
+        }
+
+        /**
+         * @brief Merges the sets of a and b.
+         */
+        void unite(int a, int b) {
+            while (true) {
+                a = find(a);
+                b = find(b);
+                if (a == b) return;
+                if (a < b) std::swap(a, b);
+                // a may have been linked since find(): then try again from its new root
+                if (parent[a].compare_exchange_strong(a, b, std::memory_order_acq_rel)) return;
+            }
+        }
+};
+
+
+/**
+ * @brief A group of the friends-of-friends catalog.
+ */
+struct FofGroup {
+    int members = 0;
+    int first = 0; // smallest index in the set of its particles
+    double mass = 0;
+    Eigen::Vector3d center_of_mass = Eigen::Vector3d::Zero(); // inside the periodic box, if any
+    Eigen::Vector3d velocity = Eigen::Vector3d::Zero(); // of the center of mass
+    double velocity_dispersion = 0; // one dimensional: sqrt(sum m |v - velocity|^2 / (3 mass))
+};
+
+
+/**
+ * @brief Friends-of-friends group finder: two particles closer than the linking length are friends, and groups are the
+ * sets of particles connected by friendships (Davis et al. 1985), across periodic boundaries if the set is periodic.
+ *
+ * Friends are found with an Octree, built for the purpose or reused (e.g. from gravity), and merged into a
+ * ConcurrentUnionFind. The particles of a node smaller than the linking length (its diagonal) are all friends: they are
+ * merged first, and then every particle walks the tree in parallel, skipping such nodes as soon as they are in its own
+ * set, which keeps dense halos cheap. Groups of at least min_members particles then make the catalog,
+ * largest first (ties by first particle, so the catalog does not depend on the number of threads), and their masses,
+ * centers of mass and velocity dispersions are summed in parallel, large groups with Parallel::reduce.
+ * ```cpp
+ * FriendsOfFriends fof(FriendsOfFriends::linkingLength(ps, 0.2), 32);
+ * const std::vector<FofGroup>& halos = fof.find(ps);
+ * int group = fof.getLabels()[i]; // index in halos, -1 if i is in no group of 32 particles or more
+ * fof.export_csv("halos.csv");
+ * ```
+ */
+class FriendsOfFriends {
+    private:
+        double linking_length;
+        int min_members;
+
+        std::vector<FofGroup> groups;
+        std::vector<int> labels;
+
+        /**
+         * @brief Groups, labels and their sums, from the linked sets.
+         */
+        void catalog(const ParticleSet& ps, ConcurrentUnionFind& sets);
+
+    public:
+        FriendsOfFriends(double linking_length, int min_members = 20);
+
+        /**
+         * @brief Finds the groups of ps, and returns the catalog (also getGroups()).
+         */
+        const std::vector<FofGroup>& find(const ParticleSet& ps);
+
+        /**
+         * @brief The same with a tree already built over ps, e.g. for gravity.
+         */
+        const std::vector<FofGroup>& find(const ParticleSet& ps, const Octree& tree);
+
+        const std::vector<FofGroup>& getGroups() const {return groups;}
+
+        /**
+         * @brief Group of every particle of the last set, as an index in getGroups(), -1 for particles outside of the
+         * catalog (in groups smaller than min_members).
+         */
+        const std::vector<int>& getLabels() const {return labels;}
+
+        /**
+         * @brief Exports the catalog to a csv file, with header, one group per line.
+         */
+        void export_csv(const std::string& filename) const;
+
+        /**
+         * @brief b times the mean interparticle spacing (V / N)^(1/3), V being the volume of the periodic box, or of the
+         * bounding box of the set in open space. b = 0.2 picks halos at about 180 times the mean density.
+         */
+        static double linkingLength(const ParticleSet& ps, double b = 0.2);
+
+        double getLinkingLength() const {return linking_length;}
+        int getMinMembers() const {return min_members;}
+};
@@ -0,0 +1,337 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include "octree.hpp"
+#include "multipole.hpp"
+#include "neighborList.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <memory>
+
+
+
+// -------------------- //
+// !-- Gravity Base --! //
+// -------------------- //
+
+/**
+ * @brief Available long range solvers, see GravitySolver::create().
+ */
+enum class GravityMethod {
+    Direct, // exact O(N^2) summation
+    Tree, // Barnes-Hut tree walk, O(N log N)
+    FMM // fast multipole method, O(N)
+};
+
+/**
+ * @brief virtual class for the gravity solvers. Every solver computes the acceleration of each particle of a set,
+ * returned in the same order as the particles of the set.
+ *
+ * Gravity is Plummer softened: the acceleration of i due to j is
+ * G m_j (x_j - x_i) / (|x_j - x_i|^2 + eps^2)^(3/2)
+ *
+ * ```cpp
+ * class MySolver : public GravitySolver {
+ *      MySolver(double softening) : GravitySolver(softening) {};
+ *      std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps);
+ * }
+ * ```
+ */
+class GravitySolver {
+    protected:
+        const double softening; // Plummer softening length eps
+        const double G; // gravitational constant
+
+    public:
+        GravitySolver(double softening, double G = 1.0) : softening(softening), G(G) {};
+        virtual ~GravitySolver() {};
+
+        double getSoftening() const {return softening;}
+        double getG() const {return G;}
+
+        /**
+         * @brief Acceleration of every particle of the set.
+         */
+        virtual std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps) = 0;
+
+        /**
+         * @brief Creates the solver of the given method, so that the method can be chosen at runtime.
+         * theta is the opening angle of the tree and FMM, order the expansion order of the FMM.
+         */
+        static std::unique_ptr<GravitySolver> create(GravityMethod method, double softening, double theta = 0.5, int order = 4, double G = 1.0);
+};
+
+
+
+// ---------------------- //
+// !-- Direct Gravity --! //
+// ---------------------- //
+
+/**
+ * @brief Exact O(N^2) direct summation, used as the reference to validate and tune the approximate solvers.
+ *
+ * Positions and masses are first copied into flat arrays. Targets are then split between threads, and the
+ * sources are swept in tiles small enough to stay in L1 cache, the inner loop over a tile being branchless
+ * so that the compiler vectorizes it.
+ *
+ * If the sources are in a periodic box, each pair interacts through its nearest image plus the Ewald correction
+ * for all the other images (scalar loop).
+ */
+class DirectGravity : public GravitySolver {
+    public:
+        static inline const int tile_size = 512; // sources per tile: 4 arrays * 512 * 8 bytes = 16 kB
+
+        DirectGravity(double softening, double G = 1.0) : GravitySolver(softening, G) {};
+
+        std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps);
+
+        /**
+         * @brief Acceleration created by the particles of `sources` at every position of `targets`.
+         */
+        std::vector<Eigen::Vector3d> accelerations(const std::vector<Eigen::Vector3d>& targets, const ParticleSet& sources) const;
+
+    private:
+        std::vector<Eigen::Vector3d> periodicAccelerations(const std::vector<Eigen::Vector3d>& targets, const ParticleSet& sources) const;
+};
+
+
+
+// -------------------- //
+// !-- Tree Gravity --! //
+// -------------------- //
+
+/**
+ * @brief When a node of the tree is accurate enough to be used as a whole, rather than opened.
+ * Whatever the criterion, a node containing the particle is always opened.
+ */
+enum class OpeningCriterion {
+    Geometric, // Barnes-Hut: l < theta * d, with l the side of the node and d the distance to its center of mass
+    Relative, // GADGET: G M / d^2 (l / d)^(p+1) < alpha |a_old|, p being the multipole order (at least 1)
+    SalmonWarren // Salmon & Warren (1994) bound on the truncation error of the expansion < alpha |a_old|
+};
+
+
+/**
+ * @brief Barnes-Hut tree code. Each particle walks the Octree, and a node accepted by the opening criterion acts
+ * through the multipole expansion of its particles about their center of mass. Leaves that cannot be accepted
+ * are summed directly.
+ *
+ * The multipole order is 0 or 1 for a point mass (the dipole vanishes about the center of mass), 2 to add the
+ * quadrupole and 3 the octupole. The Relative and SalmonWarren criteria compare the error to the acceleration of
+ * the particle at the previous call; on the first call (or if the number of particles changed) a geometric walk
+ * provides that estimate first.
+ *
+ * In a periodic box, distances are taken between nearest images, a node is only accepted if it lies within the half
+ * box around the particle, and every interaction adds the Ewald correction of its mass.
+ *
+ * With a group size (setGroupSize()), the particles of each node holding at most that many particles walk the tree
+ * together: nodes are accepted for the bounding box of the whole group, and the accepted nodes and the particles of
+ * the opened leaves form one interaction list, evaluated for every member in a vectorized loop. That trades a few
+ * more interactions for far fewer (and branch-free) traversals. Periodic trees always walk per particle.
+ * ```cpp
+ * TreeGravity tree(0.01, 0.7);
+ * tree.setMultipoleOrder(2);
+ * tree.setOpeningCriterion(OpeningCriterion::Relative, 0.001);
+ * tree.setGroupSize(32);
+ * std::vector<Eigen::Vector3d> acc = tree.accelerations(ps);
+ * ```
+ */
+class TreeGravity : public GravitySolver {
+    protected:
+        double theta; // opening angle
+        int leaf_size;
+        int order = 0; // multipole order
+        Expansion expansion = Expansion(0);
+        OpeningCriterion criterion = OpeningCriterion::Geometric;
+        double alpha = 0.001; // tolerated error, relative to the previous acceleration
+        std::vector<double> previous_acc; // |a| of each target at the previous call, in the order of the set
+        long long node_interactions = 0; // counters of the last call
+        long long particle_interactions = 0;
+        std::vector<double> costs; // interactions of each particle at the last call
+        std::vector<double> previous_costs; // the same for the targets in the order of the set, to balance the next call
+        int n_targets = 0; // the first particles of the set, whose accelerations the current call computes
+        int group_size = 1; // particles walking the tree together, 1 for a walk per particle
+        long long walks = 0; // traversals of the last call
+
+    public:
+        TreeGravity(double softening, double theta = 0.5, double G = 1.0, int leaf_size = 8) : GravitySolver(softening, G), theta(theta), leaf_size(leaf_size) {};
+
+        std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps);
+
+        /**
+         * @brief Accelerations of the first n_targets particles of the set only: the tree holds them all, but the others
+         * only act as sources and do not walk it (e.g. the sources imported from other processes, see Decomposition).
+         * Previous accelerations and costs are then those of the targets.
+         */
+        std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps, int n_targets);
+
+        /**
+         * @brief Accelerations of the particles of an already built tree, in tree order. Computes the multipole
+         * moments of the tree if needed.
+         */
+        std::vector<Eigen::Vector3d> accelerations(Octree& tree);
+
+        /**
+         * @brief Accelerations and SPH neighbors of a self-gravitating gas in one traversal: the walk of each particle
+         * also gathers the particles within its search radius (h_i + skin, see NeighborList) from the leaves it opens,
+         * and list is replaced by what was found. Nodes and particles are thus fetched once per step instead of twice.
+         * ```cpp
+         * std::vector<Eigen::Vector3d> acc = gravity.accelerations(ps, kernel, list);
+         * std::vector<Eigen::Vector3d> hydro = sph.accelerations(ps, list);
+         * ```
+         */
+        std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps, const Kernel& kernel, NeighborList& list);
+
+        /**
+         * @brief 0 or 1: monopole, 2: quadrupole, 3: octupole (higher orders work too, but the error bounds stop at 3).
+         */
+        void setMultipoleOrder(int order);
+
+        /**
+         * @brief alpha is the tolerated force error relative to |a_old| for the Relative and SalmonWarren criteria.
+         * The Geometric criterion uses theta.
+         */
+        void setOpeningCriterion(OpeningCriterion criterion, double alpha = 0.001);
+
+        /**
+         * @brief Accelerations used by the Relative and SalmonWarren criteria, in the order of the set (of its targets)
+         * (by default those of the previous call).
+         */
+        void setPreviousAccelerations(const std::vector<Eigen::Vector3d>& acc);
+
+        /**
+         * @brief Interactions of each particle used to balance the next call, in the order of the set (by default
+         * getCosts() of the previous call). Ignored if the next call does not have that many targets.
+         */
+        void setPreviousCosts(const std::vector<double>& costs) {previous_costs = costs;}
+
+        /**
+         * @brief Maximal number of particles walking the tree together (1: one walk per particle). Groups are the largest
+         * nodes with at most that many particles, so a group size of at least the leaf size walks once per leaf.
+         * The combined gravity and neighbor walk (accelerations(ps, kernel, list)) still walks per particle.
+         */
+        void setGroupSize(int size);
+
+        double getTheta() const {return theta;}
+        int getGroupSize() const {return group_size;}
+        long long getWalks() const {return walks;}
+        int getMultipoleOrder() const {return order;}
+        OpeningCriterion getOpeningCriterion() const {return criterion;}
+        long long getNodeInteractions() const {return node_interactions;}
+        long long getParticleInteractions() const {return particle_interactions;}
+
+        /**
+         * @brief Number of interactions (nodes + particles) of each target at the last call, in the order of the set
+         * (tree order after accelerations(Octree&)). A measure of the work per particle, for load balancing.
+         */
+        const std::vector<double>& getCosts() const {return costs;}
+
+    protected:
+        /**
+         * @brief Neighbors gathered during a walk: search radius of each particle and, per range of particles walked
+         * as one task, their lists (set indices) one after the other, in tree order.
+         */
+        struct NeighborGather {
+            std::vector<double> radii; // tree order
+            std::vector<int> counts; // tree order
+            std::vector<std::vector<int>> ranges;
+        };
+
+        /**
+         * @brief Accelerations of the targets of the tree, in tree order (zero for the other particles).
+         */
+        std::vector<Eigen::Vector3d> walkTree(Octree& tree);
+
+        /**
+         * @brief Whether the particle k of the tree (in tree order) is a target of the current call.
+         */
+        bool isTarget(const Octree& tree, int k) const {return tree.index[k] < n_targets;}
+
+        /**
+         * @brief Expected cost of each particle of the tree (in tree order), from its interactions at the previous call,
+         * to cut the walks into tasks of about equal work. The same for all targets if there is no previous call, and
+         * nothing for the other particles.
+         */
+        std::vector<double> previousCosts(const Octree& tree) const;
+
+        /**
+         * @brief Keeps the costs of this call (in tree order) for the next one.
+         */
+        void updateCosts(const Octree& tree);
+
+        /**
+         * @brief |a_old| of the particles of the tree (in tree order) for the Relative and SalmonWarren criteria,
+         * empty for the Geometric one.
+         */
+        std::vector<double> oldAccelerations(const Octree& tree);
+
+        /**
+         * @brief Whether node can be used as a whole for a particle at x with acceleration a_old.
+         */
+        bool accept(const Octree& tree, const OctreeNode& node, const Eigen::Vector3d& x, double r2, double a_old, OpeningCriterion criterion) const {
+            return accept(tree, node, x, Eigen::Vector3d::Zero(), r2, a_old, criterion);
+        }
+
+        /**
+         * @brief Same for every point of the box of center x and half sides extent, r2 being the smallest squared
+         * distance between the center of mass of node and the box.
+         */
+        bool accept(const Octree& tree, const OctreeNode& node, const Eigen::Vector3d& x, const Eigen::Vector3d& extent, double r2, double a_old, OpeningCriterion criterion) const;
+
+        /**
+         * @brief Acceleration at x, walking the tree from the root. Interactions are counted in the two counters.
+         * If neighbors is given, the set indices of the particles within radius of x are appended to it.
+         */
+        Eigen::Vector3d walk(const Octree& tree, const Eigen::Vector3d& x, double a_old, OpeningCriterion criterion, long long& nodes, long long& particles,
+                             double radius = 0, std::vector<int>* neighbors = nullptr) const;
+
+        /**
+         * @brief Walks the tree for all its targets (in tree order) and updates the counters, gathering neighbors too if asked.
+         * Ranges of particles of about equal cost are balanced between the workers by work stealing.
+         */
+        std::vector<Eigen::Vector3d> walkAll(const Octree& tree, const std::vector<double>& a_old, OpeningCriterion criterion, NeighborGather* gather = nullptr);
+
+        /**
+         * @brief Same, one walk per group of particles (see setGroupSize()). Subtrees of about equal cost are balanced
+         * between the workers by work stealing, splitting the expensive ones into their children.
+         */
+        std::vector<Eigen::Vector3d> walkGroups(const Octree& tree, const std::vector<double>& a_old, OpeningCriterion criterion);
+};
+
+
+
+// ------------------- //
+// !-- Force Error --! //
+// ------------------- //
+
+/**
+ * @brief Distribution of the relative error |a - a_ref| / |a_ref| of an approximate acceleration field against
+ * a reference one (typically DirectGravity). Used to pick opening angles and expansion orders with data.
+ *
+ * ```cpp
+ * ForceError error = ForceError::compare(direct.accelerations(ps), tree.accelerations(ps));
+ * error.display();
+ * ```
+ */
+class ForceError {
+    public:
+        int count = 0;
+        double mean = 0;
+        double rms = 0;
+        double median = 0;
+        double p90 = 0; // 90th percentile
+        double p99 = 0; // 99th percentile
+        double max = 0;
+
+        static ForceError compare(const std::vector<Eigen::Vector3d>& reference, const std::vector<Eigen::Vector3d>& approximation);
+
+        /**
+         * @brief Fraction of the particles with a relative error above the threshold.
+         */
+        double fractionAbove(double threshold) const;
+
+        void display(std::string name = "ForceError") const;
+
+    private:
+        std::vector<double> sorted_errors;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include "random.hpp"
+#include <cstdint>
+
+
+/**
+ * @brief Initial condition generators. Every particle draws its own numbers from a counter-based generator (Philox),
+ * indexed by the particle, so sets are built in parallel and are bit for bit the same whatever the number of threads.
+ * The same seed always gives the same set; particles get consecutive ids.
+ *
+ * All sets have a total mass of 1, and the equilibrium models (Plummer, Hernquist) are in units where G = 1.
+ * ```cpp
+ * ParticleSet cluster = InitialConditions::plummer(100000, 42);
+ * ParticleSet gas = InitialConditions::glass(32768, 7); // periodic unit box
+ * ```
+ */
+class InitialConditions {
+    public:
+        /**
+         * @brief Uniform in the cube [0, side)^3, at rest.
+         */
+        static ParticleSet uniformCube(int n, uint64_t seed = 0, double side = 1.0);
+
+        /**
+         * @brief Uniform in the ball of the given radius around the origin, at rest.
+         */
+        static ParticleSet uniformSphere(int n, uint64_t seed = 0, double radius = 1.0);
+
+        /**
+         * @brief Plummer sphere of scale radius a in equilibrium, with isotropic velocities drawn from its distribution
+         * function (Aarseth, Henon & Wielen 1974). Radii are truncated at r_max (default 20 a: 99.6% of the mass).
+         */
+        static ParticleSet plummer(int n, uint64_t seed = 0, double a = 1.0, double r_max = 20.0);
+
+        /**
+         * @brief Hernquist (1990) sphere of scale radius a, truncated at r_max (default 50 a: 96% of the mass).
+         * Velocities are Gaussian with the isotropic Jeans dispersion at each radius, below the escape speed
+         * (Hernquist 1993): close to, but not exactly, the equilibrium distribution.
+         */
+        static ParticleSet hernquist(int n, uint64_t seed = 0, double a = 1.0, double r_max = 50.0);
+
+        /**
+         * @brief Glass-like set in the periodic box [0, side)^3: a uniform random set relaxed by a short range repulsion
+         * between neighbors, leaving a uniform density without the Poisson clumps of a random set nor the preferred
+         * directions of a lattice. The set comes back periodic.
+         */
+        static ParticleSet glass(int n, uint64_t seed = 0, double side = 1.0, int iterations = 30);
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "precision.hpp"
 #include <Eigen/Dense>
 #include <iostream>
 #include <vector>
@@ -11,48 +12,106 @@
 // !-- Kernel Base --! //
 // ------------------- //
 
+/**
+ * @brief Everything a pair loop needs from the kernel for one pair, out of a single evaluation.
+ * The gradient w.r.t. the separation d is gradient_factor * d.
+ */
+template <typename Real>
+struct KernelSample {
+    Real value = 0; // W(r, h)
+    Real gradient_factor = 0; // dW/dr / r
+    Real dh = 0; // dW/dh
+
+    Eigen::Matrix<Real, 3, 1> gradient(const Eigen::Matrix<Real, 3, 1>& d) const {return gradient_factor * d;}
+};
+
+
 /**
  * @brief virtual class to implement kernel for SPH
- * 
+ *
  * User must implement the virtual function the following way:
  * ```cpp
  * class MyKernel : public Kernel {
  *      //initialize smoothing radius
  *      MyKernel(...) : Kernel(smoothingRadius);
- * 
+ *
  *      // define the kernel function (is not necessarly of integral 1, but its volume must be given in getVolume())
  *      double operator()(double r) const = 0;
- * 
+ *
  *      // define its derivative
  *      double ddr(double r) const;
- * 
+ *
  *      // define the integral of the kernel over the smoothing radius
  *      double getVolume() const;
  * }
  * ```
- * 
+ *
+ * Kernels are templated on their floating point type: Kernel, LinearKernel... are the versions in `real`, the
+ * precision of the build (see precision.hpp), and BasicQuarticKernel<double> or <float> a given one.
  */
-class Kernel {
+template <typename Real>
+class BasicKernel {
+    public:
+        using Vector3 = Eigen::Matrix<Real, 3, 1>;
+
     protected:
-        const double h; // smoothing radius
-    
+        const Real h; // smoothing radius
+
     public:
-        //constructor 
-        Kernel(double smoothingRadius) : h(smoothingRadius){};
+        //constructor
+        BasicKernel(Real smoothingRadius) : h(smoothingRadius){};
+        virtual ~BasicKernel() = default;
+
 
+        Real operator()(Real r) const;
+        Real operator()(const Vector3& r) const;
 
-        double operator()(double r) const;
-        double operator()(const Eigen::Vector3d& r) const;
+        Vector3 gradient(const Vector3& r) const;
+
+        /**
+         * @brief The same kernel with smoothing radius h instead of getSmoothingRadius(), for adaptive
+         * (per particle or per pair) smoothing lengths.
+         */
+        Real operator()(Real r, Real h) const;
+        Real operator()(const Vector3& r, Real h) const;
+        Vector3 gradient(const Vector3& r, Real h) const;
 
-        Eigen::Vector3d gradient(const Eigen::Vector3d& r) const;
+        /**
+         * @brief Derivative of the kernel w.r.t. the smoothing radius at fixed r, used to solve for h.
+         */
+        Real dh(Real r, Real h) const;
 
-        double getSmoothingRadius() const {return h;}
+        /**
+         * @brief Value, gradient and h-derivative at once, from the squared distance r2 of the pair: one (virtual) call,
+         * one division by h, and no square root at all outside the support. This is the call for pair loops:
+         * ```cpp
+         * KernelSample<real> s = kernel.sample(d.squaredNorm(), h);
+         * rho += m * s.value;
+         * force += m * s.gradient(d);
+         * ```
+         */
+        KernelSample<Real> sample(Real r2, Real h) const {
+            if (r2 >= h * h) return KernelSample<Real>();
+            const Real inv_h = Real(1) / h;
+            const Real inv_h3 = inv_h * inv_h * inv_h;
+            const Real r = std::sqrt(r2);
+            const Real u = r * inv_h;
+            Real w, dw;
+            shape(u, w, dw);
+            KernelSample<Real> s;
+            s.value = w * inv_h3;
+            s.gradient_factor = r > 0 ? dw * inv_h3 * inv_h / r : Real(0);
+            s.dh = -(3 * w + u * dw) * inv_h3 * inv_h;
+            return s;
+        }
+
+        Real getSmoothingRadius() const {return h;}
 
         /**
          * @brief Computes the integral of the Kernel over the sphere defined by the smoothin radius. For debugging purpous, should return 1
          */
-        double computeIntegral() const;
-        
+        Real computeIntegral() const;
+
 
     // --------------- //
     // !-- Virtual --! //
@@ -62,39 +121,59 @@ class Kernel {
          * @brief Any Kernel function (allowed not to be normalized). However, its integral
          * over the unit sphere must be defined in V();
          */
-        virtual double W(double u) const = 0;
+        virtual Real W(Real u) const = 0;
 
         /**
-         * @brief The derivative of the kernel function w.r.t. r
+         * @brief The derivative of the kernel function w.r.t. u = r / h
          */
-        virtual double ddr(double u) const = 0;
+        virtual Real ddr(Real u) const = 0;
 
         /**
          * @brief Defines the volume of the Kernel. Is actually only called once, by the constructor of Kernel
          */
-        virtual double V() const = 0;
-        
+        virtual Real V() const = 0;
+
+        /**
+         * @brief W(u) / V() and ddr(u) / V() in one call. Kernels may override it with a direct formula, so that
+         * sample() costs a single virtual call.
+         */
+        virtual void shape(Real u, Real& w, Real& dw) const {
+            const Real volume = V();
+            w = W(u) / volume;
+            dw = ddr(u) / volume;
+        }
+
 };
 
+using Kernel = BasicKernel<real>;
+
 
 
-class LinearKernel : public Kernel {
+template <typename Real>
+class BasicLinearKernel : public BasicKernel<Real> {
     public:
-        LinearKernel(double smoothingRadius) : Kernel(smoothingRadius) {};
+        BasicLinearKernel(Real smoothingRadius) : BasicKernel<Real>(smoothingRadius) {};
 
-        double W(double u) const;
-        double ddr(double u) const;
-        double V() const;
+        Real W(Real u) const;
+        Real ddr(Real u) const;
+        Real V() const;
+        void shape(Real u, Real& w, Real& dw) const;
 };
 
+using LinearKernel = BasicLinearKernel<real>;
 
-class QuarticKernel : public Kernel {
-    public: 
-        QuarticKernel(double smoothingRadius) : Kernel(smoothingRadius) {};
 
-        double W(double u) const;
-        double ddr(double u) const;
-        double V() const;
+template <typename Real>
+class BasicQuarticKernel : public BasicKernel<Real> {
+    public:
+        BasicQuarticKernel(Real smoothingRadius) : BasicKernel<Real>(smoothingRadius) {};
+
+        Real W(Real u) const;
+        Real ddr(Real u) const;
+        Real V() const;
+        void shape(Real u, Real& w, Real& dw) const;
 };
 
+using QuarticKernel = BasicQuarticKernel<real>;
+
 
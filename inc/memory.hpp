@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <new>
+
+
+template <typename T>
+class NumaAllocator;
+
+template <typename T>
+using NumaVector = std::vector<T, NumaAllocator<T>>;
+
+
+/**
+ * @brief Allocation of the large arrays (particles, tree, structure-of-arrays copies) so that they live close to the
+ * threads that use them. On a machine with several NUMA nodes, a page is placed on the node of the thread that first
+ * writes it: memory filled by a single thread ends up on a single node, and the threads of the other nodes read it
+ * remotely, at a fraction of the bandwidth.
+ *
+ * allocate() only aligns (containers then construct their elements as usual, on the calling thread). Placement is
+ * explicit: Memory::array builds an array whose pages are first written part by part by the workers of the loop that
+ * will use it, given the partition of that loop (Parallel::chunkBounds for static loops, or the bounds of
+ * Parallel::partition for cost balanced tasks). This only places pages well if a worker always runs on the same core,
+ * see Parallel::setPinning(). Huge pages (2 MB, transparent huge pages on Linux) reduce TLB misses on the large arrays
+ * but make the placement coarser.
+ * ```cpp
+ * Parallel::setPinning(true);
+ * Memory::setHugePages(true);
+ * NumaVector<double> x = Memory::array<double>(Parallel::chunkBounds(n)); // zeroed, pages placed as forRange(n) runs
+ * ```
+ */
+class Memory {
+    private:
+        static inline bool huge_pages = false;
+
+    public:
+        static constexpr size_t alignment = 64; // a cache line
+        static constexpr size_t huge_page_size = size_t(2) << 20;
+
+        /**
+         * @brief Below this many bytes, placing pages is not worth a parallel loop: array() leaves them to the
+         * calling thread.
+         */
+        static inline size_t first_touch_bytes = huge_page_size;
+
+        /**
+         * @brief Whether arrays of at least one huge page are aligned on, and advised to use, huge pages.
+         */
+        static bool getHugePages() {return huge_pages;}
+        static void setHugePages(bool enabled) {huge_pages = enabled;}
+
+        /**
+         * @brief Uninitialized block of n elements of the given size, aligned on a cache line (or on a huge page).
+         * Throws std::bad_alloc on failure.
+         */
+        static void* allocate(size_t n, size_t element_size);
+        static void deallocate(void* p);
+
+        /**
+         * @brief Writes zeros over the elements of p, part by part: part t, the elements [bounds[t], bounds[t + 1]), is
+         * written by worker c if t is in chunk c of Parallel::chunkBounds(bounds.size() - 1, 1), always the same one
+         * (worker t with the bounds of Parallel::chunkBounds, and the worker Parallel::forTasks deals task t to first).
+         * No work stealing: a part is never written by another worker. Does nothing for blocks smaller than
+         * first_touch_bytes.
+         */
+        static void firstTouch(void* p, size_t element_size, const std::vector<int>& bounds);
+
+        /**
+         * @brief Array of bounds.back() value-initialized elements, its pages first touched by the parts of bounds
+         * (see firstTouch).
+         */
+        template <typename T>
+        static NumaVector<T> array(const std::vector<int>& bounds);
+};
+
+
+/**
+ * @brief Standard allocator over Memory::allocate, for containers of large arrays.
+ */
+template <typename T>
+class NumaAllocator {
+    public:
+        using value_type = T;
+
+        NumaAllocator() = default;
+        template <typename U>
+        NumaAllocator(const NumaAllocator<U>&) {};
+
+        T* allocate(size_t n) {return static_cast<T*>(Memory::allocate(n, sizeof(T)));}
+        void deallocate(T* p, size_t) {Memory::deallocate(p);}
+
+        template <typename U>
+        bool operator==(const NumaAllocator<U>&) const {return true;}
+        template <typename U>
+        bool operator!=(const NumaAllocator<U>&) const {return false;}
+};
+
+template <typename T>
+NumaVector<T> Memory::array(const std::vector<int>& bounds) {
+    NumaVector<T> v;
+    if (bounds.empty() || bounds.back() <= 0) return v;
+    v.reserve(bounds.back());
+    firstTouch(v.data(), sizeof(T), bounds);
+    v.resize(bounds.back()); // by the calling thread, on pages already placed
+    return v;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <array>
+#include <vector>
+
+
+/**
+ * @brief Cartesian Taylor expansions of the 1/r potential, up to a given order. Coefficients are indexed by
+ * multi-indices n = (nx, ny, nz) with |n| = nx + ny + nz <= order, stored as flat arrays of size count().
+ *
+ * With a_n(R) = D^n(1/|R|) / n! the Taylor coefficients of 1/r, sources y_j of mass m_j around a center c and a
+ * target x near a center z:
+ * - multipole moments:  M_k = sum_j m_j (c - y_j)^k                     => phi(x) = sum_k a_k(x - c) M_k
+ * - local coefficients: L_l = sum_k C(k+l, k) a_{k+l}(z - c) M_k        => phi(x) = sum_l L_l (x - z)^l
+ * where phi(x) ~ sum_j m_j / |x - y_j|, so that the acceleration is G grad(phi).
+ *
+ * ```cpp
+ * Expansion exp(4);
+ * std::vector<double> M(exp.count(), 0.0);
+ * exp.addParticle(M.data(), center, position, mass);
+ * Eigen::Vector3d a = exp.multipoleAcceleration(M.data(), x - center);
+ * ```
+ */
+class Expansion {
+    private:
+        int order;
+        std::vector<std::array<int, 3>> exponents; // exponents[i] = (nx, ny, nz) of coefficient i, sorted by |n|
+        std::vector<int> lookup; // (order+2)^3 table (nx, ny, nz) -> flat index, -1 if |n| > order + 1
+        std::vector<double> binomials; // Pascal triangle up to 2 * order + 2
+
+        // precomputed neighbours of each multi-index n, -1 when out of range
+        std::vector<int> lower; // lower[3 * i + d] = index of n - e_d
+        std::vector<int> lower2; // lower2[3 * i + d] = index of n - 2 e_d
+        std::vector<int> upper; // upper[3 * i + d] = index of n + e_d (only for |n| <= order)
+        std::vector<int> first_axis; // first axis d with n_d > 0 (used to build monomials)
+
+        // precomputed operator terms: result[dst] += coefficient * <table>[a] * <input>[b]
+        struct Term {int dst; int a; int b; double coefficient;};
+        std::vector<Term> m2m_terms; // M_k(parent) += C(k, j) d^(k-j) M_j(child)
+        std::vector<Term> m2l_terms; // L_l += C(k+l, k) a_(k+l) M_k
+        std::vector<Term> l2l_terms; // L_j(child) += C(l, j) s^(l-j) L_l(parent)
+
+    public:
+        Expansion(int order);
+
+        int getOrder() const {return order;}
+
+        /**
+         * @brief Number of coefficients of order <= getOrder().
+         */
+        int count() const {return count(order);}
+        static int count(int order) {return (order + 1) * (order + 2) * (order + 3) / 6;}
+
+        int index(int nx, int ny, int nz) const;
+        const std::array<int, 3>& exponent(int i) const {return exponents[i];}
+
+        // ------------------------- //
+        // !-- Building Blocks --! //
+        // ------------------------- //
+
+        /**
+         * @brief All monomials d^n for |n| <= max_order, in the flat ordering.
+         */
+        void powers(const Eigen::Vector3d& d, int max_order, double* out) const;
+
+        /**
+         * @brief Taylor coefficients a_n(R) of 1/|R| for |n| <= max_order (max_order <= getOrder() + 1).
+         */
+        void derivatives(const Eigen::Vector3d& R, int max_order, double* out) const;
+
+        // ------------------ //
+        // !-- Operators --! //
+        // ------------------ //
+
+        /**
+         * @brief P2M: adds a point mass at position to the multipole moments about center.
+         */
+        void addParticle(double* M, const Eigen::Vector3d& center, const Eigen::Vector3d& position, double mass) const;
+
+        /**
+         * @brief M2M: adds the moments of a child (about child_center) to the moments of the parent (about parent_center).
+         */
+        void translateMultipole(double* parent, const Eigen::Vector3d& parent_center, const double* child, const Eigen::Vector3d& child_center) const;
+
+        /**
+         * @brief M2L: adds the contribution of the source moments M to the local expansion L. R is target center - source center.
+         */
+        void multipoleToLocal(double* L, const double* M, const Eigen::Vector3d& R) const;
+
+        /**
+         * @brief L2L: adds the local expansion of the parent to the child. s is child center - parent center.
+         */
+        void translateLocal(double* child, const double* parent, const Eigen::Vector3d& s) const;
+
+        /**
+         * @brief L2P: gradient of the local expansion at d = x - local center (multiply by G to get the acceleration).
+         */
+        Eigen::Vector3d localAcceleration(const double* L, const Eigen::Vector3d& d) const;
+
+        /**
+         * @brief M2P: gradient of the multipole expansion at R = x - multipole center (multiply by G to get the acceleration).
+         * Only the terms of order >= min_order are summed (e.g. 2 to skip the monopole, and the dipole which vanishes
+         * about the center of mass).
+         */
+        Eigen::Vector3d multipoleAcceleration(const double* M, const Eigen::Vector3d& R, int min_order = 0) const;
+
+        /**
+         * @brief Closed form of the quadrupole (|k| = 2) terms of multipoleAcceleration(), much cheaper than the
+         * general recurrence. Requires getOrder() >= 2.
+         */
+        Eigen::Vector3d quadrupoleAcceleration(const double* M, const Eigen::Vector3d& R) const;
+
+    private:
+        double binomial(int n, int k) const {return binomials[n * (2 * order + 3) + k];}
+        double binomial(const std::array<int, 3>& n, const std::array<int, 3>& k) const {
+            return binomial(n[0], k[0]) * binomial(n[1], k[1]) * binomial(n[2], k[2]);
+        }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include "kernel.hpp"
+#include "neighborSearch.hpp"
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * @brief The neighbors of one particle inside a NeighborList: a read-only range of particle indices.
+ */
+struct NeighborRange {
+    const int* first;
+    int n;
+
+    const int* begin() const {return first;}
+    const int* end() const {return first + n;}
+    int size() const {return n;}
+    int operator[](int a) const {return first[a];}
+};
+
+
+/**
+ * @brief Neighbor lists cached across time steps (Verlet lists). The list of particle i holds every particle j
+ * (i itself included) closer than h_i + skin, h_i being the smoothing length of i (the kernel radius if it has none).
+ *
+ * As long as every particle moved by less than half the skin (minus the growth of its h) since the build, the lists
+ * still contain all the pairs closer than h_i, and update() keeps them; otherwise it rebuilds them from an Octree.
+ * Users then test the actual distance when they go through a list.
+ *
+ * The lists are built with the spatial index of setMethod(): by default a CellGrid for near uniform sets and an
+ * Octree otherwise (see NeighborSearch::choose()), the grid cells being as large as the mean search radius.
+ *
+ * Lists are stored in CSR layout: the neighbors of i are indices[offsets[i]] to indices[offsets[i + 1] - 1].
+ * ```cpp
+ * NeighborList list(0.1 * h);
+ * for (int step = 0; step < n_steps; step++) {
+ *     list.update(ps, kernel); // rebuilds only when needed
+ *     for (int j : list.neighbors(i)) {...}
+ * }
+ * Message("Neighbor lists: " + std::to_string(list.getMemory() / 1e6) + " MB");
+ * ```
+ */
+class NeighborList {
+    private:
+        double skin;
+        std::vector<int> offsets; // n + 1 entries
+        std::vector<int> indices;
+        std::vector<Eigen::Vector3d> reference; // positions at the last build
+        std::vector<double> reference_h; // search radius minus skin at the last build
+        int rebuilds = 0;
+        int reuses = 0;
+        NeighborMethod method = NeighborMethod::Auto;
+        NeighborMethod used = NeighborMethod::Auto; // by the last build
+
+        static double radius(const Particle& p, const Kernel& kernel) {
+            return p.smoothing_length > 0 ? p.smoothing_length : kernel.getSmoothingRadius();
+        }
+
+    public:
+        NeighborList(double skin) : skin(skin) {};
+
+        /**
+         * @brief Rebuilds the lists if needed. Returns true if they were rebuilt.
+         */
+        bool update(const ParticleSet& ps, const Kernel& kernel);
+
+        /**
+         * @brief Rebuilds the lists unconditionally.
+         */
+        void build(const ParticleSet& ps, const Kernel& kernel);
+
+        /**
+         * @brief Takes lists found elsewhere, e.g. during a gravity walk (TreeGravity::accelerations(ps, kernel, list)).
+         * The list of i (indices[offsets[i]] onwards, sorted) must hold every particle within searchRadius(i).
+         */
+        void assign(const ParticleSet& ps, const Kernel& kernel, std::vector<int> offsets, std::vector<int> indices);
+
+        /**
+         * @brief Radius within which the neighbors of p are listed: its smoothing length plus the skin.
+         */
+        double searchRadius(const Particle& p, const Kernel& kernel) const {return radius(p, kernel) + skin;}
+
+        /**
+         * @brief True if the lists may have missed a pair, or if the set changed size.
+         */
+        bool needsRebuild(const ParticleSet& ps, const Kernel& kernel) const;
+
+        NeighborRange neighbors(int i) const {return {indices.data() + offsets[i], offsets[i + 1] - offsets[i]};}
+        int size() const {return (int)offsets.size() - 1;}
+        const std::vector<int>& getOffsets() const {return offsets;}
+        const std::vector<int>& getIndices() const {return indices;}
+
+        /**
+         * @brief Spatial index used to build the lists (Auto: chosen at each build from the density contrast).
+         */
+        void setMethod(NeighborMethod method) {this->method = method;}
+        NeighborMethod getMethod() const {return method;}
+
+        /**
+         * @brief Index actually used by the last build (Tree or Grid), Auto if the lists were assigned.
+         */
+        NeighborMethod getUsedMethod() const {return used;}
+
+        double getSkin() const {return skin;}
+        int getRebuilds() const {return rebuilds;}
+        int getReuses() const {return reuses;}
+
+        /**
+         * @brief Memory held by the lists and the reference positions, in bytes.
+         */
+        size_t getMemory() const;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include "periodic.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <memory>
+#include <optional>
+
+
+
+// ---------------------------- //
+// !-- Neighbor Search Base --! //
+// ---------------------------- //
+
+/**
+ * @brief Available spatial indices for neighbor queries, see NeighborSearch::create().
+ */
+enum class NeighborMethod {
+    Auto, // chosen from the density contrast of the set
+    Tree, // Octree, adapts to any distribution
+    Grid // CellGrid, for near uniform distributions
+};
+
+
+/**
+ * @brief Common interface of the spatial indices answering "which particles are within radius of x?".
+ * ```cpp
+ * std::unique_ptr<NeighborSearch> index = NeighborSearch::create(ps, h); // tree or grid, whichever fits ps
+ * std::vector<int> found;
+ * index->neighbors(x, h, found);
+ * ```
+ */
+class NeighborSearch {
+    public:
+        virtual ~NeighborSearch() {};
+
+        /**
+         * @brief Indices (in the set) of the particles within radius of x, across periodic boundaries if needed.
+         * out is cleared first. In a periodic box, radius must be smaller than half of the side.
+         */
+        virtual void neighbors(const Eigen::Vector3d& x, double radius, std::vector<int>& out) const = 0;
+
+        /**
+         * @brief Builds the index of the given method over ps, for queries of radius about h.
+         */
+        static std::unique_ptr<NeighborSearch> create(const ParticleSet& ps, double h, NeighborMethod method = NeighborMethod::Auto);
+
+        /**
+         * @brief Grid if the set is uniform enough at scale h (densityContrast() below max_contrast), Tree otherwise.
+         */
+        static NeighborMethod choose(const ParticleSet& ps, double h);
+
+        /**
+         * @brief Mean number of particles in the cell of a particle, over the mean number per cell of the bounding box,
+         * cells being of side h. About 1 for a uniform set (1 + 1 / mean for Poisson noise), large for clumps or voids.
+         * Infinite if a grid of that scale would not fit in memory (more than max_cells_per_particle cells per particle).
+         */
+        static double densityContrast(const ParticleSet& ps, double h);
+
+        static inline double max_contrast = 3.0;
+        static inline int max_cells_per_particle = 8;
+};
+
+
+
+// ----------------- //
+// !-- Cell Grid --! //
+// ----------------- //
+
+/**
+ * @brief Cell linked list: a uniform grid of cubic cells of side (at least) cell_size over the bounding box of the set,
+ * or over its periodic box. Particles are counting sorted by cell in O(N), and their positions copied in that order,
+ * so a query reads a few contiguous runs of memory (one per row of cells).
+ *
+ * Best for near uniform sets with a single smoothing length, queried with radius about cell_size: a query then
+ * reads 27 cells. Clumpy sets are better served by an Octree (see NeighborSearch::choose()).
+ * ```cpp
+ * CellGrid grid(ps, kernel.getSmoothingRadius());
+ * grid.neighbors(x, kernel.getSmoothingRadius(), found);
+ * ```
+ */
+class CellGrid : public NeighborSearch {
+    private:
+        Eigen::Vector3d origin;
+        double cell_size;
+        int dims[3];
+        std::vector<int> starts; // particles of cell c: [starts[c], starts[c + 1]) in sorted order
+        std::vector<int> index; // index[k] = position in the ParticleSet of the k-th sorted particle
+        std::vector<Eigen::Vector3d> positions; // sorted
+        std::optional<PeriodicBox> box;
+
+    public:
+        CellGrid(const ParticleSet& ps, double cell_size);
+
+        void neighbors(const Eigen::Vector3d& x, double radius, std::vector<int>& out) const override;
+
+        int size() const {return index.size();}
+        int cells() const {return dims[0] * dims[1] * dims[2];}
+        double getCellSize() const {return cell_size;}
+
+    private:
+        int cell(int ix, int iy, int iz) const {return (ix * dims[1] + iy) * dims[2] + iz;}
+        int coordinate(double x, int dim) const;
+};
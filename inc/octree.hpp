@@ -0,0 +1,131 @@
+#pragma once
+
+#include "precision.hpp"
+#include "particleSet.hpp"
+#include "multipole.hpp"
+#include "periodic.hpp"
+#include "neighborSearch.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+
+/**
+ * @brief A node of the Octree: a cubic cell and the contiguous range [first, first + count) of particles
+ * (in tree order) it contains.
+ */
+struct OctreeNode {
+    Eigen::Vector3d center = Eigen::Vector3d::Zero(); // geometric center of the cell
+    double half_size = 0; // half of the side of the cell
+    int first = 0; // first particle of the node, in tree order
+    int count = 0; // number of particles inside the node
+    int children[8] = {0}; // indices of the non-empty children in Octree::nodes
+    int n_children = 0;
+    int next = 0; // index of the first node after the subtree of this node (nodes are stored in pre-order)
+    int level = 0; // depth of the node, the root being level 0
+
+    // monopole
+    double mass = 0;
+    Eigen::Vector3d com = Eigen::Vector3d::Zero(); // center of mass
+    double radius = 0; // upper bound of the distance between the center of mass and the particles of the node
+    double B[6] = {0}; // B[n] = sum of m |x - com|^n over the particles (upper bound for internal nodes), for error bounds
+
+    bool isLeaf() const {return n_children == 0;}
+};
+
+
+/**
+ * @brief Octree over a particle set. Particles are sorted along a Morton (Z-order) space filling curve, so that
+ * every node covers a contiguous range of particles, and a copy of positions and masses is kept in that order.
+ * The tree does not keep any reference on the set: rebuild it once the particles have moved.
+ *
+ * If the set is periodic, the root is the periodic box itself and positions are stored wrapped into it. Distances
+ * (neighbor search, gravity) are then taken between nearest images, inside the tree: the set is never duplicated.
+ *
+ * ```cpp
+ * Octree tree(ps, 8);
+ * const OctreeNode& root = tree.nodes[0];
+ * for (int k = root.first; k < root.first + root.count; k++) {
+ *     Particle& p = ps.get(tree.index[k]);
+ * }
+ * ```
+ */
+class Octree : public NeighborSearch {
+    public:
+        static inline const int max_level = 21; // 3 * 21 = 63 bits of Morton key
+
+        // particle arrays are first touched by the threads that fill them, in static chunks (see Memory and the constructor)
+        NumaVector<OctreeNode> nodes; // nodes[0] is the root, every subtree is contiguous (pre-order)
+        NumaVector<int> index; // index[k] = position in the ParticleSet of the k-th particle in tree order
+        NumaVector<Eigen::Vector3d> positions; // positions in tree order
+        NumaVector<real> masses; // masses in tree order, in the precision of the build (node sums stay in double)
+        NumaVector<uint64_t> keys; // Morton keys in tree order
+        NumaVector<double> multipoles; // moments of node i about its center of mass, at [i * n_coef, (i+1) * n_coef)
+
+        Octree(const ParticleSet& ps, int leaf_size = 8);
+
+        int size() const {return index.size();}
+        int getLeafSize() const {return leaf_size;}
+        const OctreeNode& root() const {return nodes[0];}
+
+        bool isPeriodic() const {return box.has_value();}
+        const std::optional<PeriodicBox>& getPeriodicBox() const {return box;}
+
+        /**
+         * @brief Separation a - b, between nearest images if the tree is periodic.
+         */
+        Eigen::Vector3d separation(const Eigen::Vector3d& a, const Eigen::Vector3d& b) const {
+            return box ? box->minimumImage(a - b) : Eigen::Vector3d(a - b);
+        }
+
+        /**
+         * @brief Indices (in the set) of the particles within radius of x, found across periodic boundaries if needed.
+         * out is cleared first. In a periodic box, radius must be smaller than half of the side.
+         */
+        void neighbors(const Eigen::Vector3d& x, double radius, std::vector<int>& out) const override;
+
+        /**
+         * @brief Computes the multipole moments of every node (P2M on leaves, M2M upwards), about their center of mass.
+         * Nothing is done if moments of that order are already there.
+         */
+        void computeMultipoles(const Expansion& expansion);
+
+        /**
+         * @brief Order of the stored multipole moments, -1 if computeMultipoles() has not been called.
+         */
+        int getMultipoleOrder() const {return multipole_order;}
+        const double* multipole(int node) const {return &multipoles[node * Expansion::count(multipole_order)];}
+        double* multipole(int node) {return &multipoles[node * Expansion::count(multipole_order)];}
+
+        /**
+         * @brief Cuts the tree into at least `target` disjoint subtrees (unless there are not enough nodes) that together
+         * cover all particles, by repeatedly opening the most populated one. Subtrees can then be processed in parallel.
+         */
+        std::vector<int> subtrees(int target) const;
+
+        /**
+         * @brief Scatter values computed in tree order back into the order of the ParticleSet.
+         */
+        template <typename T>
+        std::vector<T> toSetOrder(const std::vector<T>& tree_order) const {
+            std::vector<T> set_order(tree_order.size());
+            for (int k = 0; k < size(); k++) {
+                set_order[index[k]] = tree_order[k];
+            }
+            return set_order;
+        }
+
+        /**
+         * @brief Morton key of x, the cube [origin, origin + side]^3 being divided into 2^21 cells per axis.
+         */
+        static uint64_t mortonKey(const Eigen::Vector3d& x, const Eigen::Vector3d& origin, double side);
+
+    private:
+        int leaf_size;
+        int multipole_order = -1;
+        std::optional<PeriodicBox> box;
+
+        int build(int first, int count, const Eigen::Vector3d& center, double half_size, int level);
+        void computeMoments();
+};
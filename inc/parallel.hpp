@@ -0,0 +1,236 @@
+#pragma once
+
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <map>
+
+
+/**
+ * @brief Small shared-memory parallelism helpers, running on a pool of persistent worker threads (the calling thread
+ * being worker 0). Two kinds of loops:
+ * - static ones (forChunks, forRange, reduce): the range [0, n) is cut into contiguous chunks, one per worker, chunk c
+ *   always running on worker c. For cheap, uniform items, and for memory placement (see Memory).
+ * - work stealing ones (forDynamic, forTasks, forTree): every worker has a deque of work items, takes its own from
+ *   the back and, once it runs dry, steals the oldest (largest) item of another worker. For irregular items such as
+ *   tree walks, where a static split leaves most workers idle at the end of the loop.
+ *
+ * Parallel calls made from inside a parallel loop (or from another thread while the pool is busy) run serially.
+ *
+ * Usage:
+ * ```cpp
+ * Parallel::forRange(n, [&](int begin, int end) {
+ *     for (int i = begin; i < end; i++) doStuff(i);
+ * });
+ *
+ * double sum = Parallel::reduce<double>(n, 0.0,
+ *     [&](int begin, int end) {double s = 0; for (int i = begin; i < end; i++) s += x[i]; return s;},
+ *     [](double a, double b) {return a + b;}
+ * );
+ *
+ * std::vector<int> bounds = Parallel::partition(costs, 8 * Parallel::getThreads()); // equal cost per task
+ * Parallel::forTasks(bounds.size() - 1, [&](int task) {
+ *     for (int i = bounds[task]; i < bounds[task + 1]; i++) expensiveStuff(i);
+ * });
+ * ```
+ */
+class Parallel {
+    private:
+        static inline int n_threads = 0; // 0 means std::thread::hardware_concurrency()
+        static inline bool pinning = false;
+        static inline bool deterministic = false;
+
+    public:
+        /**
+         * @brief Below this many items per thread, spawning threads costs more than it saves.
+         */
+        static inline int min_chunk = 2048;
+
+        /**
+         * @brief Number of threads used by the helpers.
+         */
+        static int getThreads();
+
+        /**
+         * @brief Set the number of threads used by the helpers. 0 goes back to the hardware concurrency.
+         */
+        static void setThreads(int n);
+
+        /**
+         * @brief When enabled, worker c always runs on the c-th core the process may run on (its affinity mask when the
+         * pool started, modulo the number of such cores). The calling thread is bound to the first one only while it runs
+         * its share of a loop, and gets its own affinity back afterwards. Memory first touched by part c (see
+         * Memory::array) is then on the NUMA node of the thread that processes part c in every later loop with the same
+         * partition.
+         */
+        static bool getPinning() {return pinning;}
+        static void setPinning(bool enabled) {pinning = enabled;}
+
+        /**
+         * @brief Deterministic mode: results no longer depend on the number of threads, bit for bit. reduce then works on
+         * blocks of deterministic_block items whatever the number of threads, and folds them pairwise in a fixed tree
+         * order; solvers that scatter pair contributions (SphSolver) sum them per particle in a fixed pair order instead
+         * of per chunk. Costs a little (see benchDeterminism), hence off by default.
+         */
+        static bool getDeterministic() {return deterministic;}
+        static void setDeterministic(bool enabled) {deterministic = enabled;}
+
+        /**
+         * @brief Items per block of reduce in deterministic mode.
+         */
+        static inline int deterministic_block = 1024;
+
+        /**
+         * @brief Index of the calling worker, in [0, getThreads()): for per-worker buffers in work stealing loops.
+         * 0 outside of parallel loops.
+         */
+        static int worker();
+
+        /**
+         * @brief Runs the parallel loops of the calling thread serially while it lives, e.g. on a background thread that
+         * must leave the pool to the main computation (see InSitu).
+         */
+        class Serial {
+            private:
+                bool previous;
+
+            public:
+                Serial();
+                ~Serial();
+                Serial(const Serial&) = delete;
+                Serial& operator=(const Serial&) = delete;
+        };
+
+        /**
+         * @brief Number of chunks [0, n) will be cut into (between 1 and getThreads()), with at least `grain` items per chunk.
+         * Expensive items (e.g. a whole direct summation per item) should use a small grain.
+         */
+        static int chunks(int n, int grain = min_chunk);
+
+        /**
+         * @brief Bounds of the chunks of forChunks(n, f, grain): chunk c is [bounds[c], bounds[c + 1]).
+         */
+        static std::vector<int> chunkBounds(int n, int grain = min_chunk);
+
+        /**
+         * @brief Calls f(chunk, begin, end) once per chunk, in parallel, chunk c on worker c. Returns once every chunk is done.
+         */
+        static void forChunks(int n, const std::function<void(int, int, int)>& f, int grain = min_chunk);
+
+        /**
+         * @brief Calls f(begin, end) on disjoint sub-ranges covering [0, n), in parallel.
+         */
+        static void forRange(int n, const std::function<void(int, int)>& f, int grain = min_chunk);
+
+        /**
+         * @brief Calls f(begin, end) on disjoint sub-ranges covering [0, n), by work stealing: every worker starts with its
+         * static chunk and splits it in halves down to `grain` items, leaving the upper halves to thieves.
+         */
+        static void forDynamic(int n, const std::function<void(int, int)>& f, int grain = 64);
+
+        /**
+         * @brief Calls f(task) for every task of [0, n_tasks), by work stealing. Tasks start dealt out in contiguous blocks
+         * (worker w runs its block in order), so neighbouring tasks mostly run on the same worker.
+         */
+        static void forTasks(int n_tasks, const std::function<void(int)>& f);
+
+        /**
+         * @brief Recursive work stealing, e.g. over the nodes of a tree: calls f(item, spawn) for every root, and for
+         * every item that f appended to spawn, until there is nothing left. A task that is too large to run in one go
+         * thus splits itself (into its children) and the pieces are stolen by idle workers.
+         */
+        static void forTree(const std::vector<int>& roots, const std::function<void(int, std::vector<int>&)>& f);
+
+        /**
+         * @brief Bounds of `parts` contiguous ranges of [0, costs.size()) of about equal total cost (e.g. interactions of
+         * each particle at the previous step): range p is [bounds[p], bounds[p + 1]). Ranges may be empty.
+         */
+        static std::vector<int> partition(const std::vector<double>& costs, int parts);
+
+        /**
+         * @brief Parallel reduction. map(begin, end) reduces a sub-range into a T, and the partial results
+         * are then folded together with combine(a, b) in chunk order. In deterministic mode, the sub-ranges are blocks of
+         * deterministic_block items and the partial results are combined pairwise ((b0 + b1) + (b2 + b3)) + ...
+         */
+        template <typename T, typename Map, typename Combine>
+        static T reduce(int n, T identity, Map map, Combine combine, int grain = min_chunk) {
+            if (deterministic) {
+                if (n <= 0) return identity;
+                const int block = std::max(1, deterministic_block);
+                std::vector<T> partial((n + block - 1) / block, identity);
+                forRange(partial.size(), [&](int begin, int end) {
+                    for (int b = begin; b < end; b++) {
+                        partial[b] = map(b * block, std::min(n, (b + 1) * block));
+                    }
+                }, std::max(1, grain / block));
+                for (size_t width = 1; width < partial.size(); width *= 2) {
+                    for (size_t b = 0; b + width < partial.size(); b += 2 * width) {
+                        partial[b] = combine(partial[b], partial[b + width]);
+                    }
+                }
+                return partial[0];
+            }
+            std::vector<T> partial(chunks(n, grain), identity);
+            forChunks(n, [&](int chunk, int begin, int end) {
+                partial[chunk] = map(begin, end);
+            }, grain);
+            T result = identity;
+            for (const T& p : partial) {
+                result = combine(result, p);
+            }
+            return result;
+        }
+
+
+        // ----------------- //
+        // !-- Profiling --! //
+        // ----------------- //
+
+        /**
+         * @brief What the parallel loops of a phase cost: wall time, and time the workers spent in the loop bodies.
+         */
+        struct PhaseStats {
+            double wall = 0; // seconds, summed over the loops of the phase
+            double busy = 0; // seconds, summed over the workers
+            double capacity = 0; // wall time times the number of workers, summed over the loops
+            long long loops = 0;
+            long long tasks = 0; // work items run (chunks, tasks, pieces of ranges, tree items)
+            long long steals = 0;
+
+            /**
+             * @brief Fraction of the worker time spent working, 1 for a perfect balance.
+             */
+            double efficiency() const {return capacity > 0 ? busy / capacity : 1.0;}
+        };
+
+        /**
+         * @brief Names the parallel loops run by the calling thread while it lives, which are accounted for under that
+         * name in getPhases(). Phases nest: the innermost one wins.
+         * ```cpp
+         * {
+         *     Parallel::Phase phase("gravity walk");
+         *     acc = gravity.accelerations(ps);
+         * }
+         * Parallel::report();
+         * ```
+         */
+        class Phase {
+            private:
+                std::string previous;
+
+            public:
+                explicit Phase(const std::string& name);
+                ~Phase();
+                Phase(const Phase&) = delete;
+                Phase& operator=(const Phase&) = delete;
+        };
+
+        static std::map<std::string, PhaseStats> getPhases();
+        static void resetPhases();
+
+        /**
+         * @brief Prints the statistics of every phase (wall time, efficiency, steals).
+         */
+        static void report();
+};
@@ -3,6 +3,8 @@
 #include <tintoretto.hpp>
 #include <Eigen/Dense>
 #include <initializer_list>
+#include <atomic>
+#include <cstdint>
 
 
 class Particle {
@@ -11,19 +13,32 @@ class Particle {
         Eigen::Vector3d velocity;
         double mass;
         double current_time = 0;
+        double smoothing_length = 0; // SPH smoothing length h, 0 until solved for (see SmoothingLengthSolver)
     
     private:
-        static inline int id_counter = 0;
-        int id;
+        static inline std::atomic<int64_t> id_counter{0}; // first id not yet handed out
+        static inline std::atomic<int64_t> id_generation{0}; // bumped by setIdCounter, invalidates the blocks of all threads
+        int64_t id;
+
+        /**
+         * @brief A fresh id, taken from the block of the calling thread; a new block of id_block ids is reserved from
+         * the shared counter when it runs out, so threads create particles without contending on the counter.
+         */
+        static int64_t nextId();
 
     public:
-        Particle(Eigen::Vector3d position = Eigen::Vector3d::Zero(), Eigen::Vector3d velocity = Eigen::Vector3d::Zero(), double mass = 1.0) : position(position), velocity(velocity), mass(mass), id(id_counter++) {};
+        Particle(Eigen::Vector3d position = Eigen::Vector3d::Zero(), Eigen::Vector3d velocity = Eigen::Vector3d::Zero(), double mass = 1.0) : position(position), velocity(velocity), mass(mass), id(nextId()) {};
         Particle(std::initializer_list<double> init);
+        /**
+         * @brief Rebuilds a particle that already has an id, e.g. received from another process.
+         */
+        Particle(Eigen::Vector3d position, Eigen::Vector3d velocity, double mass, int64_t id) : position(position), velocity(velocity), mass(mass), id(id) {};
         /**
          * Copy constructor! Copy the id of the particle
          * alongside all other attributes!!
          */
         Particle(const Particle& p);
+        Particle& operator=(const Particle& p) = default;
 
         /**
          * @brief Compares id of particles. Does not compare particle positions however!
@@ -34,6 +49,37 @@ class Particle {
          */
         bool operator==(const Particle& p) const {return id == p.id;}
 
+        int64_t getId() const {return id;}
+
+        /**
+         * @brief Ids are unique over all threads: each thread hands out its own block of consecutive ids.
+         */
+        static constexpr int64_t id_block = 1024;
+
+        /**
+         * @brief The first id not reserved by any thread. Saved and restored by checkpoints: setting it drops the
+         * blocks of all threads, so that particles created after a restart get the same ids as in the original run
+         * (Checkpoint::saveIdCounter sets it to itself for that reason). Not to be called while other threads create
+         * particles.
+         */
+        static int64_t getIdCounter() {return id_counter.load();}
+        static void setIdCounter(int64_t counter) {
+            id_counter.store(counter);
+            id_generation.fetch_add(1);
+        }
+
+        /**
+         * @brief Reserves n consecutive ids and returns the first, for code that builds many particles at once with
+         * explicit ids (e.g. in parallel):
+         * ```cpp
+         * int64_t first = Particle::reserveIds(n);
+         * Parallel::forRange(n, [&](int begin, int end) {
+         *     for (int i = begin; i < end; i++) particles[i] = Particle(x[i], v[i], m, first + i);
+         * });
+         * ```
+         */
+        static int64_t reserveIds(int64_t n) {return id_counter.fetch_add(n);}
+
         /**
          * @brief Prints the particle (position, velocity, etc.) into the terminal
          */
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "precision.hpp"
+#include "particleSet.hpp"
+#include "kernel.hpp"
+#include "neighborList.hpp"
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * @brief Compact structure-of-arrays copy of a ParticleSet for the SPH loops, templated on the floating point type
+ * of everything but positions: velocities, masses and smoothing lengths are stored as Real, positions as double
+ * (far from the origin, float positions would lose the small separations between neighbors).
+ *
+ * ParticleArrays is the configuration chosen at build time (see precision.hpp), the one SphSolver works on; both
+ * precisions always exist. In float, a particle takes 44 bytes instead of 64.
+ * ```cpp
+ * ParticleArrays arrays(ps);
+ * std::vector<real> rho = arrays.densities(QuarticKernel(1.0), list);
+ * arrays.store(ps); // back into the particles, after they were updated
+ * ```
+ */
+template <typename Real>
+class BasicParticleArrays {
+    public:
+        using Vector3 = Eigen::Matrix<Real, 3, 1>;
+
+        NumaVector<Eigen::Vector3d> positions; // first touched by the threads that fill them (see Memory)
+        NumaVector<Vector3> velocities;
+        NumaVector<Real> masses;
+        NumaVector<Real> smoothing_lengths;
+
+        BasicParticleArrays() {};
+        explicit BasicParticleArrays(const ParticleSet& ps) {load(ps);}
+
+        /**
+         * @brief Copies (and rounds) the particles of ps.
+         */
+        void load(const ParticleSet& ps);
+
+        /**
+         * @brief Writes the arrays back into the particles of ps, which must be the set they were loaded from.
+         */
+        void store(ParticleSet& ps) const;
+
+        int size() const {return positions.size();}
+
+        /**
+         * @brief SPH density of every particle, rho_i = sum_j m_j W(r_ij, h_i), over the neighbors given by list
+         * (a gather sum, built for the same set). Separations are computed in double, kernels and sums in Real.
+         */
+        std::vector<Real> densities(const BasicKernel<Real>& kernel, const NeighborList& list, const std::optional<PeriodicBox>& box = std::nullopt) const;
+
+        /**
+         * @brief Bytes held by the arrays.
+         */
+        size_t getMemory() const;
+};
+
+using ParticleArrays = BasicParticleArrays<real>;
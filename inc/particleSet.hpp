@@ -1,20 +1,90 @@
 #pragma once
 
 #include "particle.hpp"
+#include "particleView.hpp"
+#include "periodic.hpp"
+#include "memory.hpp"
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <cstdint>
 #include <tintoretto.hpp>
 #include <initializer_list>
 
 
+/**
+ * @brief Global quantities of a particle set. Everything but the diameter comes out of a single
+ * (parallel) sweep over the particles, see ParticleSet::getStatistics().
+ */
+struct ParticleSetStatistics {
+    double total_mass = 0;
+    Eigen::Vector3d center_of_mass = Eigen::Vector3d::Zero();
+    Eigen::Vector3d center_of_mass_velocity = Eigen::Vector3d::Zero();
+    Eigen::Vector3d momentum = Eigen::Vector3d::Zero(); // sum of m * v
+    double kinetic_energy = 0; // sum of 1/2 m v^2
+    Eigen::Vector3d bbox_min = Eigen::Vector3d::Zero(); // axis aligned bounding box
+    Eigen::Vector3d bbox_max = Eigen::Vector3d::Zero();
+};
+
+
+/**
+ * @brief Read-only 'picture' of a particle set, made of blocks of block_size particles. Blocks are shared between
+ * snapshots as long as the set does not modify them: a snapshot taken after a step that only moved some particles
+ * copies the blocks that hold them, and shares the others with the previous snapshot.
+ */
+class ParticleSnapshot {
+    public:
+        using Block = std::shared_ptr<const NumaVector<Particle>>;
+        static constexpr int block_size = 4096;
+
+    private:
+        std::vector<Block> blocks;
+        int n = 0;
+
+    public:
+        ParticleSnapshot() {};
+        ParticleSnapshot(std::vector<Block> blocks, int n) : blocks(std::move(blocks)), n(n) {};
+
+        const Particle& get(int i) const {return (*blocks[i / block_size])[i % block_size];}
+        int size() const {return n;}
+
+        /**
+         * @brief One view per block, in order.
+         */
+        std::vector<ConstParticleView> views() const;
+
+        /**
+         * @brief Number of blocks both snapshots share (the same block at the same place).
+         */
+        int sharedBlocks(const ParticleSnapshot& other) const;
+        int getBlocks() const {return blocks.size();}
+
+        /**
+         * @brief True if both snapshots share all their data.
+         */
+        bool sharesDataWith(const ParticleSnapshot& other) const {return n == other.n && sharedBlocks(other) == getBlocks();}
+};
+
+
 /**
  * Handles a set of particles. This class is just a wrapper around a vector of particles.
  * The idea is to always use the method get(int i) that returns in place particle.
  * 
  * On the other hand, every particle passed into a particleSet is copied.
+ *
+ * Global quantities (mass, center of mass, bounding box, energy...) and snapshots are cached and recomputed lazily.
+ * Every non-const access (get(), view(), add(), com()...) invalidates the cache, only the blocks it may modify for the
+ * snapshots. If you modify `particles` directly, call invalidate() yourself (with the range you modified, if you know it).
+ *
+ * Const methods may run concurrently (e.g. the tree and the neighbor list of a step built on two lanes, see TaskGraph):
+ * the first caller fills a cache under a lock, and the others wait for it to be complete. Non-const ones need the set
+ * to themselves.
  */
 class ParticleSet {
     public:
-        std::vector<Particle> particles;
+        NumaVector<Particle> particles; // aligned and placed, see Memory and reserve()
 
         ParticleSet();
         ParticleSet(std::initializer_list<Particle> init);
@@ -23,6 +93,19 @@ class ParticleSet {
          * Copy constructor (deep copy! each particle is copied!)
          */
         ParticleSet(const ParticleSet& p);
+        ParticleSet& operator=(const ParticleSet& p);
+
+        /**
+         * Move constructor: steals the particles, p is left empty.
+         */
+        ParticleSet(ParticleSet&& p);
+        ParticleSet& operator=(ParticleSet&& p);
+
+        /**
+         * @brief Copy the particles of a view (or a snapshot) into a new set.
+         */
+        explicit ParticleSet(ConstParticleView view);
+        explicit ParticleSet(const ParticleSnapshot& snapshot);
 
         /**
          * @brief Copy and add a particle to the set.
@@ -33,18 +116,47 @@ class ParticleSet {
          * @brief Add a particle set to the particle set.
          * 
          * Every particle inside is copied => no more inplace modification. 
-         * Very usefull to take a 'picture' of the curret set of particles.
+         * The storage is grown once for the whole set. ps may be this set.
+         */
+        void add(const ParticleSet& ps);
+
+        /**
+         * @brief Append the particles of a view (copies, storage grown once). The view may be on this set.
+         */
+        void add(ConstParticleView view);
+
+        /**
+         * @brief Move all particles of ps at the end of this set. ps is left empty.
+         */
+        void add(ParticleSet&& ps);
+
+        /**
+         * @brief Reserve storage for n particles in total. New storage has its pages first touched as the static loops
+         * over the full set run (Memory::firstTouch with Parallel::chunkBounds of its capacity), before the particles
+         * are moved in: the constructors and add() fill or grow the set through it.
+         */
+        void reserve(int n);
+
+        /**
+         * @brief Take a 'picture' of the current set of particles. Only the blocks modified since the previous
+         * snapshot (or accessed through get(i), view(start, end)...) are copied, the others are shared with it.
+         * Safe to call from several threads at once.
          */
-        void add(ParticleSet& ps);
+        ParticleSnapshot snapshot() const;
 
         /**
-         * @brief Get a particle in place. 
+         * @brief Get a particle in place. Invalidates the cached statistics since the particle may be modified.
          *
          * @param i index of the particle
          * @return Particle& reference to the particle
          */
         Particle& get(int i);
 
+        /**
+         * @brief Read-only access to a particle, leaves the cached statistics untouched.
+         */
+        const Particle& get(int i) const;
+
         /**
          * @brief Number of particles in the set
          */
@@ -53,7 +165,25 @@ class ParticleSet {
         /**
          * @brief Show some statistics of the particle set i nthe terminal
          */
-        void display();
+        void display() const;
+
+        /**
+         * @brief Mass, center of mass, momentum, kinetic energy and bounding box, computed in one parallel sweep
+         * and cached until the next modification of the set.
+         */
+        const ParticleSetStatistics& getStatistics() const;
+
+        /**
+         * @brief Twice the largest distance of a particle to the center of mass. Needs the center of mass first,
+         * hence its own sweep, but it is cached alongside the other statistics.
+         */
+        double getDiameter() const;
+
+        /**
+         * @brief Drop the cached statistics, and the snapshot blocks of the particles [start, end) (same conventions
+         * as slice(): all of them by default). Only needed after modifying `particles` directly.
+         */
+        void invalidate(int start = 0, int end = -1);
 
         /**
          * @brief Update every particle time by dt.
@@ -62,23 +192,39 @@ class ParticleSet {
 
         /**
          * @brief Split the set into all distinct time steps. Assumes particles are sorted in time though.
+         * Returns copies, see splitViews() for the zero-copy version.
+         */
+        std::vector<ParticleSet> split() const;
+
+        /**
+         * @brief Same as split() but returns views on the groups of particles sharing the same current time. No copy.
          */
-        std::vector<ParticleSet> split();
+        std::vector<ParticleView> splitViews();
+        std::vector<ConstParticleView> splitViews() const;
 
         /**
          * @brief Slice. If start greater than end (eg if end = -1), all particles are added. Returns copies.
          */
-        ParticleSet slice(int start, int end);
+        ParticleSet slice(int start, int end) const;
 
         /**
          * @brief Take the first n particles. Returns copies.
          */
-        ParticleSet slice(int n);
+        ParticleSet slice(int n) const;
+
+        /**
+         * @brief Zero-copy slice, same conventions as slice(start, end).
+         */
+        ParticleView view(int start = 0, int end = -1);
+        ConstParticleView view(int start = 0, int end = -1) const;
 
         /**
-         * @brief Take the first n particles but keep the mass of the system constant (by scaling all masses up). Returns copies.
+         * @brief Takes n particles evenly spread over the set (every size() / n-th one, so that sets made of several
+         * components one after the other keep their proportions) and keeps the mass of the system constant, by scaling
+         * all masses up. Smoothing lengths grow as the mean spacing, by (size() / n)^(1/3). Returns copies.
+         * For quick low resolution versions of a set, see Preview.
          */
-        ParticleSet slice_m(int n);
+        ParticleSet slice_m(int n) const;
 
         /**
          * @brief Changes velocities and positions to be in the center of mass frame, with center of mass on the origin.
@@ -86,14 +232,34 @@ class ParticleSet {
         void com();
 
         /**
-         * @brief Returns random particles in the unit cube.
+         * @brief Returns random particles in the unit cube [0, 1)^3, the same for the same seed
+         * (see InitialConditions for other profiles).
+         */
+        static ParticleSet random(int n, uint64_t seed = 0);
+
+        /**
+         * @brief Returns random particles inside the unit sphere, the same for the same seed.
+         */
+        static ParticleSet random_sphere(int n, uint64_t seed = 0);
+
+        /**
+         * @brief Makes the set periodic. Particles are not moved (see wrap()), but the octree and the solvers built
+         * on the set then work with nearest images.
          */
-        static ParticleSet random(int n);
+        void setPeriodicBox(const PeriodicBox& box);
 
         /**
-         * @brief Returns random particles inside the unit sphere.
+         * @brief Back to open space.
          */
-        static ParticleSet random_sphere(int n);
+        void clearPeriodicBox();
+
+        const std::optional<PeriodicBox>& getPeriodicBox() const {return box;}
+        bool isPeriodic() const {return box.has_value();}
+
+        /**
+         * @brief Moves every particle back inside the periodic box (no-op in open space).
+         */
+        void wrap();
 
         /**
          * @brief Exports to a csv file, with header, no index (but the running id from the particle though).
@@ -107,8 +273,18 @@ class ParticleSet {
     
 
     private:
-        double getTotalMass();
-        double getDiameter();
-        Eigen::Vector3d getCenterOfMass();
-        Eigen::Vector3d getCenterOfMassVelocity();
+        std::optional<PeriodicBox> box; // open space if empty
+
+        mutable ParticleSetStatistics statistics;
+        mutable std::atomic<bool> statistics_valid{false}; // set once statistics is complete
+        mutable double diameter = 0;
+        mutable std::atomic<bool> diameter_valid{false};
+        mutable std::vector<ParticleSnapshot::Block> snapshot_blocks; // shared by snapshots until their particles are modified
+        mutable std::mutex cache_mutex; // const methods filling the caches may run concurrently
+
+        void dropSnapshotBlocks(int start, int end);
+
+        double getTotalMass() const {return getStatistics().total_mass;}
+        Eigen::Vector3d getCenterOfMass() const {return getStatistics().center_of_mass;}
+        Eigen::Vector3d getCenterOfMassVelocity() const {return getStatistics().center_of_mass_velocity;}
 };
\ No newline at end of file
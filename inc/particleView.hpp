@@ -0,0 +1,48 @@
+#pragma once
+
+#include "particle.hpp"
+
+
+/**
+ * @brief Lightweight, non-owning view over a contiguous range of particles (a pointer and a size, like std::span).
+ * Nothing is copied. The view stays valid as long as the underlying set is not resized.
+ *
+ * Use ParticleView to modify particles in place, ConstParticleView to only read them.
+ * ```cpp
+ * for (Particle& p : set.view(0, 100)) p.velocity *= 2;
+ * ```
+ */
+template <typename P>
+class BasicParticleView {
+    private:
+        P* first = nullptr;
+        int n = 0;
+
+    public:
+        BasicParticleView() {};
+        BasicParticleView(P* first, int n) : first(first), n(n) {};
+
+        // a mutable view can always be read as a const one
+        operator BasicParticleView<const P>() const {return BasicParticleView<const P>(first, n);}
+
+        P& get(int i) const {return first[i];}
+        P& operator[](int i) const {return first[i];}
+        int size() const {return n;}
+        bool empty() const {return n == 0;}
+
+        P* begin() const {return first;}
+        P* end() const {return first + n;}
+
+        /**
+         * @brief Sub-view [start, end) relative to this view. Same conventions as ParticleSet::slice().
+         */
+        BasicParticleView slice(int start, int end) const {
+            if (start < 0) start = 0;
+            if (end < start || end > n) end = n;
+            if (start > end) start = end;
+            return BasicParticleView(first + start, end - start);
+        }
+};
+
+using ParticleView = BasicParticleView<Particle>;
+using ConstParticleView = BasicParticleView<const Particle>;
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <vector>
+
+
+/**
+ * @brief Cubic periodic box [origin, origin + side)^3. Particles leaving on one side come back on the other,
+ * and distances are taken between nearest images.
+ *
+ * ```cpp
+ * PeriodicBox box(1.0);
+ * Eigen::Vector3d d = box.minimumImage(x - y); // every component in [-side/2, side/2)
+ * ```
+ */
+class PeriodicBox {
+    public:
+        double side;
+        Eigen::Vector3d origin;
+
+        PeriodicBox(double side = 1.0, Eigen::Vector3d origin = Eigen::Vector3d::Zero()) : side(side), origin(origin) {};
+
+        /**
+         * @brief The image of x inside the box.
+         */
+        Eigen::Vector3d wrap(const Eigen::Vector3d& x) const {
+            Eigen::Vector3d u = x - origin;
+            for (int dim = 0; dim < 3; dim++) {
+                u[dim] -= side * std::floor(u[dim] / side);
+                if (u[dim] >= side) u[dim] = 0; // rounding of tiny negative numbers
+            }
+            return origin + u;
+        }
+
+        /**
+         * @brief The shortest of all the images of a separation vector.
+         */
+        Eigen::Vector3d minimumImage(const Eigen::Vector3d& d) const {
+            Eigen::Vector3d m = d;
+            for (int dim = 0; dim < 3; dim++) {
+                m[dim] -= side * std::round(m[dim] / side);
+            }
+            return m;
+        }
+
+        Eigen::Vector3d center() const {return origin + Eigen::Vector3d::Constant(side / 2);}
+};
+
+
+/**
+ * @brief Ewald correction for gravity in a periodic box. For a unit mass at the origin, the acceleration at x summed over
+ * all periodic images (with the mean density subtracted) is the Newtonian one of the nearest image plus correction(x).
+ *
+ * The correction is smooth, so it is tabulated once on a grid over [0, side/2]^3 (the other octants follow by symmetry)
+ * and trilinearly interpolated. The table is computed for a unit box and scaled by 1 / side^2.
+ * ```cpp
+ * const EwaldTable& ewald = EwaldTable::get();
+ * Eigen::Vector3d d = box.minimumImage(x - y); // target - source
+ * acc += G * m * (-d / std::pow(d.norm(), 3) + ewald.correction(d, box.side));
+ * ```
+ */
+class EwaldTable {
+    private:
+        int n; // grid points per axis = n + 1 over [0, 1/2]
+        std::vector<Eigen::Vector3d> table;
+
+    public:
+        static inline const int default_resolution = 32;
+
+        EwaldTable(int resolution = default_resolution);
+
+        /**
+         * @brief The table at the default resolution, computed on first use and shared afterwards.
+         */
+        static const EwaldTable& get();
+
+        /**
+         * @brief Correction to the acceleration of a target at separation d = target - source (nearest image) from a unit
+         * mass, with G = 1, in a box of the given side.
+         */
+        Eigen::Vector3d correction(const Eigen::Vector3d& d, double side) const;
+
+        /**
+         * @brief Full periodic acceleration at x (unit box) from a unit mass at the origin, by Ewald summation.
+         */
+        static Eigen::Vector3d ewaldAcceleration(const Eigen::Vector3d& x);
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+
+/**
+ * @brief Floating point type of the particle data the solvers read and of the kernel values: the SPH engine works on
+ * a ParticleArrays copy of the set (velocities, masses and smoothing lengths in real) with Kernel = BasicKernel<real>,
+ * and the tree keeps its masses in real. double by default; configure with -DSINGLE_PRECISION=ON (defines
+ * COMPASTRO_SINGLE_PRECISION) for float, which halves their memory traffic.
+ *
+ * Positions stay in double in both builds (separations are taken in double and only then rounded), and so do the
+ * particles themselves, the sums over nodes of the tree and the DirectGravity reference. app/benchPrecision.cpp
+ * compares the two builds on the same run.
+ */
+#ifdef COMPASTRO_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
+using Vector3r = Eigen::Matrix<real, 3, 1>;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "particleSet.hpp"
+#include <functional>
+#include <vector>
+#include <string>
+#include <map>
+
+
+/**
+ * @brief One downsampled run of a preview: the set had size / factor particles, and its phases (see Parallel::Phase)
+ * took the given times.
+ */
+struct PreviewRun {
+    int factor;
+    int n;
+    double seconds;
+    std::map<std::string, double> phases; // seconds per phase
+};
+
+
+/**
+ * @brief What the full run should cost, extrapolated from the downsampled ones with a power law t = a N^b fitted
+ * through them (b is about 1 for tree codes, 2 for direct summation).
+ */
+struct PreviewReport {
+    std::vector<PreviewRun> runs; // coarsest first
+    int n; // particles of the full run
+    double exponent = 1; // b
+    double seconds = 0; // projected for the full run
+    std::map<std::string, double> phases; // projected seconds per phase, each with its own exponent
+
+    /**
+     * @brief Whether the projected full run fits in a budget of that many seconds.
+     */
+    bool fits(double budget) const {return seconds <= budget;}
+
+    /**
+     * @brief Prints the measured runs and the projection.
+     */
+    void print() const;
+};
+
+
+/**
+ * @brief Preview mode: before launching a large run, the same run on massively downsampled versions of its initial set
+ * (1/64 and 1/8 of the particles by default, see ParticleSet::slice_m: same total mass, smoothing lengths scaled with
+ * the spacing), to catch bad setups in seconds and to project the cost of the full run from the measured scaling.
+ *
+ * The run is any callable taking the downsampled set and the downsampling factor (e.g. to scale a softening length by
+ * factor^(1/3)); it should run a few steps, the same number whatever the factor. Short runs are repeated until they
+ * last min_seconds, each time on a fresh copy of the downsampled set.
+ * ```cpp
+ * Preview preview([&](ParticleSet& ps, int factor) {
+ *     TreeGravity gravity(0.01 * std::cbrt(factor), 0.7);
+ *     for (int step = 0; step < 10; step++) advance(ps, gravity.accelerations(ps));
+ * });
+ * PreviewReport report = preview.run(initial);
+ * report.print();
+ * if (!report.fits(3600 * 24)) throw std::runtime_error("too expensive");
+ * ```
+ */
+class Preview {
+    private:
+        std::function<void(ParticleSet&, int)> f;
+        std::vector<int> factors;
+        double min_seconds;
+
+    public:
+        Preview(std::function<void(ParticleSet&, int)> f, std::vector<int> factors = {64, 8}, double min_seconds = 0.05);
+
+        /**
+         * @brief Runs every downsampled version of full, coarsest first, and projects the cost of running full itself.
+         */
+        PreviewReport run(const ParticleSet& full) const;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+
+/**
+ * @brief Philox4x32-10 counter-based random number generator (Salmon et al. 2011). The output is a pure function of
+ * a 128 bit counter and a 64 bit key (the seed): there is no state to share or advance, so any thread can draw the
+ * numbers of any particle directly, and results do not depend on how the work was split.
+ * ```cpp
+ * Philox rng(42);
+ * std::array<uint32_t, 4> bits = rng({0, 0, 0, 0});
+ * ```
+ */
+class Philox {
+    private:
+        uint32_t key[2];
+
+        static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+            uint64_t product = (uint64_t)a * b;
+            hi = product >> 32;
+            lo = (uint32_t)product;
+        }
+
+    public:
+        explicit Philox(uint64_t seed = 0) : key{(uint32_t)seed, (uint32_t)(seed >> 32)} {};
+
+        std::array<uint32_t, 4> operator()(std::array<uint32_t, 4> counter) const {
+            uint32_t k0 = key[0], k1 = key[1];
+            for (int round = 0; round < 10; round++) {
+                uint32_t hi0, lo0, hi1, lo1;
+                mulhilo(0xD2511F53, counter[0], hi0, lo0);
+                mulhilo(0xCD9E8D57, counter[2], hi1, lo1);
+                counter = {hi1 ^ counter[1] ^ k0, lo1, hi0 ^ counter[3] ^ k1, lo0};
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+            return counter;
+        }
+
+        /**
+         * @brief Uniform double in [0, 1) from two 32 bit words (53 random bits).
+         */
+        static double toUniform(uint32_t a, uint32_t b) {
+            return ((a >> 5) * 67108864.0 + (b >> 6)) * (1.0 / 9007199254740992.0);
+        }
+};
+
+
+/**
+ * @brief The random numbers of one item (e.g. one particle), as a sequence: the n-th number of item i of stream s
+ * is always the same, whoever draws it. Different streams give independent sequences for the same items.
+ * ```cpp
+ * Parallel::forRange(n, [&](int begin, int end) {
+ *     for (int i = begin; i < end; i++) {
+ *         RandomStream random(rng, i);
+ *         x[i] = random.uniform();
+ *         y[i] = random.normal();
+ *     }
+ * });
+ * ```
+ */
+class RandomStream {
+    private:
+        const Philox& rng;
+        uint64_t item;
+        uint32_t stream;
+        uint32_t block = 0; // next counter
+        double cached[2];
+        int available = 0;
+
+    public:
+        RandomStream(const Philox& rng, uint64_t item, uint32_t stream = 0) : rng(rng), item(item), stream(stream) {};
+
+        /**
+         * @brief Uniform in [0, 1).
+         */
+        double uniform() {
+            if (available == 0) {
+                std::array<uint32_t, 4> bits = rng({block++, stream, (uint32_t)item, (uint32_t)(item >> 32)});
+                cached[0] = Philox::toUniform(bits[0], bits[1]);
+                cached[1] = Philox::toUniform(bits[2], bits[3]);
+                available = 2;
+            }
+            return cached[2 - available--];
+        }
+
+        double uniform(double a, double b) {return a + (b - a) * uniform();}
+
+        /**
+         * @brief Standard normal (Box-Muller, one value per pair of uniforms).
+         */
+        double normal() {
+            double u = 1.0 - uniform(); // in (0, 1]
+            double v = uniform();
+            return std::sqrt(-2.0 * std::log(u)) * std::cos(2 * M_PI * v);
+        }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "kernel.hpp"
+#include "particleSet.hpp"
+#include "octree.hpp"
+#include <vector>
+
+
+/**
+ * @brief Solves for the smoothing length of every particle, so that its kernel always contains about the same
+ * mass: 4/3 pi h^3 rho(h) = n_neighbors * m, with rho(h) = sum_j m_j W(r_ij, h) the SPH density. For equal
+ * masses, that is n_neighbors neighbors per particle whatever the local density.
+ *
+ * Each particle runs a safeguarded Newton-Raphson iteration on h (bisection whenever a step leaves the bracket).
+ * The candidate neighbors are fetched once from the Octree within a margin around h, and only fetched again if h
+ * grows beyond it, so iterations cost a sum over a short list rather than a tree search.
+ *
+ * The current smoothing_length of each particle is the initial guess; particles without one (0) start from the
+ * density of their leaf of the tree.
+ * ```cpp
+ * QuarticKernel kernel(1.0); // only the shape matters, h comes from the particles
+ * SmoothingLengthSolver solver(kernel, 50);
+ * solver.solve(ps); // sets ps.get(i).smoothing_length
+ * double rho = solver.getDensities()[i];
+ * ```
+ */
+class SmoothingLengthSolver {
+    private:
+        const Kernel& kernel;
+        double n_neighbors;
+        double tolerance; // on the relative error of the enclosed mass
+        int max_iterations;
+
+        std::vector<double> densities; // of the last solve, in set order
+        long long iterations = 0;
+        long long queries = 0;
+        int failures = 0;
+
+    public:
+        static inline const double margin = 1.25; // neighbors are fetched within margin * h
+
+        SmoothingLengthSolver(const Kernel& kernel, double n_neighbors = 50, double tolerance = 1e-3, int max_iterations = 50);
+
+        /**
+         * @brief Builds the tree of the set and solves for every smoothing length.
+         */
+        void solve(ParticleSet& ps);
+
+        /**
+         * @brief Same, reusing an Octree already built on ps.
+         */
+        void solve(ParticleSet& ps, const Octree& tree);
+
+        /**
+         * @brief SPH density of each particle with its final smoothing length, in the order of the set.
+         */
+        const std::vector<double>& getDensities() const {return densities;}
+
+        double getNeighbors() const {return n_neighbors;}
+        double getMeanIterations() const {return densities.empty() ? 0.0 : double(iterations) / densities.size();}
+        long long getNeighborQueries() const {return queries;}
+
+        /**
+         * @brief Particles that did not converge within max_iterations during the last solve. They keep the last h the
+         * density was computed with, so that getDensities() is still rho(h) for them.
+         */
+        int getFailures() const {return failures;}
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "kernel.hpp"
+#include "particleSet.hpp"
+#include "particleArrays.hpp"
+#include "neighborList.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <array>
+
+
+/**
+ * @brief One neighbor pair of an SphSolver pass, visited once for both particles (i < j in the set).
+ * The kernel of the pair is evaluated once, with the symmetrized smoothing length h_ij = (h_i + h_j) / 2, and kept
+ * for the force pass.
+ */
+struct SphPair {
+    int i, j;
+    real w; // W(r_ij, h_ij)
+    real gradient_factor; // grad_i W = gradient_factor * (x_i - x_j)
+};
+
+
+/**
+ * @brief Symmetric SPH pair engine: density, pressure gradient and Monaghan artificial viscosity for a barotropic
+ * gas P = K rho^gamma. Every neighbor pair is visited once, and its contributions are applied with opposite signs to
+ * both particles (Newton's third law), so total momentum is conserved to round-off and the kernel is evaluated once
+ * per pair instead of once per particle and neighbor.
+ *
+ * Pairs come from a NeighborList (gather lists): a pair is taken from the list of the smaller index, or from the
+ * list of the larger one if it only appears there. Chunks of particles are handled in parallel, each accumulating
+ * into its own buffers (contributions to neighbors outside the chunk would race otherwise), summed at the end. A
+ * buffer only spans the particles the pairs of its chunk touch (a few times the chunk on a spatially sorted set),
+ * and is kept from one pass to the next.
+ * In deterministic mode (Parallel::setDeterministic), the contributions go to slots instead, laid out per particle in
+ * the order the pairs were found, and every particle sums its own slots in that order, whatever the number of chunks.
+ *
+ * The passes read a ParticleArrays copy of the set, loaded by computeDensities(): velocities, masses, smoothing
+ * lengths, kernel values and the contributions of the pairs are in `real`, the precision of the build (see
+ * precision.hpp). Separations are taken in double, and the densities and accelerations returned are double.
+ * ```cpp
+ * SmoothingLengthSolver(kernel, 50).solve(ps);
+ * list.update(ps, kernel);
+ * SphSolver sph(kernel, 1.0, 5.0 / 3.0);
+ * std::vector<Eigen::Vector3d> acc = sph.accelerations(ps, list); // also sets getDensities(), getPressures()
+ * ```
+ */
+class SphSolver {
+    private:
+        const Kernel& kernel;
+        double K; // P = K rho^gamma
+        double gamma;
+        double alpha; // linear and quadratic artificial viscosity
+        double beta;
+
+        ParticleArrays arrays; // the set of the last density pass
+        std::vector<std::vector<SphPair>> pairs; // per chunk, of the last density pass
+        std::vector<std::array<int, 2>> touched; // per chunk, the first and one past the last particle its pairs touch
+        std::vector<std::vector<real>> density_buffers; // per chunk, for the particles it touches
+        std::vector<std::vector<Vector3r>> force_buffers;
+        std::vector<int> slot_offsets; // deterministic mode: contributions to particle i go to slots [offsets[i], offsets[i + 1])
+        std::vector<std::vector<std::array<int, 2>>> slots; // per chunk and pair, the slots of the contributions to i and to j
+        std::vector<double> densities;
+        std::vector<double> pressures;
+        long long kernel_evaluations = 0;
+
+    public:
+        SphSolver(const Kernel& kernel, double K = 1.0, double gamma = 5.0 / 3.0, double alpha = 1.0, double beta = 2.0);
+
+        /**
+         * @brief rho_i = sum_j m_j W(r_ij, h_ij) (self included) and the pressures, in the order of the set.
+         * list must be up to date for ps.
+         */
+        const std::vector<double>& computeDensities(const ParticleSet& ps, const NeighborList& list);
+
+        /**
+         * @brief Hydrodynamic acceleration of every particle, in the order of the set:
+         * a_i = -sum_j m_j (P_i / rho_i^2 + P_j / rho_j^2 + Pi_ij) grad_i W_ij
+         * Runs the density pass first, and reuses its pairs and kernel values.
+         */
+        std::vector<Eigen::Vector3d> accelerations(const ParticleSet& ps, const NeighborList& list);
+
+        const std::vector<double>& getDensities() const {return densities;}
+        const std::vector<double>& getPressures() const {return pressures;}
+
+        /**
+         * @brief Sound speed of particle i at the last density pass.
+         */
+        double soundSpeed(int i) const {return std::sqrt(gamma * pressures[i] / densities[i]);}
+
+        /**
+         * @brief Kernel evaluations of the last density pass (one per pair, plus one self term per particle).
+         */
+        long long getKernelEvaluations() const {return kernel_evaluations;}
+
+        /**
+         * @brief Pairs found by the last density pass.
+         */
+        long long getPairs() const;
+
+    private:
+        real smoothingLength(int i) const {return arrays.smoothing_lengths[i] > 0 ? arrays.smoothing_lengths[i] : kernel.getSmoothingRadius();}
+
+        /**
+         * @brief Deterministic mode: gives every pair its two slots, the slots of a particle being in the order its pairs
+         * were found (chunk after chunk), which does not depend on where the chunks start.
+         */
+        void assignSlots(int n);
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+
+
+/**
+ * @brief A simulation step (or several) as a graph of tasks, run so that independent tasks overlap. Each task names
+ * the data it reads and writes; a task then depends on the last earlier writer of what it reads or writes, and on the
+ * earlier readers of what it writes. The result is thus always the same as running the tasks one by one in the order
+ * they were added, but e.g. diagnostics and snapshot output no longer wait for each other, nor hold up the next step.
+ *
+ * Only the declared data orders tasks: state a task changes behind the scenes, even from const methods, must be
+ * declared as data too (written by that task), or be safe to fill concurrently. ParticleSet caches its statistics and
+ * snapshots under a lock, so readers of "positions" may share a set; a cache of your own (a solver remembering its last
+ * costs, say) makes the tasks that use it writers of it.
+ *
+ * Tasks run on up to `lanes` threads, each task inside a Parallel::Phase of its name. Parallel loops inside a task use
+ * the worker pool when it is free, and run serially on the lane otherwise: the large phases get the pool, and the
+ * small ones around them fill the gaps. Every run records a timeline of which task ran when, and on which lane.
+ * ```cpp
+ * TaskGraph step;
+ * step.add("tree", [&] {tree = std::make_unique<Octree>(ps);}, {"positions"}, {"tree"});
+ * step.add("gravity", [&] {acc = gravity.accelerations(*tree);}, {"tree"}, {"acc"});
+ * step.add("diagnostics", [&] {energy = ps.getStatistics().kinetic_energy;}, {"positions"}, {"energy"});
+ * step.add("kick drift", [&] {leapfrog(ps, acc);}, {"acc"}, {"positions"}); // after tree and diagnostics read them
+ * step.run();
+ * step.printTimeline();
+ * ```
+ */
+class TaskGraph {
+    public:
+        /**
+         * @brief When a task ran, in seconds since the start of the run, and on which lane (0 is the calling thread).
+         */
+        struct TimelineEntry {
+            int task;
+            std::string name;
+            double start, end;
+            int lane;
+        };
+
+    private:
+        struct Node {
+            std::string name;
+            std::function<void()> f;
+            std::vector<int> dependencies;
+            std::vector<int> successors;
+        };
+        std::vector<Node> nodes;
+        std::map<std::string, int> last_writer; // per data name, the last task that writes it
+        std::map<std::string, std::vector<int>> readers; // per data name, the tasks that read it since it was last written
+        std::vector<TimelineEntry> timeline;
+
+        void depend(int task, int dependency);
+
+    public:
+        TaskGraph() {};
+
+        /**
+         * @brief Adds a task and returns its index. Its dependencies follow from the data it reads and writes.
+         */
+        int add(const std::string& name, std::function<void()> f, const std::vector<std::string>& reads = {}, const std::vector<std::string>& writes = {});
+
+        /**
+         * @brief An explicit dependency, for what data names do not express: task waits for dependency, added earlier.
+         */
+        void after(int task, int dependency);
+
+        /**
+         * @brief Runs every task once, on up to `lanes` threads (0: Parallel::getThreads()). Rethrows the first exception
+         * thrown by a task, once the running tasks are done; tasks that depend on a failed one do not run.
+         */
+        void run(int lanes = 0);
+
+        /**
+         * @brief Removes every task, to build the next graph.
+         */
+        void clear();
+
+        int size() const {return nodes.size();}
+        const std::string& getName(int task) const {return nodes[task].name;}
+        const std::vector<int>& getDependencies(int task) const {return nodes[task].dependencies;}
+
+        /**
+         * @brief Tasks of the last run, by start time.
+         */
+        const std::vector<TimelineEntry>& getTimeline() const {return timeline;}
+
+        /**
+         * @brief Whether the two tasks ran at the same time during the last run.
+         */
+        bool ranConcurrently(int a, int b) const;
+
+        /**
+         * @brief Prints the timeline of the last run, one bar per task.
+         */
+        void printTimeline(int width = 60) const;
+};
@@ -0,0 +1,357 @@
+#include "analysis.hpp"
+#include "octree.hpp"
+#include "parallel.hpp"
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+
+
+// ---------------------- //
+// !-- Radial Profile --! //
+// ---------------------- //
+
+RadialProfile::RadialProfile(int bins, double r_min, double r_max) : bins(bins), r_min(r_min), r_max(r_max), fixed_center(false), center(Eigen::Vector3d::Zero()) {
+    if (bins < 1 || !(r_min > 0) || !(r_max > r_min)) throw std::invalid_argument("RadialProfile: needs at least one bin and 0 < r_min < r_max.");
+}
+
+RadialProfile::RadialProfile(int bins, double r_min, double r_max, const Eigen::Vector3d& center) : RadialProfile(bins, r_min, r_max) {
+    fixed_center = true;
+    this->center = center;
+}
+
+AnalysisTable RadialProfile::compute(const ParticleSnapshot& snapshot, int, double) {
+    const int n = snapshot.size();
+    struct Shell {
+        double count = 0, mass = 0, radial = 0, v2 = 0; // sums of 1, m, m v_r, m |v|^2
+        Eigen::Vector3d momentum = Eigen::Vector3d::Zero();
+    };
+    auto add = [](std::vector<Shell> a, const std::vector<Shell>& b) {
+        for (size_t s = 0; s < a.size(); s++) {
+            a[s].count += b[s].count;
+            a[s].mass += b[s].mass;
+            a[s].radial += b[s].radial;
+            a[s].v2 += b[s].v2;
+            a[s].momentum += b[s].momentum;
+        }
+        return a;
+    };
+
+    // center of mass, and its velocity
+    using Moments = std::pair<double, Eigen::Matrix<double, 6, 1>>;
+    Moments moments = Parallel::reduce<Moments>(n, {0.0, Eigen::Matrix<double, 6, 1>::Zero()}, [&](int begin, int end) {
+        Moments m{0.0, Eigen::Matrix<double, 6, 1>::Zero()};
+        for (int i = begin; i < end; i++) {
+            const Particle& p = snapshot.get(i);
+            m.first += p.mass;
+            m.second.head<3>() += p.mass * p.position;
+            m.second.tail<3>() += p.mass * p.velocity;
+        }
+        return m;
+    }, [](const Moments& a, const Moments& b) {return Moments{a.first + b.first, a.second + b.second};});
+    const double total = moments.first > 0 ? moments.first : 1.0;
+    const Eigen::Vector3d origin = fixed_center ? center : Eigen::Vector3d(moments.second.head<3>() / total);
+    const Eigen::Vector3d drift = moments.second.tail<3>() / total;
+
+    const double log_ratio = std::log(r_max / r_min);
+    std::vector<Shell> shells = Parallel::reduce<std::vector<Shell>>(n, std::vector<Shell>(bins), [&](int begin, int end) {
+        std::vector<Shell> partial(bins);
+        for (int i = begin; i < end; i++) {
+            const Particle& p = snapshot.get(i);
+            const Eigen::Vector3d x = p.position - origin;
+            const double r = x.norm();
+            if (r < r_min || r >= r_max) continue;
+            const int s = std::min(bins - 1, (int)(std::log(r / r_min) / log_ratio * bins));
+            const Eigen::Vector3d v = p.velocity - drift;
+            partial[s].count += 1;
+            partial[s].mass += p.mass;
+            partial[s].radial += p.mass * v.dot(x) / r;
+            partial[s].v2 += p.mass * v.squaredNorm();
+            partial[s].momentum += p.mass * v;
+        }
+        return partial;
+    }, add);
+
+    AnalysisTable table{{"r_inner", "r_outer", "count", "mass", "density", "radial_velocity", "velocity_dispersion"}, {}};
+    for (int s = 0; s < bins; s++) {
+        const double inner = r_min * std::exp(log_ratio * s / bins);
+        const double outer = r_min * std::exp(log_ratio * (s + 1) / bins);
+        const Shell& shell = shells[s];
+        const double volume = 4.0 / 3.0 * M_PI * (outer * outer * outer - inner * inner * inner);
+        double radial = 0, dispersion = 0;
+        if (shell.mass > 0) {
+            radial = shell.radial / shell.mass;
+            const Eigen::Vector3d mean = shell.momentum / shell.mass;
+            dispersion = std::sqrt(std::max(0.0, (shell.v2 / shell.mass - mean.squaredNorm()) / 3));
+        }
+        table.rows.push_back({inner, outer, shell.count, shell.mass, shell.mass / volume, radial, dispersion});
+    }
+    return table;
+}
+
+
+
+// --------------------- //
+// !-- Energy Budget --! //
+// --------------------- //
+
+EnergyBudget::EnergyBudget(double softening, double theta, double G) : softening(softening), theta(theta), G(G) {
+    if (softening < 0 || theta < 0 || theta >= 1) throw std::invalid_argument("EnergyBudget: needs softening >= 0 and 0 <= theta < 1.");
+}
+
+AnalysisTable EnergyBudget::compute(const ParticleSnapshot& snapshot, int, double) {
+    const int n = snapshot.size();
+    struct Sums {
+        double kinetic = 0;
+        Eigen::Vector3d momentum = Eigen::Vector3d::Zero();
+        Eigen::Vector3d angular_momentum = Eigen::Vector3d::Zero();
+    };
+    Sums sums = Parallel::reduce<Sums>(n, Sums(), [&](int begin, int end) {
+        Sums s;
+        for (int i = begin; i < end; i++) {
+            const Particle& p = snapshot.get(i);
+            s.kinetic += 0.5 * p.mass * p.velocity.squaredNorm();
+            s.momentum += p.mass * p.velocity;
+            s.angular_momentum += p.mass * p.position.cross(p.velocity);
+        }
+        return s;
+    }, [](const Sums& a, const Sums& b) {
+        return Sums{a.kinetic + b.kinetic, a.momentum + b.momentum, a.angular_momentum + b.angular_momentum};
+    });
+
+    // W = 1/2 sum_i m_i phi_i, with phi from the monopoles of the nodes that are far enough
+    double potential = 0;
+    if (n > 1) {
+        ParticleSet set(snapshot);
+        Octree tree(set);
+        const double eps2 = softening * softening;
+        potential = Parallel::reduce<double>(n, 0.0, [&](int begin, int end) {
+            double w = 0;
+            int stack[8 * (Octree::max_level + 1)];
+            for (int k = begin; k < end; k++) {
+                const Eigen::Vector3d& x = tree.positions[k];
+                double phi = 0;
+                int top = 0;
+                stack[top++] = 0;
+                while (top > 0) {
+                    const OctreeNode& node = tree.nodes[stack[--top]];
+                    const double d2 = (x - node.com).squaredNorm();
+                    if (node.isLeaf()) {
+                        for (int j = node.first; j < node.first + node.count; j++) {
+                            if (j != k) phi -= tree.masses[j] / std::sqrt((x - tree.positions[j]).squaredNorm() + eps2);
+                        }
+                    } else if (node.radius * node.radius < theta * theta * d2) {
+                        phi -= node.mass / std::sqrt(d2 + eps2);
+                    } else {
+                        for (int c = 0; c < node.n_children; c++) stack[top++] = node.children[c];
+                    }
+                }
+                w += 0.5 * tree.masses[k] * G * phi;
+            }
+            return w;
+        }, [](double a, double b) {return a + b;}, 256);
+    }
+
+    const double virial = potential != 0 ? 2 * sums.kinetic / std::abs(potential) : 0.0;
+    return AnalysisTable{
+        {"kinetic", "potential", "total", "virial_ratio", "px", "py", "pz", "lx", "ly", "lz"},
+        {{sums.kinetic, potential, sums.kinetic + potential, virial,
+          sums.momentum.x(), sums.momentum.y(), sums.momentum.z(),
+          sums.angular_momentum.x(), sums.angular_momentum.y(), sums.angular_momentum.z()}}
+    };
+}
+
+
+
+// --------------------- //
+// !-- Projected Map --! //
+// --------------------- //
+
+ProjectedMap::ProjectedMap(int pixels, double half_width, const Eigen::Vector3d& center, int axis) : pixels(pixels), half_width(half_width), center(center), axis(axis) {
+    if (pixels < 1 || !(half_width > 0) || axis < 0 || axis > 2) throw std::invalid_argument("ProjectedMap: needs pixels >= 1, half_width > 0 and an axis in {0, 1, 2}.");
+}
+
+AnalysisTable ProjectedMap::compute(const ParticleSnapshot& snapshot, int, double) {
+    const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+    const double pixel = 2 * half_width / pixels;
+    const double u0 = center[u] - half_width, v0 = center[v] - half_width;
+
+    std::vector<double> mass = Parallel::reduce<std::vector<double>>(snapshot.size(), std::vector<double>(pixels * pixels, 0.0), [&](int begin, int end) {
+        std::vector<double> grid(pixels * pixels, 0.0);
+        for (int i = begin; i < end; i++) {
+            const Particle& p = snapshot.get(i);
+            // cloud in cell: the mass of a pixel sized cloud shared between the four pixels it overlaps
+            const double su = (p.position[u] - u0) / pixel - 0.5, sv = (p.position[v] - v0) / pixel - 0.5;
+            const int iu = std::floor(su), iv = std::floor(sv);
+            const double fu = su - iu, fv = sv - iv;
+            for (int a = 0; a < 2; a++) {
+                for (int b = 0; b < 2; b++) {
+                    const int pu = iu + a, pv = iv + b;
+                    if (pu < 0 || pu >= pixels || pv < 0 || pv >= pixels) continue;
+                    grid[pu * pixels + pv] += p.mass * (a ? fu : 1 - fu) * (b ? fv : 1 - fv);
+                }
+            }
+        }
+        return grid;
+    }, [](std::vector<double> a, const std::vector<double>& b) {
+        for (size_t k = 0; k < a.size(); k++) a[k] += b[k];
+        return a;
+    });
+
+    AnalysisTable table{{"x", "y", "surface_density"}, {}};
+    table.rows.reserve(pixels * pixels);
+    for (int pu = 0; pu < pixels; pu++) {
+        for (int pv = 0; pv < pixels; pv++) {
+            table.rows.push_back({u0 + (pu + 0.5) * pixel, v0 + (pv + 0.5) * pixel, mass[pu * pixels + pv] / (pixel * pixel)});
+        }
+    }
+    return table;
+}
+
+
+
+// --------------- //
+// !-- In Situ --! //
+// --------------- //
+
+InSitu::InSitu(int lanes, int max_pending) : max_pending(max_pending) {
+    if (lanes < 1 || max_pending < 1) throw std::invalid_argument("InSitu: needs at least one lane and one pending analysis.");
+    for (int l = 0; l < lanes; l++) {
+        this->lanes.emplace_back(&InSitu::lane, this);
+    }
+}
+
+InSitu::~InSitu() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&] {return queue.empty() && running == 0;});
+    stop = true;
+    lock.unlock();
+    changed.notify_all();
+    for (std::thread& t : lanes) t.join();
+}
+
+int InSitu::add(std::unique_ptr<Analysis> analysis, int every, const std::string& filename) {
+    if (!analysis || every < 1) throw std::invalid_argument("InSitu::add: needs an analysis and every >= 1.");
+    std::lock_guard<std::mutex> lock(mutex);
+    plugins.push_back(std::make_unique<Plugin>());
+    plugins.back()->analysis = std::move(analysis);
+    plugins.back()->every = every;
+    plugins.back()->filename = filename;
+    return plugins.size() - 1;
+}
+
+void InSitu::rethrow() {
+    if (error) {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+void InSitu::step(const ParticleSet& ps, int step, double time) {
+    std::unique_lock<std::mutex> lock(mutex);
+    rethrow();
+    std::vector<int> due;
+    for (int p = 0; p < (int)plugins.size(); p++) {
+        if (step % plugins[p]->every == 0) due.push_back(p);
+    }
+    if (due.empty()) return;
+
+    changed.wait(lock, [&] {return (int)queue.size() < max_pending || error;});
+    rethrow();
+    const ParticleSnapshot snapshot = ps.snapshot(); // one for all of them, the set goes on
+    for (int p : due) {
+        queue.push_back({p, snapshot, step, time});
+    }
+    lock.unlock();
+    changed.notify_all();
+}
+
+void InSitu::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&] {return queue.empty() && running == 0;});
+    rethrow();
+}
+
+void InSitu::lane() {
+    Parallel::Serial serial; // the pool belongs to the simulation
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // the oldest job of an analysis that is not running already: each one runs its steps in order
+        std::deque<Job>::iterator job;
+        changed.wait(lock, [&] {
+            job = std::find_if(queue.begin(), queue.end(), [&](const Job& j) {return !plugins[j.plugin]->running;});
+            return stop || job != queue.end();
+        });
+        if (job == queue.end()) return;
+
+        Job todo = std::move(*job);
+        queue.erase(job);
+        Plugin& plugin = *plugins[todo.plugin];
+        plugin.running = true;
+        running++;
+        lock.unlock();
+        changed.notify_all(); // room in the queue
+
+        AnalysisTable table;
+        long long bytes = 0;
+        std::exception_ptr thrown;
+        try {
+            Parallel::Phase phase(plugin.analysis->getName());
+            table = plugin.analysis->compute(todo.snapshot, todo.step, todo.time);
+            todo.snapshot = ParticleSnapshot(); // the particles can go before the output
+            bytes = write(plugin, table, todo.step, todo.time);
+        } catch (...) {
+            thrown = std::current_exception();
+        }
+
+        lock.lock();
+        plugin.running = false;
+        running--;
+        if (thrown) {
+            if (!error) error = thrown;
+        } else {
+            plugin.last = std::move(table);
+            plugin.bytes += bytes;
+        }
+        changed.notify_all();
+    }
+}
+
+long long InSitu::write(Plugin& plugin, const AnalysisTable& table, int step, double time) {
+    std::ostringstream out;
+    out.precision(17);
+    if (!plugin.header_written) {
+        out << "step,time";
+        for (const std::string& column : table.columns) out << "," << column;
+        out << "\n";
+    }
+    for (const std::vector<double>& row : table.rows) {
+        out << step << "," << time;
+        for (double value : row) out << "," << value;
+        out << "\n";
+    }
+    const std::string text = out.str();
+
+    std::ofstream file(plugin.filename, plugin.header_written ? std::ios::app : std::ios::trunc);
+    if (!file) throw std::runtime_error("InSitu: cannot open " + plugin.filename + ".");
+    file << text;
+    if (!file) throw std::runtime_error("InSitu: write failed on " + plugin.filename + ".");
+    plugin.header_written = true;
+    return text.size();
+}
+
+AnalysisTable InSitu::getLast(int plugin) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (plugin < 0 || plugin >= (int)plugins.size()) throw std::invalid_argument("InSitu::getLast: no such analysis.");
+    return plugins[plugin]->last;
+}
+
+long long InSitu::getBytesWritten() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    long long total = 0;
+    for (const std::unique_ptr<Plugin>& plugin : plugins) total += plugin->bytes;
+    return total;
+}
@@ -0,0 +1,313 @@
+#include "checkpoint.hpp"
+#include "parallel.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <array>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+namespace {
+    const char magic[8] = {'C', 'A', 'S', 'T', 'R', 'C', 'H', 'K'};
+    const size_t alignment = 4096; // sections start on page boundaries
+
+    struct ParticleRecord {
+        double position[3], velocity[3], mass, current_time, smoothing_length;
+        int64_t id;
+    };
+
+    struct SectionEntry {
+        char name[Checkpoint::max_name_length + 1];
+        uint64_t offset, size;
+    };
+
+    size_t blocks(size_t size) {return (size + Checkpoint::block_size - 1) / Checkpoint::block_size;}
+
+    // 8 tables => the CRC goes through 8 bytes per step
+    const std::array<std::array<uint32_t, 256>, 8>& crcTables() {
+        static const std::array<std::array<uint32_t, 256>, 8> tables = [] {
+            std::array<std::array<uint32_t, 256>, 8> t;
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[0][i] = c;
+            }
+            for (int s = 1; s < 8; s++) {
+                for (int i = 0; i < 256; i++) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+            }
+            return t;
+        }();
+        return tables;
+    }
+
+    void writeAll(int fd, const char* data, size_t size, size_t offset) {
+        while (size > 0) {
+            ssize_t n = pwrite(fd, data, size, offset);
+            if (n <= 0) throw std::runtime_error("Checkpoint::write: write failed.");
+            data += n;
+            size -= n;
+            offset += n;
+        }
+    }
+
+    bool readAll(int fd, char* data, size_t size, size_t offset) {
+        while (size > 0) {
+            ssize_t n = pread(fd, data, size, offset);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+            offset += n;
+        }
+        return true;
+    }
+}
+
+
+uint32_t Checkpoint::crc32(const void* data, size_t size, uint32_t crc) {
+    const auto& t = crcTables();
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    while (size >= 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size-- > 0) crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+
+/**
+ * ----------------
+ * !-- Sections --!
+ * ----------------
+ */
+
+void Checkpoint::set(const std::string& name, std::vector<char> bytes) {
+    if (name.empty() || (int)name.size() > max_name_length) throw std::invalid_argument("Checkpoint::set: names must have 1 to 31 characters.");
+    sections[name] = std::move(bytes);
+}
+
+const std::vector<char>& Checkpoint::get(const std::string& name) const {
+    auto it = sections.find(name);
+    if (it == sections.end()) throw std::runtime_error("Checkpoint::get: no section named " + name + ".");
+    return it->second;
+}
+
+std::vector<std::string> Checkpoint::names() const {
+    std::vector<std::string> result;
+    for (const auto& section : sections) {
+        result.push_back(section.first);
+    }
+    return result;
+}
+
+void Checkpoint::setParticles(const ParticleSet& ps) {
+    std::vector<ParticleRecord> records(ps.size());
+    Parallel::forRange(ps.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Particle& p = ps.get(i);
+            ParticleRecord& r = records[i];
+            for (int dim = 0; dim < 3; dim++) {
+                r.position[dim] = p.position[dim];
+                r.velocity[dim] = p.velocity[dim];
+            }
+            r.mass = p.mass;
+            r.current_time = p.current_time;
+            r.smoothing_length = p.smoothing_length;
+            r.id = p.getId();
+        }
+    });
+    setValues("particles", records);
+
+    if (ps.isPeriodic()) {
+        const PeriodicBox& box = *ps.getPeriodicBox();
+        setValues<double>("particles.box", {box.side, box.origin.x(), box.origin.y(), box.origin.z()});
+    } else {
+        sections.erase("particles.box");
+    }
+}
+
+ParticleSet Checkpoint::restoreParticles() const {
+    std::vector<ParticleRecord> records = getValues<ParticleRecord>("particles");
+    ParticleSet ps;
+    ps.particles.resize(records.size());
+    Parallel::forRange(records.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const ParticleRecord& r = records[i];
+            ps.particles[i] = Particle(Eigen::Vector3d(r.position), Eigen::Vector3d(r.velocity), r.mass, r.id);
+            ps.particles[i].current_time = r.current_time;
+            ps.particles[i].smoothing_length = r.smoothing_length;
+        }
+    });
+    ps.invalidate();
+
+    if (has("particles.box")) {
+        std::vector<double> box = getValues<double>("particles.box");
+        ps.setPeriodicBox(PeriodicBox(box[0], Eigen::Vector3d(box[1], box[2], box[3])));
+    }
+    return ps;
+}
+
+void Checkpoint::saveIdCounter() {
+    const int64_t counter = Particle::getIdCounter();
+    Particle::setIdCounter(counter); // new blocks from here, as after a restart
+    setValue<int64_t>("particles.id_counter", counter);
+}
+
+void Checkpoint::restoreIdCounter() const {
+    Particle::setIdCounter(getValue<int64_t>("particles.id_counter"));
+}
+
+
+
+/**
+ * ---------------
+ * !-- File IO --!
+ * ---------------
+ */
+
+void Checkpoint::write(const std::string& filename) const {
+    // layout: header (magic, version, section table, block checksums, header checksum), then the aligned sections
+    std::vector<SectionEntry> entries;
+    std::vector<const std::vector<char>*> data;
+    size_t n_blocks = 0;
+    for (const auto& section : sections) {
+        SectionEntry entry = {};
+        std::strncpy(entry.name, section.first.c_str(), max_name_length);
+        entry.size = section.second.size();
+        entries.push_back(entry);
+        data.push_back(&section.second);
+        n_blocks += blocks(entry.size);
+    }
+    const uint32_t n_sections = entries.size();
+    size_t header_size = sizeof(magic) + 2 * sizeof(uint32_t) + n_sections * sizeof(SectionEntry) + (n_blocks + 1) * sizeof(uint32_t);
+    size_t offset = (header_size + alignment - 1) / alignment * alignment;
+    for (SectionEntry& entry : entries) {
+        entry.offset = offset;
+        offset += (entry.size + alignment - 1) / alignment * alignment;
+    }
+
+    const std::string tmp = filename + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Checkpoint::write: cannot open " + tmp + ".");
+
+    // every block is checksummed and written by whichever thread gets it
+    struct Job {int section; size_t begin, size, crc_index;};
+    std::vector<Job> jobs;
+    for (int s = 0; s < (int)n_sections; s++) {
+        for (size_t begin = 0; begin < entries[s].size; begin += block_size) {
+            jobs.push_back({s, begin, std::min(block_size, (size_t)entries[s].size - begin), jobs.size()});
+        }
+    }
+    std::vector<uint32_t> crcs(jobs.size());
+    try {
+        if (ftruncate(fd, offset) != 0) throw std::runtime_error("Checkpoint::write: cannot resize " + tmp + ".");
+        Parallel::forRange(jobs.size(), [&](int begin, int end) {
+            for (int j = begin; j < end; j++) {
+                const char* bytes = data[jobs[j].section]->data() + jobs[j].begin;
+                crcs[jobs[j].crc_index] = crc32(bytes, jobs[j].size);
+                writeAll(fd, bytes, jobs[j].size, entries[jobs[j].section].offset + jobs[j].begin);
+            }
+        }, 1);
+
+        std::vector<char> header;
+        auto append = [&](const void* p, size_t size) {header.insert(header.end(), (const char*)p, (const char*)p + size);};
+        const uint32_t v = version;
+        append(magic, sizeof(magic));
+        append(&v, sizeof(v));
+        append(&n_sections, sizeof(n_sections));
+        append(entries.data(), entries.size() * sizeof(SectionEntry));
+        append(crcs.data(), crcs.size() * sizeof(uint32_t));
+        uint32_t header_crc = crc32(header.data(), header.size());
+        append(&header_crc, sizeof(header_crc));
+        writeAll(fd, header.data(), header.size(), 0);
+
+        if (fsync(fd) != 0) throw std::runtime_error("Checkpoint::write: cannot flush " + tmp + ".");
+    } catch (...) {
+        close(fd);
+        unlink(tmp.c_str());
+        throw;
+    }
+    close(fd);
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0) throw std::runtime_error("Checkpoint::write: cannot rename " + tmp + ".");
+}
+
+Checkpoint Checkpoint::read(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Checkpoint::read: cannot open " + filename + ".");
+
+    Checkpoint checkpoint;
+    try {
+        // fixed part of the header, then the section table and the checksums
+        std::vector<char> header(sizeof(magic) + 2 * sizeof(uint32_t));
+        uint32_t file_version, n_sections;
+        if (!readAll(fd, header.data(), header.size(), 0) || std::memcmp(header.data(), magic, sizeof(magic)) != 0) {
+            throw std::runtime_error("Checkpoint::read: " + filename + " is not a checkpoint.");
+        }
+        std::memcpy(&file_version, header.data() + sizeof(magic), sizeof(uint32_t));
+        std::memcpy(&n_sections, header.data() + sizeof(magic) + sizeof(uint32_t), sizeof(uint32_t));
+        if ((int)file_version != version) throw std::runtime_error("Checkpoint::read: unsupported version " + std::to_string(file_version) + ".");
+        if (n_sections > 1 << 16) throw std::runtime_error("Checkpoint::read: corrupted header in " + filename + ".");
+
+        // the section table is only checked by the header checksum, which comes after the block checksums: sections
+        // must at least fit in the file before anything is allocated from their sizes
+        struct stat info;
+        if (fstat(fd, &info) != 0) throw std::runtime_error("Checkpoint::read: cannot stat " + filename + ".");
+        const uint64_t file_size = info.st_size;
+        std::vector<SectionEntry> entries(n_sections);
+        if (!readAll(fd, (char*)entries.data(), n_sections * sizeof(SectionEntry), header.size())) throw std::runtime_error("Checkpoint::read: truncated header in " + filename + ".");
+        size_t n_blocks = 0;
+        for (const SectionEntry& entry : entries) {
+            if (entry.offset > file_size || entry.size > file_size - entry.offset) throw std::runtime_error("Checkpoint::read: corrupted header in " + filename + ".");
+            n_blocks += blocks(entry.size);
+        }
+        std::vector<uint32_t> crcs(n_blocks);
+        uint32_t header_crc;
+        size_t position = header.size() + n_sections * sizeof(SectionEntry);
+        if (!readAll(fd, (char*)crcs.data(), n_blocks * sizeof(uint32_t), position) ||
+            !readAll(fd, (char*)&header_crc, sizeof(header_crc), position + n_blocks * sizeof(uint32_t))) {
+            throw std::runtime_error("Checkpoint::read: truncated header in " + filename + ".");
+        }
+        uint32_t crc = crc32(header.data(), header.size());
+        crc = crc32(entries.data(), entries.size() * sizeof(SectionEntry), crc);
+        crc = crc32(crcs.data(), crcs.size() * sizeof(uint32_t), crc);
+        if (crc != header_crc) throw std::runtime_error("Checkpoint::read: corrupted header in " + filename + ".");
+
+        // blocks in parallel, each checked against its checksum
+        std::vector<std::vector<char>*> data;
+        struct Job {int section; size_t begin, size, crc_index;};
+        std::vector<Job> jobs;
+        for (int s = 0; s < (int)n_sections; s++) {
+            entries[s].name[max_name_length] = '\0';
+            std::vector<char>& bytes = checkpoint.sections[entries[s].name];
+            bytes.resize(entries[s].size);
+            data.push_back(&bytes);
+            for (size_t begin = 0; begin < entries[s].size; begin += block_size) {
+                jobs.push_back({s, begin, std::min(block_size, (size_t)entries[s].size - begin), jobs.size()});
+            }
+        }
+        std::vector<char> valid(jobs.size(), 0);
+        Parallel::forRange(jobs.size(), [&](int begin, int end) {
+            for (int j = begin; j < end; j++) {
+                char* bytes = data[jobs[j].section]->data() + jobs[j].begin;
+                valid[j] = readAll(fd, bytes, jobs[j].size, entries[jobs[j].section].offset + jobs[j].begin) && crc32(bytes, jobs[j].size) == crcs[jobs[j].crc_index];
+            }
+        }, 1);
+        for (int j = 0; j < (int)jobs.size(); j++) {
+            if (!valid[j]) throw std::runtime_error("Checkpoint::read: corrupted block in section " + std::string(entries[jobs[j].section].name) + " of " + filename + ".");
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return checkpoint;
+}
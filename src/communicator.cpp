@@ -0,0 +1,175 @@
+#include "communicator.hpp"
+#include <tintoretto.hpp>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+
+/**
+ * -------------------
+ * !-- Process Set --!
+ * -------------------
+ */
+
+Communicator::~Communicator() {
+    for (int fd : sockets) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void Communicator::run(int n_processes, const std::function<void(Communicator&)>& f) {
+    if (n_processes < 1) throw std::invalid_argument("Communicator::run: at least one process is needed.");
+
+    // one socket pair per pair of ranks: pairs[i][j] is the end owned by rank i
+    std::vector<std::vector<int>> pairs(n_processes, std::vector<int>(n_processes, -1));
+    for (int i = 0; i < n_processes; i++) {
+        for (int j = i + 1; j < n_processes; j++) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) throw std::runtime_error("Communicator::run: socketpair failed.");
+            pairs[i][j] = fds[0];
+            pairs[j][i] = fds[1];
+        }
+    }
+    auto closeOthers = [&](int rank) {
+        for (int i = 0; i < n_processes; i++) {
+            if (i == rank) continue;
+            for (int j = 0; j < n_processes; j++) {
+                if (pairs[i][j] >= 0) close(pairs[i][j]);
+            }
+        }
+    };
+
+    std::fflush(stdout); // or the children print the buffered output again
+    std::vector<pid_t> children;
+    for (int rank = 1; rank < n_processes; rank++) {
+        pid_t pid = fork();
+        if (pid < 0) throw std::runtime_error("Communicator::run: fork failed.");
+        if (pid == 0) {
+            closeOthers(rank);
+            int status = 0;
+            try {
+                Communicator comm(rank, n_processes, pairs[rank]);
+                f(comm);
+            } catch (const std::exception& e) {
+                Message("Rank " + std::to_string(rank) + ": " + e.what(), "!");
+                status = 1;
+            }
+            std::fflush(stdout);
+            _exit(status); // no static destructors or atexit handlers of the parent in the children
+        }
+        children.push_back(pid);
+    }
+
+    closeOthers(0);
+    std::string error;
+    try {
+        Communicator comm(0, n_processes, pairs[0]);
+        f(comm);
+    } catch (const std::exception& e) {
+        error = std::string("rank 0: ") + e.what(); // the sockets are closed => the children fail too
+    }
+
+    bool failed = false;
+    for (pid_t pid : children) {
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = true;
+    }
+    if (!error.empty()) throw std::runtime_error("Communicator::run: " + error);
+    if (failed) throw std::runtime_error("Communicator::run: a process failed.");
+}
+
+
+
+/**
+ * ----------------------
+ * !-- Communications --!
+ * ----------------------
+ */
+
+std::vector<std::vector<char>> Communicator::exchange(const std::vector<std::vector<char>>& outgoing) {
+    if ((int)outgoing.size() != n_ranks) throw std::invalid_argument("Communicator::exchange: one message per rank is needed.");
+
+    // every message is preceded by its size
+    struct Channel {
+        std::vector<char> out;
+        size_t sent = 0;
+        uint64_t in_size = 0;
+        size_t received = 0; // header included
+        bool done_sending = false, done_receiving = false;
+    };
+    std::vector<Channel> channels(n_ranks);
+    std::vector<std::vector<char>> incoming(n_ranks);
+    incoming[rank] = outgoing[rank];
+
+    int pending = 0;
+    for (int r = 0; r < n_ranks; r++) {
+        if (r == rank) continue;
+        uint64_t size = outgoing[r].size();
+        channels[r].out.resize(sizeof(size) + size);
+        std::memcpy(channels[r].out.data(), &size, sizeof(size));
+        if (size > 0) std::memcpy(channels[r].out.data() + sizeof(size), outgoing[r].data(), size);
+        pending += 2;
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<int> fd_rank;
+    while (pending > 0) {
+        fds.clear();
+        fd_rank.clear();
+        for (int r = 0; r < n_ranks; r++) {
+            if (r == rank) continue;
+            short events = (channels[r].done_sending ? 0 : POLLOUT) | (channels[r].done_receiving ? 0 : POLLIN);
+            if (events == 0) continue;
+            fds.push_back({sockets[r], events, 0});
+            fd_rank.push_back(r);
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) throw std::runtime_error("Communicator::exchange: poll failed.");
+
+        for (int i = 0; i < (int)fds.size(); i++) {
+            Channel& c = channels[fd_rank[i]];
+            std::vector<char>& in = incoming[fd_rank[i]];
+            if (!c.done_sending && (fds[i].revents & POLLOUT)) {
+                ssize_t n = send(fds[i].fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN) throw std::runtime_error("Communicator::exchange: rank " + std::to_string(fd_rank[i]) + " is gone.");
+                c.sent += std::max<ssize_t>(n, 0);
+                if (c.sent == c.out.size()) {
+                    c.done_sending = true;
+                    pending--;
+                }
+            }
+            if (!c.done_receiving && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                ssize_t n;
+                if (c.received < sizeof(c.in_size)) {
+                    n = recv(fds[i].fd, reinterpret_cast<char*>(&c.in_size) + c.received, sizeof(c.in_size) - c.received, MSG_DONTWAIT);
+                } else {
+                    n = recv(fds[i].fd, in.data() + c.received - sizeof(c.in_size), sizeof(c.in_size) + in.size() - c.received, MSG_DONTWAIT);
+                }
+                if (n < 0 && errno == EAGAIN) continue;
+                if (n <= 0) throw std::runtime_error("Communicator::exchange: rank " + std::to_string(fd_rank[i]) + " is gone.");
+                c.received += n;
+                if (c.received == sizeof(c.in_size)) in.resize(c.in_size);
+                if (c.received == sizeof(c.in_size) + c.in_size) {
+                    c.done_receiving = true;
+                    pending--;
+                }
+            }
+        }
+    }
+    return incoming;
+}
+
+std::vector<std::vector<char>> Communicator::allgather(const std::vector<char>& data) {
+    return exchange(std::vector<std::vector<char>>(n_ranks, data));
+}
+
+void Communicator::barrier() {
+    allgather({});
+}
@@ -0,0 +1,372 @@
+#include "decomposition.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+namespace {
+    // what travels between processes
+    struct ParticleRecord {
+        double position[3], velocity[3], mass, current_time, smoothing_length, cost;
+        int64_t id;
+    };
+
+    struct PointMass {
+        double position[3], mass;
+    };
+
+    struct CellRecord {
+        double min[3], max[3], mass, com[3];
+        int rank;
+    };
+
+    ParticleRecord toRecord(const Particle& p, double cost) {
+        ParticleRecord r;
+        for (int dim = 0; dim < 3; dim++) {
+            r.position[dim] = p.position[dim];
+            r.velocity[dim] = p.velocity[dim];
+        }
+        r.mass = p.mass;
+        r.current_time = p.current_time;
+        r.smoothing_length = p.smoothing_length;
+        r.cost = cost;
+        r.id = p.getId();
+        return r;
+    }
+
+    Particle fromRecord(const ParticleRecord& r) {
+        Particle p(Eigen::Vector3d(r.position), Eigen::Vector3d(r.velocity), r.mass, r.id);
+        p.current_time = r.current_time;
+        p.smoothing_length = r.smoothing_length;
+        return p;
+    }
+}
+
+
+double DomainCell::distance(const Eigen::Vector3d& x, const std::optional<PeriodicBox>& box) const {
+    Eigen::Vector3d center = 0.5 * (min + max);
+    Eigen::Vector3d d = x - center;
+    if (box) d = box->minimumImage(d);
+    return (d.cwiseAbs() - 0.5 * (max - min)).cwiseMax(0.0).norm();
+}
+
+
+
+/**
+ * ----------------------
+ * !-- Load Balancing --!
+ * ----------------------
+ */
+
+int Decomposition::balance(ParticleSet& local) {
+    std::vector<double> costs(local.size(), 1.0);
+    return balance(local, costs);
+}
+
+int Decomposition::balance(ParticleSet& local, std::vector<double>& costs) {
+    if ((int)costs.size() != local.size()) throw std::invalid_argument("Decomposition::balance: one cost per particle is needed.");
+    const int n_ranks = comm.getSize();
+
+    // key space: the periodic box, or a cube around every particle, kept as long as nobody leaves it
+    bool moved = false;
+    if (local.isPeriodic()) {
+        moved = side != local.getPeriodicBox()->side || origin != local.getPeriodicBox()->origin;
+        side = local.getPeriodicBox()->side;
+        origin = local.getPeriodicBox()->origin;
+    } else {
+        const double inf = std::numeric_limits<double>::infinity();
+        std::vector<double> bounds = {inf, inf, inf, inf, inf, inf}; // min and -max
+        if (local.size() > 0) {
+            const ParticleSetStatistics& stats = local.getStatistics();
+            for (int dim = 0; dim < 3; dim++) {
+                bounds[dim] = stats.bbox_min[dim];
+                bounds[3 + dim] = -stats.bbox_max[dim];
+            }
+        }
+        bounds = comm.allreduce(bounds, [](double a, double b) {return std::min(a, b);});
+        Eigen::Vector3d lo(bounds[0], bounds[1], bounds[2]), hi(-bounds[3], -bounds[4], -bounds[5]);
+        bool inside = side > 0 && (lo - origin).minCoeff() >= 0 && (origin + Eigen::Vector3d::Constant(side) - hi).minCoeff() > 0;
+        if (!inside && lo.allFinite()) {
+            double extent = (hi - lo).maxCoeff();
+            side = extent > 0 ? 1.25 * extent : 1.0; // margin: particles drifting a little do not change the keys
+            origin = 0.5 * (lo + hi) - Eigen::Vector3d::Constant(side / 2);
+            moved = true;
+        }
+    }
+
+    // global cost histogram along the curve
+    const int shift = 3 * (Octree::max_level - bin_level);
+    const int n_bins = 1 << (3 * bin_level);
+    std::vector<int> bins(local.size());
+    std::vector<double> histogram(n_bins, 0.0);
+    for (int i = 0; i < local.size(); i++) {
+        const Eigen::Vector3d& x = local.get(i).position;
+        bins[i] = key(local.isPeriodic() ? local.getPeriodicBox()->wrap(x) : x) >> shift;
+        histogram[bins[i]] += costs[i];
+    }
+    histogram = comm.allreduce(histogram, [](double a, double b) {return a + b;});
+
+    auto loads = [&]() {
+        std::vector<double> load(n_ranks, 0.0);
+        for (int r = 0; r < n_ranks; r++) {
+            for (uint64_t b = splits[r]; b < splits[r + 1]; b++) load[r] += histogram[b];
+        }
+        return load;
+    };
+    auto imbalanceOf = [&](const std::vector<double>& load) {
+        double total = 0, largest = 0;
+        for (double l : load) {
+            total += l;
+            largest = std::max(largest, l);
+        }
+        return total > 0 ? largest * n_ranks / total : 1.0;
+    };
+
+    // move the boundaries only if needed
+    if (moved || (int)splits.size() != n_ranks + 1 || imbalanceOf(loads()) > 1 + tolerance) {
+        double total = 0;
+        for (double h : histogram) total += h;
+        splits = std::vector<uint64_t>(n_ranks + 1, 0);
+        splits[n_ranks] = n_bins;
+        double cumulative = 0;
+        int b = 0;
+        for (int r = 1; r < n_ranks; r++) {
+            double target = total * r / n_ranks;
+            while (b < n_bins && cumulative + histogram[b] <= target) cumulative += histogram[b++];
+            // the boundary closest to the target: before or after bin b
+            if (b < n_bins && target - cumulative > cumulative + histogram[b] - target) cumulative += histogram[b++];
+            splits[r] = std::max<uint64_t>(b, splits[r - 1]);
+        }
+    }
+    imbalance = imbalanceOf(loads());
+
+    // migrate the particles whose owner changed
+    std::vector<std::vector<ParticleRecord>> outgoing(n_ranks);
+    NumaVector<Particle> kept;
+    std::vector<double> kept_costs;
+    kept.reserve(local.size());
+    kept_costs.reserve(local.size());
+    int sent = 0;
+    for (int i = 0; i < local.size(); i++) {
+        int r = std::upper_bound(splits.begin(), splits.end(), (uint64_t)bins[i]) - splits.begin() - 1;
+        r = std::min(r, n_ranks - 1);
+        if (r == comm.getRank()) {
+            kept.push_back(local.get(i));
+            kept_costs.push_back(costs[i]);
+        } else {
+            outgoing[r].push_back(toRecord(local.get(i), costs[i]));
+            sent++;
+        }
+    }
+
+    std::vector<std::vector<char>> messages(n_ranks);
+    for (int r = 0; r < n_ranks; r++) {
+        messages[r] = Communicator::pack(outgoing[r]);
+    }
+    messages = comm.exchange(messages);
+    for (int r = 0; r < n_ranks; r++) {
+        if (r == comm.getRank()) continue;
+        for (const ParticleRecord& record : Communicator::unpack<ParticleRecord>(messages[r])) {
+            kept.push_back(fromRecord(record));
+            kept_costs.push_back(record.cost);
+        }
+    }
+
+    if (sent > 0 || kept.size() != (size_t)local.size()) previous_acc.clear(); // no longer in the order of local
+    local.particles = std::move(kept);
+    local.invalidate();
+    costs = std::move(kept_costs);
+    return sent;
+}
+
+int Decomposition::owner(uint64_t key) const {
+    if (splits.empty()) return 0;
+    uint64_t bin = key >> (3 * (Octree::max_level - bin_level));
+    int r = std::upper_bound(splits.begin(), splits.end(), bin) - splits.begin() - 1;
+    return std::min(r, comm.getSize() - 1);
+}
+
+long long Decomposition::globalCount(const ParticleSet& local) {
+    return comm.allreduce((long long)local.size(), [](long long a, long long b) {return a + b;});
+}
+
+
+
+/**
+ * ----------------
+ * !-- Top Tree --!
+ * ----------------
+ */
+
+void Decomposition::buildTopTree(const Octree& tree) {
+    std::vector<CellRecord> cells;
+    if (tree.size() > 0) {
+        for (int id : tree.subtrees(cells_per_rank)) {
+            const OctreeNode& node = tree.nodes[id];
+            Eigen::Vector3d lo = tree.positions[node.first], hi = lo;
+            for (int k = node.first + 1; k < node.first + node.count; k++) {
+                lo = lo.cwiseMin(tree.positions[k]);
+                hi = hi.cwiseMax(tree.positions[k]);
+            }
+            CellRecord cell;
+            for (int dim = 0; dim < 3; dim++) {
+                cell.min[dim] = lo[dim];
+                cell.max[dim] = hi[dim];
+                cell.com[dim] = node.com[dim];
+            }
+            cell.mass = node.mass;
+            cell.rank = comm.getRank();
+            cells.push_back(cell);
+        }
+    }
+
+    top_tree.clear();
+    for (const std::vector<char>& message : comm.allgather(Communicator::pack(cells))) {
+        for (const CellRecord& record : Communicator::unpack<CellRecord>(message)) {
+            DomainCell cell;
+            cell.min = Eigen::Vector3d(record.min);
+            cell.max = Eigen::Vector3d(record.max);
+            cell.mass = record.mass;
+            cell.com = Eigen::Vector3d(record.com);
+            cell.rank = record.rank;
+            top_tree.push_back(cell);
+        }
+    }
+}
+
+
+
+/**
+ * -------------
+ * !-- Halos --!
+ * -------------
+ */
+
+ParticleSet Decomposition::exchangeHalos(const ParticleSet& local, double radius) {
+    const int n_ranks = comm.getSize();
+    const std::optional<PeriodicBox> box = local.getPeriodicBox();
+    Octree tree(local);
+    buildTopTree(tree);
+
+    std::vector<std::vector<ParticleRecord>> outgoing(n_ranks);
+    std::vector<int> last(n_ranks);
+    for (int k = 0; k < tree.size(); k++) {
+        std::fill(last.begin(), last.end(), 0);
+        for (const DomainCell& cell : top_tree) {
+            if (cell.rank == comm.getRank() || last[cell.rank] || cell.distance(tree.positions[k], box) > radius) continue;
+            last[cell.rank] = 1;
+            Particle ghost = local.get(tree.index[k]);
+            if (box) {
+                // the image closest to the cell
+                Eigen::Vector3d center = 0.5 * (cell.min + cell.max);
+                ghost.position = center + box->minimumImage(tree.positions[k] - center);
+            }
+            outgoing[cell.rank].push_back(toRecord(ghost, 0.0));
+        }
+    }
+
+    std::vector<std::vector<char>> messages(n_ranks);
+    for (int r = 0; r < n_ranks; r++) {
+        messages[r] = Communicator::pack(outgoing[r]);
+    }
+    messages = comm.exchange(messages);
+
+    ParticleSet ghosts;
+    for (int r = 0; r < n_ranks; r++) {
+        if (r == comm.getRank()) continue;
+        for (const ParticleRecord& record : Communicator::unpack<ParticleRecord>(messages[r])) {
+            ghosts.particles.push_back(fromRecord(record));
+        }
+    }
+    ghosts.invalidate();
+    if (box) ghosts.setPeriodicBox(*box);
+    return ghosts;
+}
+
+
+
+/**
+ * ---------------
+ * !-- Gravity --!
+ * ---------------
+ */
+
+ParticleSet Decomposition::importGravitySources(const ParticleSet& local, double theta) {
+    const int n_ranks = comm.getSize();
+    const std::optional<PeriodicBox> box = local.getPeriodicBox();
+    Octree tree(local);
+    buildTopTree(tree);
+
+    std::vector<std::vector<PointMass>> outgoing(n_ranks);
+    if (tree.size() > 0) {
+        Parallel::forRange(n_ranks, [&](int begin, int end) {
+            for (int r = begin; r < end; r++) {
+                if (r == comm.getRank()) continue;
+                std::vector<const DomainCell*> cells;
+                for (const DomainCell& cell : top_tree) {
+                    if (cell.rank == r) cells.push_back(&cell);
+                }
+                if (cells.empty()) continue;
+
+                int stack[8 * (Octree::max_level + 1)];
+                int top = 0;
+                stack[top++] = 0;
+                while (top > 0) {
+                    const OctreeNode& node = tree.nodes[stack[--top]];
+                    double d = std::numeric_limits<double>::infinity();
+                    for (const DomainCell* cell : cells) {
+                        d = std::min(d, cell->distance(node.com, box));
+                    }
+                    // accepted for any particle of rank r => one point mass
+                    bool accepted = 2 * node.half_size < theta * d;
+                    if (box) accepted = accepted && d + 2 * node.half_size < box->side / 2;
+                    if (accepted) {
+                        outgoing[r].push_back({{node.com.x(), node.com.y(), node.com.z()}, node.mass});
+                    } else if (node.isLeaf()) {
+                        for (int k = node.first; k < node.first + node.count; k++) {
+                            outgoing[r].push_back({{tree.positions[k].x(), tree.positions[k].y(), tree.positions[k].z()}, tree.masses[k]});
+                        }
+                    } else {
+                        for (int c = 0; c < node.n_children; c++) {
+                            stack[top++] = node.children[c];
+                        }
+                    }
+                }
+            }
+        }, 1);
+    }
+
+    std::vector<std::vector<char>> messages(n_ranks);
+    for (int r = 0; r < n_ranks; r++) {
+        messages[r] = Communicator::pack(outgoing[r]);
+    }
+    messages = comm.exchange(messages);
+
+    ParticleSet sources;
+    for (int r = 0; r < n_ranks; r++) {
+        if (r == comm.getRank()) continue;
+        for (const PointMass& p : Communicator::unpack<PointMass>(messages[r])) {
+            sources.particles.push_back(Particle(Eigen::Vector3d(p.position), Eigen::Vector3d::Zero(), p.mass, -1)); // not particles: no id
+        }
+    }
+    sources.invalidate();
+    if (box) sources.setPeriodicBox(*box);
+    return sources;
+}
+
+std::vector<Eigen::Vector3d> Decomposition::accelerations(const ParticleSet& local, TreeGravity& solver, std::vector<double>& costs) {
+    const int n_local = local.size();
+    ParticleSet all(local);
+    all.add(importGravitySources(local, solver.getTheta())); // the local particles come first
+
+    // only the local particles are targets: the sources are in the tree, but do not walk it. What the solver remembers
+    // of its previous call is thus that of the local particles, costs migrated by balance() and accelerations dropped
+    // by it when the local order changes
+    solver.setPreviousCosts((int)costs.size() == n_local ? costs : std::vector<double>());
+    solver.setPreviousAccelerations((int)previous_acc.size() == n_local ? previous_acc : std::vector<Eigen::Vector3d>()); // else estimated by a geometric walk
+    std::vector<Eigen::Vector3d> acc = solver.accelerations(all, n_local);
+    costs = solver.getCosts();
+    previous_acc = acc;
+    return acc;
+}
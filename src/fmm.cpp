@@ -0,0 +1,134 @@
+#include "fmm.hpp"
+#include "parallel.hpp"
+#include <stdexcept>
+#include <algorithm>
+
+
+FmmGravity::FmmGravity(double softening, int order, double theta, double G, int leaf_size) : GravitySolver(softening, G), expansion(order), theta(theta), leaf_size(leaf_size) {
+    if (order < 1) throw std::invalid_argument("FmmGravity: the expansion order must be at least 1 (order 0 carries no force).");
+}
+
+std::vector<Eigen::Vector3d> FmmGravity::accelerations(const ParticleSet& ps) {
+    Octree tree(ps, leaf_size);
+    return tree.toSetOrder(accelerations(tree));
+}
+
+
+/**
+ * ---------------------
+ * !-- Main Pipeline --!
+ * ---------------------
+ */
+
+std::vector<Eigen::Vector3d> FmmGravity::accelerations(Octree& tree) {
+    if (tree.isPeriodic()) throw std::invalid_argument("FmmGravity: periodic boxes are not supported, use TreeGravity.");
+    tree.computeMultipoles(expansion); // upward pass
+    Parallel::Phase phase("fmm");
+
+    const int n_coef = expansion.count();
+    Workspace w = {
+        tree,
+        std::vector<double>(tree.nodes.size() * n_coef, 0.0),
+        std::vector<Eigen::Vector3d>(tree.size(), Eigen::Vector3d::Zero())
+    };
+
+    // every target subtree only writes into its own nodes and particles => no race
+    std::vector<int> front = tree.subtrees(8 * Parallel::getThreads());
+    std::pair<long long, long long> counts = Parallel::reduce<std::pair<long long, long long>>(front.size(), {0, 0},
+        [&](int begin, int end) {
+            std::pair<long long, long long> c = {0, 0};
+            for (int f = begin; f < end; f++) {
+                std::pair<long long, long long> cf = interact(w, front[f], 0);
+                c.first += cf.first;
+                c.second += cf.second;
+                downwardPass(w, front[f]);
+            }
+            return c;
+        },
+        [](std::pair<long long, long long> a, std::pair<long long, long long> b) {return std::make_pair(a.first + b.first, a.second + b.second);},
+        1
+    );
+    m2l_interactions = counts.first;
+    p2p_interactions = counts.second;
+
+    for (Eigen::Vector3d& a : w.acc) {
+        a *= G;
+    }
+    return w.acc;
+}
+
+
+/**
+ * ------------------------
+ * !-- Dual Tree Walk --!
+ * ------------------------
+ */
+
+std::pair<long long, long long> FmmGravity::interact(Workspace& w, int a, int b) const {
+    const OctreeNode& A = w.tree.nodes[a];
+    const OctreeNode& B = w.tree.nodes[b];
+    if (B.mass == 0) return {0, 0};
+
+    const int n_coef = expansion.count();
+    Eigen::Vector3d R = A.com - B.com;
+    double size = A.radius + B.radius;
+
+    // well separated: cell-cell interaction
+    if (size * size < theta * theta * R.squaredNorm()) {
+        expansion.multipoleToLocal(&w.locals[a * n_coef], w.tree.multipole(b), R); // M2L
+        return {1, 0};
+    }
+
+    // two leaves too close to each other: direct summation
+    if (A.isLeaf() && B.isLeaf()) {
+        const double eps2 = softening * softening;
+        for (int i = A.first; i < A.first + A.count; i++) {
+            Eigen::Vector3d acc = Eigen::Vector3d::Zero();
+            for (int j = B.first; j < B.first + B.count; j++) {
+                Eigen::Vector3d d = w.tree.positions[j] - w.tree.positions[i];
+                double r2 = d.squaredNorm() + eps2;
+                if (r2 == 0) continue; // the particle itself, without softening
+                double inv_r = 1.0 / std::sqrt(r2);
+                acc += w.tree.masses[j] * inv_r * inv_r * inv_r * d;
+            }
+            w.acc[i] += acc;
+        }
+        return {0, (long long)A.count * B.count};
+    }
+
+    // otherwise open the larger node
+    std::pair<long long, long long> counts = {0, 0};
+    bool split_a = !A.isLeaf() && (B.isLeaf() || A.radius >= B.radius);
+    const OctreeNode& split = split_a ? A : B;
+    for (int c = 0; c < split.n_children; c++) {
+        std::pair<long long, long long> cc = split_a ? interact(w, split.children[c], b) : interact(w, a, split.children[c]);
+        counts.first += cc.first;
+        counts.second += cc.second;
+    }
+    return counts;
+}
+
+
+/**
+ * ---------------------
+ * !-- Downward Pass --!
+ * ---------------------
+ */
+
+void FmmGravity::downwardPass(Workspace& w, int id) const {
+    const int n_coef = expansion.count();
+    const OctreeNode& node = w.tree.nodes[id];
+    const double* L = &w.locals[id * n_coef];
+
+    if (node.isLeaf()) {
+        for (int k = node.first; k < node.first + node.count; k++) {
+            w.acc[k] += expansion.localAcceleration(L, w.tree.positions[k] - node.com); // L2P
+        }
+        return;
+    }
+    for (int c = 0; c < node.n_children; c++) {
+        const OctreeNode& child = w.tree.nodes[node.children[c]];
+        expansion.translateLocal(&w.locals[node.children[c] * n_coef], L, child.com - node.com); // L2L
+        downwardPass(w, node.children[c]);
+    }
+}
@@ -0,0 +1,222 @@
+#include "friendsOfFriends.hpp"
+#include "parallel.hpp"
+#include "octree.hpp"
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+
+ConcurrentUnionFind::ConcurrentUnionFind(int n) : parent(std::max(0, n)) {
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) parent[i].store(i, std::memory_order_relaxed);
+    });
+}
+
+
+FriendsOfFriends::FriendsOfFriends(double linking_length, int min_members) : linking_length(linking_length), min_members(min_members) {
+    if (!(linking_length > 0)) throw std::invalid_argument("FriendsOfFriends: the linking length must be positive.");
+    if (min_members < 1) throw std::invalid_argument("FriendsOfFriends: groups need at least one member.");
+}
+
+double FriendsOfFriends::linkingLength(const ParticleSet& ps, double b) {
+    if (ps.size() == 0) throw std::invalid_argument("FriendsOfFriends::linkingLength: the set is empty.");
+    double volume;
+    if (ps.isPeriodic()) {
+        volume = std::pow(ps.getPeriodicBox()->side, 3);
+    } else {
+        const Eigen::Vector3d extent = ps.getStatistics().bbox_max - ps.getStatistics().bbox_min;
+        volume = extent.prod();
+    }
+    return b * std::cbrt(volume / ps.size());
+}
+
+
+
+/**
+ * ---------------
+ * !-- Linking --!
+ * ---------------
+ */
+
+const std::vector<FofGroup>& FriendsOfFriends::find(const ParticleSet& ps) {
+    Octree tree(ps);
+    return find(ps, tree);
+}
+
+const std::vector<FofGroup>& FriendsOfFriends::find(const ParticleSet& ps, const Octree& tree) {
+    const int n = ps.size();
+    if (tree.size() != n) throw std::invalid_argument("FriendsOfFriends::find: the tree was not built over this set.");
+    if (tree.isPeriodic() && 2 * linking_length >= tree.getPeriodicBox()->side) throw std::invalid_argument("FriendsOfFriends::find: the linking length must be smaller than half of the periodic box.");
+    ConcurrentUnionFind sets(n);
+    if (n > 0) {
+        Parallel::Phase phase("fof links");
+        const double b2 = linking_length * linking_length;
+        // every particle of a compact node is a friend of every other one
+        auto compact = [&](const OctreeNode& node) {return 2 * std::sqrt(3.0) * node.half_size <= linking_length;};
+
+        Parallel::forTree({0}, [&](int id, std::vector<int>& spawn) {
+            const OctreeNode& node = tree.nodes[id];
+            if (compact(node)) {
+                for (int k = node.first + 1; k < node.first + node.count; k++) sets.unite(tree.index[node.first], tree.index[k]);
+            } else {
+                spawn.assign(node.children, node.children + node.n_children);
+            }
+        });
+
+        // friendship is symmetric: particle k only looks for friends after it in tree order, and consecutive particles
+        // walk the same nodes
+        Parallel::forDynamic(n, [&](int begin, int end) {
+            int stack[8 * (Octree::max_level + 1)];
+            for (int k = begin; k < end; k++) {
+                const Eigen::Vector3d& x = tree.positions[k];
+                const int i = tree.index[k];
+                int top = 0;
+                stack[top++] = 0;
+                while (top > 0) {
+                    const OctreeNode& node = tree.nodes[stack[--top]];
+                    if (node.first + node.count <= k) continue;
+                    const Eigen::Vector3d d = tree.separation(x, node.center).cwiseAbs();
+                    const Eigen::Vector3d half = Eigen::Vector3d::Constant(node.half_size);
+                    if ((d - half).cwiseMax(0.0).squaredNorm() > b2) continue;
+
+                    if (compact(node)) {
+                        // a single set: one friend inside is enough, and none is needed once it is joined
+                        const int first = tree.index[node.first];
+                        if (sets.find(first) == sets.find(i)) continue;
+                        bool linked = (d + half).squaredNorm() <= b2;
+                        for (int j = node.first; j < node.first + node.count && !linked; j++) {
+                            linked = tree.separation(x, tree.positions[j]).squaredNorm() <= b2;
+                        }
+                        if (linked) sets.unite(i, first);
+                    } else if (node.isLeaf()) {
+                        for (int j = std::max(node.first, k + 1); j < node.first + node.count; j++) {
+                            if (tree.separation(x, tree.positions[j]).squaredNorm() <= b2) sets.unite(i, tree.index[j]);
+                        }
+                    } else {
+                        for (int c = 0; c < node.n_children; c++) stack[top++] = node.children[c];
+                    }
+                }
+            }
+        }, 256);
+    }
+    catalog(ps, sets);
+    return groups;
+}
+
+
+
+/**
+ * ---------------
+ * !-- Catalog --!
+ * ---------------
+ */
+
+void FriendsOfFriends::catalog(const ParticleSet& ps, ConcurrentUnionFind& sets) {
+    Parallel::Phase phase("fof catalog");
+    const int n = ps.size();
+    std::vector<int> roots(n);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) roots[i] = sets.find(i);
+    });
+
+    // catalog order: most members first, then first particle
+    std::vector<int> counts(n, 0);
+    for (int i = 0; i < n; i++) counts[roots[i]]++;
+    std::vector<int> kept;
+    for (int i = 0; i < n; i++) {
+        if (counts[i] >= min_members) kept.push_back(i); // roots[i] == i here
+    }
+    std::stable_sort(kept.begin(), kept.end(), [&](int a, int b) {return counts[a] > counts[b];});
+
+    const int n_groups = kept.size();
+    groups.assign(n_groups, FofGroup());
+    std::vector<int> group_of_root(n, -1);
+    std::vector<int> offsets(n_groups + 1, 0);
+    for (int g = 0; g < n_groups; g++) {
+        group_of_root[kept[g]] = g;
+        groups[g].members = counts[kept[g]];
+        groups[g].first = kept[g];
+        offsets[g + 1] = offsets[g] + counts[kept[g]];
+    }
+    labels.resize(n);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) labels[i] = group_of_root[roots[i]];
+    });
+
+    // members of every group, contiguous and by increasing index
+    std::vector<int> members(offsets[n_groups]);
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    for (int i = 0; i < n; i++) {
+        if (labels[i] >= 0) members[next[labels[i]]++] = i;
+    }
+
+    // relative to the first particle of the group: nearest images across the box, and less cancellation
+    struct Sums {
+        double mass = 0;
+        Eigen::Vector3d dx = Eigen::Vector3d::Zero(); // sum m (x - x_first)
+        Eigen::Vector3d dv = Eigen::Vector3d::Zero(); // sum m (v - v_first)
+        double dv2 = 0; // sum m |v - v_first|^2
+    };
+    const std::optional<PeriodicBox>& box = ps.getPeriodicBox();
+    auto sum = [&](int g, int begin, int end) {
+        const Particle& first = ps.get(groups[g].first);
+        Sums s;
+        for (int k = begin; k < end; k++) {
+            const Particle& p = ps.get(members[k]);
+            Eigen::Vector3d dx = p.position - first.position;
+            if (box) dx = box->minimumImage(dx);
+            const Eigen::Vector3d dv = p.velocity - first.velocity;
+            s.mass += p.mass;
+            s.dx += p.mass * dx;
+            s.dv += p.mass * dv;
+            s.dv2 += p.mass * dv.squaredNorm();
+        }
+        return s;
+    };
+    auto combine = [](const Sums& a, const Sums& b) {
+        return Sums{a.mass + b.mass, a.dx + b.dx, a.dv + b.dv, a.dv2 + b.dv2};
+    };
+    auto finish = [&](int g, const Sums& s) {
+        FofGroup& group = groups[g];
+        const Particle& first = ps.get(group.first);
+        group.mass = s.mass;
+        if (s.mass <= 0) return;
+        group.center_of_mass = first.position + s.dx / s.mass;
+        if (box) group.center_of_mass = box->wrap(group.center_of_mass);
+        group.velocity = first.velocity + s.dv / s.mass;
+        const Eigen::Vector3d mean_dv = s.dv / s.mass;
+        group.velocity_dispersion = std::sqrt(std::max(0.0, (s.dv2 / s.mass - mean_dv.squaredNorm()) / 3));
+    };
+
+    // large groups split over the workers, the others one task each (groups are sorted by size: large ones first)
+    const int large = std::max(Parallel::min_chunk, offsets[n_groups] / (8 * Parallel::getThreads()));
+    int n_large = 0;
+    while (n_large < n_groups && groups[n_large].members >= large) {
+        const int g = n_large++;
+        finish(g, Parallel::reduce<Sums>(groups[g].members, Sums(), [&](int begin, int end) {
+            return sum(g, offsets[g] + begin, offsets[g] + end);
+        }, combine));
+    }
+    std::vector<double> costs(n_groups - n_large);
+    for (int g = n_large; g < n_groups; g++) costs[g - n_large] = groups[g].members;
+    const std::vector<int> bounds = Parallel::partition(costs, 8 * Parallel::getThreads());
+    Parallel::forTasks(bounds.size() - 1, [&](int task) {
+        for (int g = n_large + bounds[task]; g < n_large + bounds[task + 1]; g++) {
+            finish(g, sum(g, offsets[g], offsets[g + 1]));
+        }
+    });
+}
+
+void FriendsOfFriends::export_csv(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file) throw std::runtime_error("FriendsOfFriends::export_csv: cannot open " + filename + ".");
+    file.precision(17);
+    file << "members,first,mass,x,y,z,vx,vy,vz,sigma\n";
+    for (const FofGroup& g : groups) {
+        file << g.members << "," << g.first << "," << g.mass << ","
+             << g.center_of_mass.x() << "," << g.center_of_mass.y() << "," << g.center_of_mass.z() << ","
+             << g.velocity.x() << "," << g.velocity.y() << "," << g.velocity.z() << "," << g.velocity_dispersion << "\n";
+    }
+    if (!file) throw std::runtime_error("FriendsOfFriends::export_csv: write failed.");
+}
@@ -0,0 +1,596 @@
+#include "gravity.hpp"
+#include "fmm.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+// -------------------- //
+// !-- Gravity Base --! //
+// -------------------- //
+
+std::unique_ptr<GravitySolver> GravitySolver::create(GravityMethod method, double softening, double theta, int order, double G) {
+    switch (method) {
+        case GravityMethod::Direct: return std::make_unique<DirectGravity>(softening, G);
+        case GravityMethod::Tree: return std::make_unique<TreeGravity>(softening, theta, G);
+        case GravityMethod::FMM: return std::make_unique<FmmGravity>(softening, order, theta, G);
+    }
+    throw std::invalid_argument("GravitySolver::create: unknown method.");
+}
+
+
+
+// ---------------------- //
+// !-- Direct Gravity --! //
+// ---------------------- //
+
+std::vector<Eigen::Vector3d> DirectGravity::accelerations(const ParticleSet& ps) {
+    std::vector<Eigen::Vector3d> targets(ps.size());
+    for (int i = 0; i < ps.size(); i++) {
+        targets[i] = ps.get(i).position;
+    }
+    return accelerations(targets, ps);
+}
+
+std::vector<Eigen::Vector3d> DirectGravity::accelerations(const std::vector<Eigen::Vector3d>& targets, const ParticleSet& sources) const {
+    if (sources.isPeriodic()) return periodicAccelerations(targets, sources);
+
+    // structure of arrays => contiguous, vectorizable loads in the inner loop
+    const int n_sources = sources.size();
+    std::vector<double> sx(n_sources), sy(n_sources), sz(n_sources), sm(n_sources);
+    for (int j = 0; j < n_sources; j++) {
+        const Particle& p = sources.get(j);
+        sx[j] = p.position.x();
+        sy[j] = p.position.y();
+        sz[j] = p.position.z();
+        sm[j] = p.mass;
+    }
+
+    const int n_targets = targets.size();
+    const double eps2 = softening * softening;
+    std::vector<Eigen::Vector3d> acc(n_targets, Eigen::Vector3d::Zero());
+
+    // each target costs n_sources interactions => small chunks are already worth a thread
+    Parallel::forRange(n_targets, [&](int begin, int end) {
+        for (int tile = 0; tile < n_sources; tile += tile_size) {
+            const int tile_end = std::min(tile + tile_size, n_sources);
+            for (int i = begin; i < end; i++) {
+                const double xi = targets[i].x(), yi = targets[i].y(), zi = targets[i].z();
+                double ax = 0, ay = 0, az = 0;
+                #pragma omp simd reduction(+:ax,ay,az)
+                for (int j = tile; j < tile_end; j++) {
+                    const double dx = sx[j] - xi;
+                    const double dy = sy[j] - yi;
+                    const double dz = sz[j] - zi;
+                    double r2 = dx * dx + dy * dy + dz * dz + eps2;
+                    r2 = r2 > 0 ? r2 : 1.0; // r2 == 0 only for self interaction without softening, where dx = dy = dz = 0 anyway
+                    const double inv_r = 1.0 / std::sqrt(r2);
+                    const double w = sm[j] * inv_r * inv_r * inv_r;
+                    ax += w * dx;
+                    ay += w * dy;
+                    az += w * dz;
+                }
+                acc[i] += Eigen::Vector3d(ax, ay, az);
+            }
+        }
+    }, 16);
+
+    for (Eigen::Vector3d& a : acc) {
+        a *= G;
+    }
+    return acc;
+}
+
+std::vector<Eigen::Vector3d> DirectGravity::periodicAccelerations(const std::vector<Eigen::Vector3d>& targets, const ParticleSet& sources) const {
+    const PeriodicBox box = *sources.getPeriodicBox();
+    const EwaldTable& ewald = EwaldTable::get();
+    const int n_sources = sources.size();
+    const double eps2 = softening * softening;
+    std::vector<Eigen::Vector3d> acc(targets.size(), Eigen::Vector3d::Zero());
+
+    // nearest image, plus the Ewald correction for all the others
+    Parallel::forRange(targets.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Eigen::Vector3d a = Eigen::Vector3d::Zero();
+            for (int j = 0; j < n_sources; j++) {
+                const Particle& p = sources.get(j);
+                Eigen::Vector3d d = box.minimumImage(p.position - targets[i]);
+                double r2 = d.squaredNorm() + eps2;
+                if (r2 == 0) continue; // the particle itself, without softening
+                double inv_r = 1.0 / std::sqrt(r2);
+                a += p.mass * (inv_r * inv_r * inv_r * d + ewald.correction(-d, box.side));
+            }
+            acc[i] = G * a;
+        }
+    }, 16);
+    return acc;
+}
+
+
+
+// -------------------- //
+// !-- Tree Gravity --! //
+// -------------------- //
+
+void TreeGravity::setMultipoleOrder(int order) {
+    if (order < 0) throw std::invalid_argument("TreeGravity::setMultipoleOrder: order must be non-negative.");
+    this->order = order;
+    expansion = Expansion(order);
+}
+
+void TreeGravity::setGroupSize(int size) {
+    if (size < 1) throw std::invalid_argument("TreeGravity::setGroupSize: groups hold at least one particle.");
+    group_size = size;
+}
+
+void TreeGravity::setOpeningCriterion(OpeningCriterion criterion, double alpha) {
+    this->criterion = criterion;
+    this->alpha = alpha;
+}
+
+void TreeGravity::setPreviousAccelerations(const std::vector<Eigen::Vector3d>& acc) {
+    previous_acc = std::vector<double>(acc.size());
+    for (int i = 0; i < (int)acc.size(); i++) {
+        previous_acc[i] = acc[i].norm();
+    }
+}
+
+std::vector<Eigen::Vector3d> TreeGravity::accelerations(const ParticleSet& ps) {
+    return accelerations(ps, ps.size());
+}
+
+std::vector<Eigen::Vector3d> TreeGravity::accelerations(const ParticleSet& ps, int n_targets) {
+    if (n_targets < 0 || n_targets > ps.size()) throw std::invalid_argument("TreeGravity::accelerations: the targets must be particles of the set.");
+    this->n_targets = n_targets;
+    Octree tree(ps, leaf_size);
+    std::vector<Eigen::Vector3d> acc = tree.toSetOrder(walkTree(tree));
+    acc.resize(n_targets); // the targets come first in the order of the set
+    costs = tree.toSetOrder(costs);
+    costs.resize(n_targets);
+    setPreviousAccelerations(acc);
+    return acc;
+}
+
+std::vector<Eigen::Vector3d> TreeGravity::accelerations(Octree& tree) {
+    n_targets = tree.size();
+    return walkTree(tree);
+}
+
+std::vector<Eigen::Vector3d> TreeGravity::walkTree(Octree& tree) {
+    if (order >= 2) tree.computeMultipoles(expansion);
+    Parallel::Phase phase("gravity walk");
+    std::vector<double> a_old = oldAccelerations(tree);
+    if (group_size > 1 && !tree.isPeriodic()) return walkGroups(tree, a_old, criterion);
+    return walkAll(tree, a_old, criterion);
+}
+
+std::vector<Eigen::Vector3d> TreeGravity::accelerations(const ParticleSet& ps, const Kernel& kernel, NeighborList& list) {
+    Octree tree(ps, leaf_size);
+    if (order >= 2) tree.computeMultipoles(expansion);
+    Parallel::Phase phase("gravity and neighbor walk");
+    const int n = tree.size();
+    n_targets = n;
+
+    NeighborGather gather;
+    gather.radii.resize(n);
+    for (int k = 0; k < n; k++) {
+        gather.radii[k] = list.searchRadius(ps.get(tree.index[k]), kernel);
+        if (tree.isPeriodic() && 2 * gather.radii[k] >= tree.getPeriodicBox()->side) throw std::invalid_argument("TreeGravity::accelerations: the search radius must be smaller than half of the periodic box.");
+    }
+    std::vector<Eigen::Vector3d> acc = tree.toSetOrder(walkAll(tree, oldAccelerations(tree), criterion, &gather));
+    costs = tree.toSetOrder(costs);
+    setPreviousAccelerations(acc);
+
+    // ranges are in tree order: concatenated, they are the lists in tree order, which are then moved to set order
+    std::vector<int> tree_offsets(n + 1, 0), offsets(n + 1, 0);
+    for (int k = 0; k < n; k++) {
+        tree_offsets[k + 1] = tree_offsets[k] + gather.counts[k];
+        offsets[tree.index[k] + 1] = gather.counts[k];
+    }
+    for (int i = 0; i < n; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<int> found;
+    found.reserve(tree_offsets[n]);
+    for (const std::vector<int>& range : gather.ranges) {
+        found.insert(found.end(), range.begin(), range.end());
+    }
+    std::vector<int> indices(offsets[n]);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            auto first = indices.begin() + offsets[tree.index[k]];
+            std::copy(found.begin() + tree_offsets[k], found.begin() + tree_offsets[k + 1], first);
+            std::sort(first, first + gather.counts[k]);
+        }
+    }, 256);
+    list.assign(ps, kernel, std::move(offsets), std::move(indices));
+    return acc;
+}
+
+std::vector<double> TreeGravity::oldAccelerations(const Octree& tree) {
+    if (criterion == OpeningCriterion::Geometric) return {};
+
+    // |a_old| in tree order, estimated with a geometric walk if there is no previous step. Only targets walk the tree
+    std::vector<double> a_old(tree.size(), 0.0);
+    if ((int)previous_acc.size() == n_targets) {
+        for (int k = 0; k < tree.size(); k++) {
+            if (isTarget(tree, k)) a_old[k] = previous_acc[tree.index[k]];
+        }
+    } else {
+        std::vector<Eigen::Vector3d> estimate = walkAll(tree, {}, OpeningCriterion::Geometric);
+        for (int k = 0; k < tree.size(); k++) {
+            a_old[k] = estimate[k].norm();
+        }
+    }
+    return a_old;
+}
+
+std::vector<double> TreeGravity::previousCosts(const Octree& tree) const {
+    std::vector<double> weights(tree.size(), 0.0);
+    const bool known = (int)previous_costs.size() == n_targets;
+    for (int k = 0; k < tree.size(); k++) {
+        if (!isTarget(tree, k)) continue;
+        weights[k] = 1.0 + (known ? previous_costs[tree.index[k]] : 0.0); // + 1: a particle without interactions still costs a little
+    }
+    return weights;
+}
+
+void TreeGravity::updateCosts(const Octree& tree) {
+    previous_costs.resize(n_targets);
+    for (int k = 0; k < tree.size(); k++) {
+        if (isTarget(tree, k)) previous_costs[tree.index[k]] = costs[k];
+    }
+}
+
+std::vector<Eigen::Vector3d> TreeGravity::walkAll(const Octree& tree, const std::vector<double>& a_old, OpeningCriterion criterion, NeighborGather* gather) {
+    // targets in tree order => neighbouring targets walk through the same nodes. Ranges of about equal cost
+    // (interactions at the previous call), several per worker, are then balanced by work stealing
+    const std::vector<int> bounds = Parallel::partition(previousCosts(tree), 8 * Parallel::getThreads());
+    const int n_tasks = bounds.size() - 1;
+    std::vector<Eigen::Vector3d> acc(tree.size());
+    costs = std::vector<double>(tree.size());
+    if (gather) {
+        gather->counts.assign(tree.size(), 0);
+        gather->ranges.assign(n_tasks, std::vector<int>());
+    }
+
+    std::vector<std::pair<long long, long long>> counts(n_tasks, {0, 0});
+    Parallel::forTasks(n_tasks, [&](int task) {
+        long long nodes = 0, particles = 0;
+        std::vector<int>* neighbors = gather ? &gather->ranges[task] : nullptr;
+        for (int k = bounds[task]; k < bounds[task + 1]; k++) {
+            if (!isTarget(tree, k)) continue;
+            long long before = nodes + particles;
+            size_t listed = neighbors ? neighbors->size() : 0;
+            acc[k] = G * walk(tree, tree.positions[k], a_old.empty() ? 0.0 : a_old[k], criterion, nodes, particles,
+                              gather ? gather->radii[k] : 0.0, neighbors);
+            costs[k] = nodes + particles - before;
+            if (gather) gather->counts[k] = neighbors->size() - listed;
+        }
+        counts[task] = std::make_pair(nodes, particles);
+    });
+
+    node_interactions = particle_interactions = 0;
+    for (const std::pair<long long, long long>& c : counts) {
+        node_interactions += c.first;
+        particle_interactions += c.second;
+    }
+    walks = n_targets;
+    updateCosts(tree);
+    return acc;
+}
+
+std::vector<Eigen::Vector3d> TreeGravity::walkGroups(const Octree& tree, const std::vector<double>& a_old, OpeningCriterion criterion) {
+    const int n = tree.size();
+    std::vector<Eigen::Vector3d> acc(n);
+    costs = std::vector<double>(n);
+    const double eps2 = softening * softening;
+    const bool quadrupole = order >= 2;
+    const int Sxx = quadrupole ? expansion.index(2, 0, 0) : 0, Syy = quadrupole ? expansion.index(0, 2, 0) : 0, Szz = quadrupole ? expansion.index(0, 0, 2) : 0;
+    const int Sxy = quadrupole ? expansion.index(1, 1, 0) : 0, Sxz = quadrupole ? expansion.index(1, 0, 1) : 0, Syz = quadrupole ? expansion.index(0, 1, 1) : 0;
+
+    // interaction list of the current group, as structures of arrays for the vectorized loops:
+    // particles of the opened leaves, and accepted nodes (monopole and second moments S_ij = sum m d_i d_j)
+    struct Workspace {
+        std::vector<double> px, py, pz, pm;
+        std::vector<double> nx, ny, nz, nm, sxx, syy, szz, sxy, sxz, syz;
+        std::vector<int> accepted;
+        long long nodes = 0, particles = 0, walks = 0;
+    };
+    std::vector<Workspace> workspaces(Parallel::getThreads());
+
+    auto walkGroup = [&](int group_id) {
+        auto& [px, py, pz, pm, nx, ny, nz, nm, sxx, syy, szz, sxy, sxz, syz, accepted, nodes, particles, walks] = workspaces[Parallel::worker()];
+        int stack[8 * (Octree::max_level + 1)];
+        const OctreeNode& group = tree.nodes[group_id];
+        if (group.count == 0) return;
+        const int first = group.first, last = group.first + group.count;
+        Eigen::Vector3d lo = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity()), hi = -lo;
+        double group_a_old = std::numeric_limits<double>::infinity();
+        int members = 0; // the targets of the group: the other particles only act as sources
+        for (int k = first; k < last; k++) {
+            if (!isTarget(tree, k)) continue;
+            lo = lo.cwiseMin(tree.positions[k]);
+            hi = hi.cwiseMax(tree.positions[k]);
+            if (!a_old.empty()) group_a_old = std::min(group_a_old, a_old[k]);
+            members++;
+        }
+        if (members == 0) return;
+        if (a_old.empty()) group_a_old = 0.0;
+        const Eigen::Vector3d center = 0.5 * (lo + hi), extent = 0.5 * (hi - lo);
+
+        // one walk for the whole group: a node is accepted only if it is for every point of its bounding box
+        for (std::vector<double>* v : {&px, &py, &pz, &pm, &nx, &ny, &nz, &nm, &sxx, &syy, &szz, &sxy, &sxz, &syz}) v->clear();
+        accepted.clear();
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            int id = stack[--top];
+            const OctreeNode& node = tree.nodes[id];
+            double r2 = ((node.com - center).cwiseAbs() - extent).cwiseMax(0.0).squaredNorm();
+            if (accept(tree, node, center, extent, r2, group_a_old, criterion)) {
+                accepted.push_back(id);
+                nx.push_back(node.com.x());
+                ny.push_back(node.com.y());
+                nz.push_back(node.com.z());
+                nm.push_back(node.mass);
+                if (quadrupole) {
+                    const double* M = tree.multipole(id);
+                    sxx.push_back(M[Sxx]);
+                    syy.push_back(M[Syy]);
+                    szz.push_back(M[Szz]);
+                    sxy.push_back(M[Sxy]);
+                    sxz.push_back(M[Sxz]);
+                    syz.push_back(M[Syz]);
+                }
+            } else if (node.isLeaf()) {
+                for (int k = node.first; k < node.first + node.count; k++) {
+                    px.push_back(tree.positions[k].x());
+                    py.push_back(tree.positions[k].y());
+                    pz.push_back(tree.positions[k].z());
+                    pm.push_back(tree.masses[k]);
+                }
+            } else {
+                for (int c = 0; c < node.n_children; c++) {
+                    stack[top++] = node.children[c];
+                }
+            }
+        }
+
+        // the same list for every member
+        const int n_particles = px.size(), n_nodes = nx.size();
+        for (int k = first; k < last; k++) {
+            if (!isTarget(tree, k)) continue;
+            const double xi = tree.positions[k].x(), yi = tree.positions[k].y(), zi = tree.positions[k].z();
+            double ax = 0, ay = 0, az = 0;
+            #pragma omp simd reduction(+:ax,ay,az)
+            for (int j = 0; j < n_particles; j++) {
+                const double dx = px[j] - xi;
+                const double dy = py[j] - yi;
+                const double dz = pz[j] - zi;
+                double r2 = dx * dx + dy * dy + dz * dz + eps2;
+                r2 = r2 > 0 ? r2 : 1.0; // the particle itself without softening, where dx = dy = dz = 0 anyway
+                const double inv_r = 1.0 / std::sqrt(r2);
+                const double w = pm[j] * inv_r * inv_r * inv_r;
+                ax += w * dx;
+                ay += w * dy;
+                az += w * dz;
+            }
+            #pragma omp simd reduction(+:ax,ay,az)
+            for (int j = 0; j < n_nodes; j++) {
+                const double dx = nx[j] - xi;
+                const double dy = ny[j] - yi;
+                const double dz = nz[j] - zi;
+                const double inv_r = 1.0 / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+                const double w = nm[j] * inv_r * inv_r * inv_r;
+                ax += w * dx;
+                ay += w * dy;
+                az += w * dz;
+            }
+            if (quadrupole) {
+                // grad of (3 R.S.R - r^2 tr S) / (2 r^5), R = x - com, as in Expansion::quadrupoleAcceleration
+                #pragma omp simd reduction(+:ax,ay,az)
+                for (int j = 0; j < n_nodes; j++) {
+                    const double rx = xi - nx[j];
+                    const double ry = yi - ny[j];
+                    const double rz = zi - nz[j];
+                    const double inv_r2 = 1.0 / (rx * rx + ry * ry + rz * rz);
+                    const double inv_r5 = inv_r2 * inv_r2 * std::sqrt(inv_r2);
+                    const double srx = sxx[j] * rx + sxy[j] * ry + sxz[j] * rz;
+                    const double sry = sxy[j] * rx + syy[j] * ry + syz[j] * rz;
+                    const double srz = sxz[j] * rx + syz[j] * ry + szz[j] * rz;
+                    const double trace = 1.5 * (sxx[j] + syy[j] + szz[j]);
+                    const double radial = 7.5 * (rx * srx + ry * sry + rz * srz) * inv_r2;
+                    ax += inv_r5 * (3.0 * srx + (trace - radial) * rx);
+                    ay += inv_r5 * (3.0 * sry + (trace - radial) * ry);
+                    az += inv_r5 * (3.0 * srz + (trace - radial) * rz);
+                }
+            }
+            Eigen::Vector3d a(ax, ay, az);
+            if (order >= 3) {
+                for (int id : accepted) {
+                    a += expansion.multipoleAcceleration(tree.multipole(id), tree.positions[k] - tree.nodes[id].com, 3);
+                }
+            }
+            acc[k] = G * a;
+            costs[k] = n_particles + n_nodes;
+        }
+        nodes += (long long)members * n_nodes;
+        particles += (long long)members * n_particles;
+        walks++;
+    };
+
+    // groups are the largest nodes with at most group_size particles. The tree is cut into tasks of about equal cost
+    // (interactions at the previous call): a node that costs more is split into its children, which idle workers steal
+    std::vector<double> weights = previousCosts(tree), prefix(n + 1, 0.0);
+    for (int k = 0; k < n; k++) {
+        prefix[k + 1] = prefix[k] + weights[k];
+    }
+    const double task_cost = prefix[n] / (8 * Parallel::getThreads());
+    auto isGroup = [&](const OctreeNode& node) {return node.count <= group_size || node.isLeaf();};
+    Parallel::forTree({0}, [&](int id, std::vector<int>& spawn) {
+        const OctreeNode& node = tree.nodes[id];
+        if (!isGroup(node) && prefix[node.first + node.count] - prefix[node.first] > task_cost) {
+            spawn.assign(node.children, node.children + node.n_children);
+            return;
+        }
+        for (int g = id; g < node.next;) {
+            if (isGroup(tree.nodes[g])) {
+                walkGroup(g);
+                g = tree.nodes[g].next;
+            } else {
+                g++;
+            }
+        }
+    });
+
+    node_interactions = particle_interactions = walks = 0;
+    for (const Workspace& w : workspaces) {
+        node_interactions += w.nodes;
+        particle_interactions += w.particles;
+        walks += w.walks;
+    }
+    updateCosts(tree);
+    return acc;
+}
+
+
+
+bool TreeGravity::accept(const Octree& tree, const OctreeNode& node, const Eigen::Vector3d& x, const Eigen::Vector3d& extent, double r2, double a_old, OpeningCriterion criterion) const {
+    Eigen::Vector3d offset = tree.separation(x, node.center).cwiseAbs();
+    if ((offset - extent).maxCoeff() <= node.half_size) return false; // the particle (or part of the group) is inside
+    // periodic: the node must lie within the nearest image half box around x, otherwise its own images are mixed
+    if (tree.isPeriodic() && (offset + extent).maxCoeff() + node.half_size > tree.getPeriodicBox()->side / 2) return false;
+
+    const double side = 2 * node.half_size;
+    const int p = std::max(order, 1); // the dipole vanishes about the center of mass
+    if (criterion == OpeningCriterion::Geometric) return side * side < theta * theta * r2;
+
+    double d = std::sqrt(r2);
+    if (criterion == OpeningCriterion::Relative) {
+        double ratio = side / d;
+        double bound = G * node.mass / r2;
+        for (int i = 0; i <= p; i++) bound *= ratio; // (l / d)^(p+1)
+        return bound < alpha * a_old;
+    }
+
+    // Salmon-Warren: |da| <= G / (d - b)^2 * ((p+2) B_(p+1) / d^(p+1) - (p+1) B_(p+2) / d^(p+2)), for d > b
+    if (d <= node.radius || p + 2 > 5) return side * side < theta * theta * r2; // no bound available
+    double dp = d;
+    for (int i = 0; i < p; i++) dp *= d; // d^(p+1)
+    double bound = G / ((d - node.radius) * (d - node.radius)) * ((p + 2) * node.B[p + 1] / dp - (p + 1) * node.B[p + 2] / (dp * d));
+    return bound < alpha * a_old;
+}
+
+Eigen::Vector3d TreeGravity::walk(const Octree& tree, const Eigen::Vector3d& x, double a_old, OpeningCriterion criterion, long long& n_nodes, long long& n_particles,
+                                  double radius, std::vector<int>* neighbors) const {
+    const double eps2 = softening * softening;
+    const double radius2 = radius * radius;
+    const bool periodic = tree.isPeriodic();
+    const double box_side = periodic ? tree.getPeriodicBox()->side : 0;
+    const EwaldTable* ewald = periodic ? &EwaldTable::get() : nullptr;
+    Eigen::Vector3d acc = Eigen::Vector3d::Zero();
+
+    int stack[8 * (Octree::max_level + 1)]; // at most 7 siblings waiting per level
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        int id = stack[--top];
+        const OctreeNode& node = tree.nodes[id];
+        Eigen::Vector3d d = tree.separation(node.com, x);
+        double r2 = d.squaredNorm();
+        bool near = false; // does the cell intersect the neighbor search sphere?
+        if (neighbors) {
+            Eigen::Vector3d excess = (tree.separation(x, node.center).cwiseAbs() - Eigen::Vector3d::Constant(node.half_size)).cwiseMax(0.0);
+            near = excess.squaredNorm() <= radius2;
+        }
+
+        if (accept(tree, node, x, r2, a_old, criterion)) {
+            // the whole node acts through its (softened) mass and its higher order moments
+            double inv_r = 1.0 / std::sqrt(r2 + eps2);
+            acc += node.mass * inv_r * inv_r * inv_r * d;
+            if (order >= 2) acc += expansion.quadrupoleAcceleration(tree.multipole(id), -d);
+            if (order >= 3) acc += expansion.multipoleAcceleration(tree.multipole(id), -d, 3);
+            if (periodic) acc += node.mass * ewald->correction(-d, box_side);
+            n_nodes++;
+            if (near) { // rare: only with a large opening angle or search radius
+                for (int k = node.first; k < node.first + node.count; k++) {
+                    if (tree.separation(tree.positions[k], x).squaredNorm() <= radius2) neighbors->push_back(tree.index[k]);
+                }
+            }
+        } else if (node.isLeaf()) {
+            for (int k = node.first; k < node.first + node.count; k++) {
+                Eigen::Vector3d dk = tree.separation(tree.positions[k], x);
+                if (near && dk.squaredNorm() <= radius2) neighbors->push_back(tree.index[k]);
+                double rk2 = dk.squaredNorm() + eps2;
+                if (rk2 == 0) continue; // the particle itself, without softening
+                double inv_r = 1.0 / std::sqrt(rk2);
+                acc += tree.masses[k] * inv_r * inv_r * inv_r * dk;
+                if (periodic) acc += double(tree.masses[k]) * ewald->correction(-dk, box_side);
+            }
+            n_particles += node.count;
+        } else {
+            for (int c = 0; c < node.n_children; c++) {
+                stack[top++] = node.children[c];
+            }
+        }
+    }
+    return acc;
+}
+
+
+
+// ------------------- //
+// !-- Force Error --! //
+// ------------------- //
+
+ForceError ForceError::compare(const std::vector<Eigen::Vector3d>& reference, const std::vector<Eigen::Vector3d>& approximation) {
+    if (reference.size() != approximation.size()) throw std::invalid_argument("ForceError::compare: reference and approximation must have the same size.");
+
+    ForceError error;
+    error.count = reference.size();
+    if (error.count == 0) return error;
+
+    error.sorted_errors.resize(error.count);
+    for (int i = 0; i < error.count; i++) {
+        double norm = reference[i].norm();
+        double diff = (approximation[i] - reference[i]).norm();
+        error.sorted_errors[i] = norm > 0 ? diff / norm : diff;
+    }
+    std::sort(error.sorted_errors.begin(), error.sorted_errors.end());
+
+    double sum = 0, sum2 = 0;
+    for (double e : error.sorted_errors) {
+        sum += e;
+        sum2 += e * e;
+    }
+    auto percentile = [&](double q) {return error.sorted_errors[std::min(error.count - 1, (int)(q * error.count))];};
+
+    error.mean = sum / error.count;
+    error.rms = std::sqrt(sum2 / error.count);
+    error.median = percentile(0.5);
+    error.p90 = percentile(0.9);
+    error.p99 = percentile(0.99);
+    error.max = error.sorted_errors.back();
+    return error;
+}
+
+double ForceError::fractionAbove(double threshold) const {
+    if (count == 0) return 0;
+    auto it = std::upper_bound(sorted_errors.begin(), sorted_errors.end(), threshold);
+    return (double)(sorted_errors.end() - it) / count;
+}
+
+void ForceError::display(std::string name) const {
+    Message::print(cstr(name).blue() + " <" + cstr("#").green() + cstr(count).green() + ">:");
+    Message::tab();
+    Message::print("- Mean relative error: " + std::to_string(mean));
+    Message::print("- RMS relative error: " + std::to_string(rms));
+    Message::print("- Median: " + std::to_string(median) + ", 90%: " + std::to_string(p90) + ", 99%: " + std::to_string(p99));
+    Message::print("- Max: " + std::to_string(max));
+    Message::print("- Above 0.1%: " + std::to_string(100 * fractionAbove(1e-3)) + "% of the particles");
+    Message::untab();
+}
@@ -0,0 +1,148 @@
+#include "initialConditions.hpp"
+#include "neighborSearch.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <stdexcept>
+
+
+namespace {
+
+/**
+ * @brief Builds n particles of mass 1 / n in parallel, particle i being set by draw(random, position, velocity)
+ * from its own random stream. Ids are reserved as one block, particle i getting the i-th.
+ */
+template <typename Draw>
+ParticleSet generate(int n, uint64_t seed, Draw draw) {
+    if (n < 0) throw std::invalid_argument("InitialConditions: the number of particles must be non-negative.");
+    const Philox rng(seed);
+    const int64_t first_id = Particle::reserveIds(n);
+
+    ParticleSet ps;
+    ps.particles.assign(n, Particle(Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), 0.0, 0));
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            RandomStream random(rng, i);
+            Eigen::Vector3d position, velocity = Eigen::Vector3d::Zero();
+            draw(random, position, velocity);
+            ps.particles[i] = Particle(position, velocity, 1.0 / n, first_id + i);
+        }
+    });
+    ps.invalidate();
+    return ps;
+}
+
+Eigen::Vector3d isotropic(RandomStream& random) {
+    double cos_theta = random.uniform(-1.0, 1.0);
+    double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
+    double phi = random.uniform(0.0, 2 * M_PI);
+    return Eigen::Vector3d(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+}
+
+}
+
+
+
+// ------------------------ //
+// !-- Uniform Profiles --! //
+// ------------------------ //
+
+ParticleSet InitialConditions::uniformCube(int n, uint64_t seed, double side) {
+    return generate(n, seed, [&](RandomStream& random, Eigen::Vector3d& x, Eigen::Vector3d&) {
+        x = Eigen::Vector3d(random.uniform(), random.uniform(), random.uniform()) * side;
+    });
+}
+
+ParticleSet InitialConditions::uniformSphere(int n, uint64_t seed, double radius) {
+    return generate(n, seed, [&](RandomStream& random, Eigen::Vector3d& x, Eigen::Vector3d&) {
+        x = radius * std::cbrt(random.uniform()) * isotropic(random);
+    });
+}
+
+
+
+// --------------------------- //
+// !-- Equilibrium Spheres --! //
+// --------------------------- //
+
+ParticleSet InitialConditions::plummer(int n, uint64_t seed, double a, double r_max) {
+    // enclosed mass M(r) = r^3 / (r^2 + a^2)^(3/2), inverted
+    const double x_max = std::pow(r_max * r_max / (r_max * r_max + a * a), 1.5);
+    return generate(n, seed, [&](RandomStream& random, Eigen::Vector3d& x, Eigen::Vector3d& v) {
+        double m = x_max * (1.0 - random.uniform()); // in (0, x_max]
+        double r = a / std::sqrt(std::pow(m, -2.0 / 3.0) - 1.0);
+        x = r * isotropic(random);
+
+        // speed as a fraction q of the escape speed, g(q) = q^2 (1 - q^2)^(7/2) by rejection (max of g < 0.1)
+        double q, y;
+        do {
+            q = random.uniform();
+            y = 0.1 * random.uniform();
+        } while (y > q * q * std::pow(1.0 - q * q, 3.5));
+        double escape = std::sqrt(2.0) * std::pow(r * r + a * a, -0.25);
+        v = q * escape * isotropic(random);
+    });
+}
+
+ParticleSet InitialConditions::hernquist(int n, uint64_t seed, double a, double r_max) {
+    // enclosed mass M(r) = r^2 / (r + a)^2, inverted
+    const double x_max = (r_max / (r_max + a)) * (r_max / (r_max + a));
+    return generate(n, seed, [&](RandomStream& random, Eigen::Vector3d& x, Eigen::Vector3d& v) {
+        double s = std::sqrt(x_max * random.uniform());
+        double r = a * s / (1.0 - s);
+        x = r * isotropic(random);
+
+        // isotropic Jeans dispersion, Hernquist (1990) eq. 10
+        double u = r / a;
+        double sigma2 = 1.0 / (12.0 * a) * (12.0 * u * std::pow(1.0 + u, 3) * std::log((1.0 + u) / u) - u / (1.0 + u) * (25.0 + 52.0 * u + 42.0 * u * u + 12.0 * u * u * u));
+        double sigma = std::sqrt(std::max(sigma2, 0.0));
+        double escape2 = 2.0 / (r + a);
+        do {
+            v = sigma * Eigen::Vector3d(random.normal(), random.normal(), random.normal());
+        } while (v.squaredNorm() >= escape2);
+    });
+}
+
+
+
+// ------------- //
+// !-- Glass --! //
+// ------------- //
+
+ParticleSet InitialConditions::glass(int n, uint64_t seed, double side, int iterations) {
+    ParticleSet ps = uniformCube(n, seed, side);
+    ps.setPeriodicBox(PeriodicBox(side));
+    if (n < 2) return ps;
+
+    // each particle is pushed away from its neighbors within h, all at once (from the same positions), so the result
+    // does not depend on the order of the updates
+    const double spacing = side / std::cbrt(n);
+    const double h = std::min(2.0 * spacing, 0.49 * side);
+    const double step = 0.1 * spacing;
+    const PeriodicBox box = *ps.getPeriodicBox();
+    std::vector<Eigen::Vector3d> displacement(n);
+    for (int it = 0; it < iterations; it++) {
+        CellGrid grid(ps, h);
+        Parallel::forRange(n, [&](int begin, int end) {
+            std::vector<int> found;
+            for (int i = begin; i < end; i++) {
+                const Eigen::Vector3d& xi = ps.particles[i].position;
+                grid.neighbors(xi, h, found);
+                Eigen::Vector3d push = Eigen::Vector3d::Zero();
+                for (int j : found) {
+                    Eigen::Vector3d d = box.minimumImage(xi - ps.particles[j].position);
+                    double r = d.norm();
+                    if (r == 0) continue;
+                    double w = 1.0 - r / h;
+                    push += w * w * d / r;
+                }
+                double norm = push.norm();
+                displacement[i] = norm > 1.0 ? Eigen::Vector3d(push / norm) : push; // at most one step
+            }
+        }, 256);
+        for (int i = 0; i < n; i++) {
+            ps.particles[i].position = box.wrap(ps.particles[i].position + step * displacement[i]);
+        }
+        ps.invalidate();
+    }
+    return ps;
+}
@@ -4,26 +4,53 @@
 // !-- Kernel Base --! //
 // ------------------- //
 
-double Kernel::operator()(double r) const {
+template <typename Real>
+Real BasicKernel<Real>::operator()(Real r) const {
+    return (*this)(r, h);
+}
+
+template <typename Real>
+Real BasicKernel<Real>::operator()(const Vector3& r) const {
+    return (*this)(r.norm(), h);
+}
+
+template <typename Real>
+typename BasicKernel<Real>::Vector3 BasicKernel<Real>::gradient(const Vector3& r) const {
+    return gradient(r, h);
+}
+
+template <typename Real>
+Real BasicKernel<Real>::operator()(Real r, Real h) const {
     if (r >= h) {return 0;};
-    return W(r/h) / V() / std::pow(h, 3); // Kernel homogenous to L^-3
+    return W(r/h) / V() / (h * h * h); // Kernel homogenous to L^-3
+}
+
+template <typename Real>
+Real BasicKernel<Real>::operator()(const Vector3& r, Real h) const {
+    return (*this)(r.norm(), h);
 }
 
-double Kernel::operator()(const Eigen::Vector3d& r) const {
-    return (*this)(r.norm());
+template <typename Real>
+typename BasicKernel<Real>::Vector3 BasicKernel<Real>::gradient(const Vector3& r, Real h) const {
+    Real norm = r.norm();
+    if (norm >= h || norm == Real(0)) return Vector3::Zero();
+    return ddr(norm / h) * r / norm / V() / (h * h * h * h); // Kernel derivative homogenous to L^-3 * L^-1
 }
 
-Eigen::Vector3d Kernel::gradient(const Eigen::Vector3d& r) const {
-    if (r.norm() >= h || r.norm() == 0.0) return Eigen::Vector3d::Zero();
-    return ddr(r.norm() / h) * r.normalized() / V() / std::pow(h, 4); // Kernel derivative homogenous to L^-3 * L^-1
+template <typename Real>
+Real BasicKernel<Real>::dh(Real r, Real h) const {
+    if (r >= h) return 0;
+    Real u = r / h;
+    return -(3 * W(u) + u * ddr(u)) / V() / (h * h * h * h); // d/dh [W(r/h) / h^3]
 }
 
 
-double Kernel::computeIntegral() const {
-    double s = 0;
+template <typename Real>
+Real BasicKernel<Real>::computeIntegral() const {
+    double s = 0; // summed in double whatever Real is
     double dr = 0.001; // we can assume spherically symetric kernel in 3d
     for (double r = 0; r < h; r += dr) {
-        s += (*this)(r) * 4 * M_PI * r * r * dr;
+        s += (*this)(Real(r)) * 4 * M_PI * r * r * dr;
     }
     return s;
 }
@@ -35,33 +62,68 @@ double Kernel::computeIntegral() const {
 // !-- LinearKernel --! //
 // -------------------- //
 
-double LinearKernel::W(double u) const {
-    return 1.0 - u;
+template <typename Real>
+Real BasicLinearKernel<Real>::W(Real u) const {
+    return Real(1) - u;
 }
 
-double LinearKernel::V() const {
-    return 1.0/3 * M_PI;
+template <typename Real>
+Real BasicLinearKernel<Real>::V() const {
+    return Real(1.0/3 * M_PI);
 }
 
-double LinearKernel::ddr(double u) const {
+template <typename Real>
+Real BasicLinearKernel<Real>::ddr(Real u) const {
     return -1;
 }
 
+template <typename Real>
+void BasicLinearKernel<Real>::shape(Real u, Real& w, Real& dw) const {
+    const Real inv_volume = Real(3 / M_PI);
+    w = (1 - u) * inv_volume;
+    dw = -inv_volume;
+}
+
 
 
 // --------------------- //
 // !-- QuarticKernel --! //
 // --------------------- //
 
-double QuarticKernel::W(double u) const {
-    if (u >= 1) return 0.0;
-    return std::pow(1 - std::pow(u, 2), 2);
+template <typename Real>
+Real BasicQuarticKernel<Real>::W(Real u) const {
+    if (u >= 1) return 0;
+    Real a = 1 - u * u;
+    return a * a;
+}
+
+template <typename Real>
+Real BasicQuarticKernel<Real>::V() const {
+    return Real(32.0 * M_PI / 105.0);
+}
+
+template <typename Real>
+Real BasicQuarticKernel<Real>::ddr(Real u) const {
+    return -4 * (1 - u * u) * u;
 }
 
-double QuarticKernel::V() const {
-    return 32.0 * M_PI / 105.0;
+template <typename Real>
+void BasicQuarticKernel<Real>::shape(Real u, Real& w, Real& dw) const {
+    const Real inv_volume = Real(105.0 / (32.0 * M_PI));
+    const Real a = 1 - u * u;
+    w = a * a * inv_volume;
+    dw = -4 * a * u * inv_volume;
 }
 
-double QuarticKernel::ddr(double u) const {
-    return -4.0 * (1 - std::pow(u, 2)) * u;
-}
\ No newline at end of file
+
+
+// ---------------------- //
+// !-- Instantiations --! //
+// ---------------------- //
+
+template class BasicKernel<float>;
+template class BasicKernel<double>;
+template class BasicLinearKernel<float>;
+template class BasicLinearKernel<double>;
+template class BasicQuarticKernel<float>;
+template class BasicQuarticKernel<double>;
@@ -0,0 +1,41 @@
+#include "memory.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+
+void* Memory::allocate(size_t n, size_t element_size) {
+    if (element_size > 0 && n > SIZE_MAX / element_size) throw std::bad_alloc();
+    const size_t bytes = std::max<size_t>(n * element_size, 1);
+    const bool huge = huge_pages && bytes >= huge_page_size;
+    const size_t align = huge ? huge_page_size : alignment;
+    const size_t rounded = (bytes + align - 1) / align * align; // aligned_alloc wants a multiple of the alignment
+
+    char* p = static_cast<char*>(std::aligned_alloc(align, rounded));
+    if (!p) throw std::bad_alloc();
+#ifdef __linux__
+    if (huge) madvise(p, rounded, MADV_HUGEPAGE); // a hint: without transparent huge pages, normal pages are used
+#endif
+    return p;
+}
+
+void Memory::deallocate(void* p) {
+    std::free(p);
+}
+
+void Memory::firstTouch(void* p, size_t element_size, const std::vector<int>& bounds) {
+    if (bounds.size() < 2 || (size_t)bounds.back() * element_size < first_touch_bytes) return;
+    char* bytes = static_cast<char*>(p);
+    Parallel::Phase phase("first touch"); // not part of the phase of the caller
+    // parts dealt out in contiguous blocks, block c on worker c: the blocks forTasks starts from, but never stolen
+    Parallel::forChunks(bounds.size() - 1, [&](int, int first, int last) {
+        for (int part = first; part < last; part++) {
+            std::memset(bytes + (size_t)bounds[part] * element_size, 0, (size_t)(bounds[part + 1] - bounds[part]) * element_size);
+        }
+    }, 1);
+}
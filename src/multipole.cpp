@@ -0,0 +1,196 @@
+#include "multipole.hpp"
+#include <stdexcept>
+#include <cmath>
+
+
+Expansion::Expansion(int order) : order(order) {
+    if (order < 0) throw std::invalid_argument("Expansion: order must be non-negative.");
+
+    // multi-indices up to order + 1 (the gradient of a multipole expansion needs one more order), sorted by |n|
+    int side = order + 2;
+    lookup = std::vector<int>(side * side * side, -1);
+    for (int m = 0; m <= order + 1; m++) {
+        for (int nx = m; nx >= 0; nx--) {
+            for (int ny = m - nx; ny >= 0; ny--) {
+                int nz = m - nx - ny;
+                lookup[(nx * side + ny) * side + nz] = exponents.size();
+                exponents.push_back({nx, ny, nz});
+            }
+        }
+    }
+
+    // neighbouring multi-indices, used by the recurrences
+    int n_all = exponents.size();
+    lower = std::vector<int>(3 * n_all, -1);
+    lower2 = std::vector<int>(3 * n_all, -1);
+    upper = std::vector<int>(3 * n_all, -1);
+    first_axis = std::vector<int>(n_all, -1);
+    for (int i = 0; i < n_all; i++) {
+        const std::array<int, 3>& e = exponents[i];
+        for (int dim = 2; dim >= 0; dim--) {
+            std::array<int, 3> p = e;
+            p[dim] -= 1;
+            lower[3 * i + dim] = index(p[0], p[1], p[2]);
+            p[dim] -= 1;
+            lower2[3 * i + dim] = index(p[0], p[1], p[2]);
+            p[dim] += 3;
+            upper[3 * i + dim] = index(p[0], p[1], p[2]);
+            if (e[dim] > 0) first_axis[i] = dim;
+        }
+    }
+
+    // Pascal triangle
+    int rows = 2 * order + 3;
+    binomials = std::vector<double>(rows * rows, 0.0);
+    for (int n = 0; n < rows; n++) {
+        binomials[n * rows] = 1;
+        for (int k = 1; k <= n; k++) {
+            binomials[n * rows + k] = binomials[(n - 1) * rows + k - 1] + binomials[(n - 1) * rows + k];
+        }
+    }
+
+    // operator terms, see multipole.hpp for the formulas
+    int n_coef = count();
+    for (int k = 0; k < n_coef; k++) {
+        const std::array<int, 3>& nk = exponents[k];
+        for (int j = 0; j < n_coef; j++) {
+            const std::array<int, 3>& nj = exponents[j];
+            if (nj[0] <= nk[0] && nj[1] <= nk[1] && nj[2] <= nk[2]) {
+                // M2M: parent_k += C(k, j) d^(k-j) child_j   &   L2L: child_j += C(k, j) s^(k-j) parent_k
+                int diff = index(nk[0] - nj[0], nk[1] - nj[1], nk[2] - nj[2]);
+                m2m_terms.push_back({k, diff, j, binomial(nk, nj)});
+                l2l_terms.push_back({j, diff, k, binomial(nk, nj)});
+            }
+            if (nk[0] + nk[1] + nk[2] + nj[0] + nj[1] + nj[2] <= order) {
+                // M2L: L_k += C(k+j, j) a_(k+j) M_j
+                std::array<int, 3> sum = {nk[0] + nj[0], nk[1] + nj[1], nk[2] + nj[2]};
+                m2l_terms.push_back({k, index(sum[0], sum[1], sum[2]), j, binomial(sum, nj)});
+            }
+        }
+    }
+}
+
+int Expansion::index(int nx, int ny, int nz) const {
+    int side = order + 2;
+    if (nx < 0 || ny < 0 || nz < 0 || nx >= side || ny >= side || nz >= side) return -1;
+    return lookup[(nx * side + ny) * side + nz];
+}
+
+
+// ----------------------- //
+// !-- Building Blocks --! //
+// ----------------------- //
+
+void Expansion::powers(const Eigen::Vector3d& d, int max_order, double* out) const {
+    out[0] = 1.0;
+    int n = count(max_order);
+    for (int i = 1; i < n; i++) {
+        // multiply the monomial with one less power along the first non-zero axis
+        int dim = first_axis[i];
+        out[i] = out[lower[3 * i + dim]] * d[dim];
+    }
+}
+
+void Expansion::derivatives(const Eigen::Vector3d& R, int max_order, double* out) const {
+    // recurrence on the Taylor coefficients of 1/r, for |n| = m >= 1:
+    // r^2 a_n + (2 - 1/m) sum_i R_i a_(n - e_i) + (1 - 1/m) sum_i a_(n - 2 e_i) = 0
+    double r2 = R.squaredNorm();
+    double inv_r2 = 1.0 / r2;
+    out[0] = std::sqrt(inv_r2);
+    int n = count(max_order);
+    for (int i = 1; i < n; i++) {
+        const std::array<int, 3>& e = exponents[i];
+        double m = e[0] + e[1] + e[2];
+        double first = 0, second = 0;
+        for (int dim = 0; dim < 3; dim++) {
+            if (lower[3 * i + dim] >= 0) first += R[dim] * out[lower[3 * i + dim]];
+            if (lower2[3 * i + dim] >= 0) second += out[lower2[3 * i + dim]];
+        }
+        out[i] = -((2.0 - 1.0 / m) * first + (1.0 - 1.0 / m) * second) * inv_r2;
+    }
+}
+
+
+// ----------------- //
+// !-- Operators --! //
+// ----------------- //
+
+void Expansion::addParticle(double* M, const Eigen::Vector3d& center, const Eigen::Vector3d& position, double mass) const {
+    thread_local std::vector<double> pw;
+    pw.resize(count());
+    powers(center - position, order, pw.data());
+    for (int k = 0; k < count(); k++) {
+        M[k] += mass * pw[k];
+    }
+}
+
+void Expansion::translateMultipole(double* parent, const Eigen::Vector3d& parent_center, const double* child, const Eigen::Vector3d& child_center) const {
+    thread_local std::vector<double> pw;
+    pw.resize(count());
+    powers(parent_center - child_center, order, pw.data());
+    for (const Term& t : m2m_terms) {
+        parent[t.dst] += t.coefficient * pw[t.a] * child[t.b];
+    }
+}
+
+void Expansion::multipoleToLocal(double* L, const double* M, const Eigen::Vector3d& R) const {
+    thread_local std::vector<double> a;
+    a.resize(count());
+    derivatives(R, order, a.data());
+    for (const Term& t : m2l_terms) {
+        L[t.dst] += t.coefficient * a[t.a] * M[t.b];
+    }
+}
+
+void Expansion::translateLocal(double* child, const double* parent, const Eigen::Vector3d& s) const {
+    thread_local std::vector<double> pw;
+    pw.resize(count());
+    powers(s, order, pw.data());
+    for (const Term& t : l2l_terms) {
+        child[t.dst] += t.coefficient * pw[t.a] * parent[t.b];
+    }
+}
+
+Eigen::Vector3d Expansion::localAcceleration(const double* L, const Eigen::Vector3d& d) const {
+    thread_local std::vector<double> pw;
+    pw.resize(count());
+    powers(d, order, pw.data());
+    Eigen::Vector3d g = Eigen::Vector3d::Zero();
+    for (int l = 1; l < count(); l++) {
+        const std::array<int, 3>& e = exponents[l];
+        for (int dim = 0; dim < 3; dim++) {
+            if (e[dim] > 0) g[dim] += L[l] * e[dim] * pw[lower[3 * l + dim]];
+        }
+    }
+    return g;
+}
+
+Eigen::Vector3d Expansion::multipoleAcceleration(const double* M, const Eigen::Vector3d& R, int min_order) const {
+    thread_local std::vector<double> a;
+    a.resize(count(order + 1));
+    derivatives(R, order + 1, a.data());
+    Eigen::Vector3d g = Eigen::Vector3d::Zero();
+    for (int k = count(min_order - 1); k < count(); k++) {
+        const std::array<int, 3>& e = exponents[k];
+        for (int dim = 0; dim < 3; dim++) {
+            g[dim] += M[k] * (e[dim] + 1) * a[upper[3 * k + dim]];
+        }
+    }
+    return g;
+}
+
+Eigen::Vector3d Expansion::quadrupoleAcceleration(const double* M, const Eigen::Vector3d& R) const {
+    // S_ij = sum m d_i d_j, then grad of (3 R.S.R - r^2 tr S) / (2 r^5)
+    Eigen::Matrix3d S;
+    S(0, 0) = M[index(2, 0, 0)];
+    S(1, 1) = M[index(0, 2, 0)];
+    S(2, 2) = M[index(0, 0, 2)];
+    S(0, 1) = S(1, 0) = M[index(1, 1, 0)];
+    S(0, 2) = S(2, 0) = M[index(1, 0, 1)];
+    S(1, 2) = S(2, 1) = M[index(0, 1, 1)];
+
+    double inv_r2 = 1.0 / R.squaredNorm();
+    double inv_r5 = inv_r2 * inv_r2 * std::sqrt(inv_r2);
+    Eigen::Vector3d SR = S * R;
+    return inv_r5 * (3.0 * SR + 1.5 * S.trace() * R - 7.5 * R.dot(SR) * inv_r2 * R);
+}
@@ -0,0 +1,99 @@
+#include "neighborList.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+
+bool NeighborList::update(const ParticleSet& ps, const Kernel& kernel) {
+    if (!needsRebuild(ps, kernel)) {
+        reuses++;
+        return false;
+    }
+    build(ps, kernel);
+    return true;
+}
+
+bool NeighborList::needsRebuild(const ParticleSet& ps, const Kernel& kernel) const {
+    if (size() != ps.size()) return true;
+    const std::optional<PeriodicBox>& box = ps.getPeriodicBox();
+
+    // a pair closer than h_i is still listed if d_i + d_j + growth of h_i <= skin
+    std::pair<double, double> worst = Parallel::reduce<std::pair<double, double>>(ps.size(), {0.0, 0.0},
+        [&](int begin, int end) {
+            double displacement = 0, growth = 0;
+            for (int i = begin; i < end; i++) {
+                const Particle& p = ps.get(i);
+                Eigen::Vector3d d = p.position - reference[i];
+                if (box) d = box->minimumImage(d);
+                displacement = std::max(displacement, d.squaredNorm());
+                growth = std::max(growth, radius(p, kernel) - reference_h[i]);
+            }
+            return std::make_pair(displacement, growth);
+        },
+        [](std::pair<double, double> a, std::pair<double, double> b) {return std::make_pair(std::max(a.first, b.first), std::max(a.second, b.second));}
+    );
+    return 2 * std::sqrt(worst.first) + worst.second > skin;
+}
+
+void NeighborList::build(const ParticleSet& ps, const Kernel& kernel) {
+    Parallel::Phase phase("neighbor search");
+    const int n = ps.size();
+    double mean_radius = 0;
+    for (int i = 0; i < n; i++) {
+        mean_radius += radius(ps.get(i), kernel) + skin;
+    }
+    mean_radius = n > 0 ? mean_radius / n : kernel.getSmoothingRadius() + skin;
+    used = method == NeighborMethod::Auto ? NeighborSearch::choose(ps, mean_radius) : method;
+    std::unique_ptr<NeighborSearch> search = NeighborSearch::create(ps, mean_radius, used);
+
+    reference.resize(n);
+    reference_h.resize(n);
+    offsets.assign(n + 1, 0);
+
+    // each chunk fills its own lists, concatenated afterwards in chunk order
+    const int n_chunks = Parallel::chunks(n, 256);
+    std::vector<std::vector<int>> chunk_indices(n_chunks);
+    Parallel::forChunks(n, [&](int chunk, int begin, int end) {
+        std::vector<int> found;
+        for (int i = begin; i < end; i++) {
+            const Particle& p = ps.get(i);
+            reference[i] = p.position;
+            reference_h[i] = radius(p, kernel);
+            search->neighbors(p.position, reference_h[i] + skin, found);
+            std::sort(found.begin(), found.end()); // increasing indices => friendlier memory accesses
+            chunk_indices[chunk].insert(chunk_indices[chunk].end(), found.begin(), found.end());
+            offsets[i + 1] = found.size();
+        }
+    }, 256);
+
+    for (int i = 0; i < n; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    indices.resize(offsets[n]);
+    Parallel::forChunks(n, [&](int chunk, int begin, int) {
+        std::copy(chunk_indices[chunk].begin(), chunk_indices[chunk].end(), indices.begin() + offsets[begin]);
+    }, 256);
+    rebuilds++;
+}
+
+void NeighborList::assign(const ParticleSet& ps, const Kernel& kernel, std::vector<int> offsets, std::vector<int> indices) {
+    const int n = ps.size();
+    if ((int)offsets.size() != n + 1 || offsets[n] != (int)indices.size()) throw std::invalid_argument("NeighborList::assign: offsets and indices do not describe one list per particle.");
+    this->offsets = std::move(offsets);
+    this->indices = std::move(indices);
+    used = NeighborMethod::Auto;
+    reference.resize(n);
+    reference_h.resize(n);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            reference[i] = ps.get(i).position;
+            reference_h[i] = radius(ps.get(i), kernel);
+        }
+    });
+    rebuilds++;
+}
+
+size_t NeighborList::getMemory() const {
+    return offsets.capacity() * sizeof(int) + indices.capacity() * sizeof(int) +
+           reference.capacity() * sizeof(Eigen::Vector3d) + reference_h.capacity() * sizeof(double);
+}
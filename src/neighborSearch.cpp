@@ -0,0 +1,176 @@
+#include "neighborSearch.hpp"
+#include "octree.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+
+// ---------------------------- //
+// !-- Neighbor Search Base --! //
+// ---------------------------- //
+
+std::unique_ptr<NeighborSearch> NeighborSearch::create(const ParticleSet& ps, double h, NeighborMethod method) {
+    if (method == NeighborMethod::Auto) method = choose(ps, h);
+    switch (method) {
+        case NeighborMethod::Tree: return std::make_unique<Octree>(ps);
+        case NeighborMethod::Grid: return std::make_unique<CellGrid>(ps, h);
+        case NeighborMethod::Auto: break;
+    }
+    throw std::invalid_argument("NeighborSearch::create: unknown method.");
+}
+
+NeighborMethod NeighborSearch::choose(const ParticleSet& ps, double h) {
+    return densityContrast(ps, h) < max_contrast ? NeighborMethod::Grid : NeighborMethod::Tree;
+}
+
+double NeighborSearch::densityContrast(const ParticleSet& ps, double h) {
+    const int n = ps.size();
+    if (n == 0) return 1.0;
+    if (!(h > 0)) throw std::invalid_argument("NeighborSearch::densityContrast: h must be positive.");
+
+    Eigen::Vector3d origin, extent;
+    if (ps.isPeriodic()) {
+        origin = ps.getPeriodicBox()->origin;
+        extent = Eigen::Vector3d::Constant(ps.getPeriodicBox()->side);
+    } else {
+        origin = ps.getStatistics().bbox_min;
+        extent = ps.getStatistics().bbox_max - origin;
+    }
+    int dims[3];
+    double cells = 1;
+    for (int dim = 0; dim < 3; dim++) {
+        dims[dim] = std::max(1.0, std::floor(extent[dim] / h));
+        cells *= dims[dim];
+    }
+    if (cells > (double)max_cells_per_particle * n) return std::numeric_limits<double>::infinity();
+
+    std::vector<int> counts((size_t)cells, 0);
+    for (int i = 0; i < n; i++) {
+        const Eigen::Vector3d& x = ps.get(i).position;
+        int c[3];
+        for (int dim = 0; dim < 3; dim++) {
+            c[dim] = std::clamp((int)std::floor((x[dim] - origin[dim]) / h), 0, dims[dim] - 1);
+        }
+        counts[(c[0] * dims[1] + c[1]) * dims[2] + c[2]]++;
+    }
+    // mean occupancy seen by a particle, over the mean occupancy of a cell
+    double seen = 0;
+    for (int count : counts) {
+        seen += (double)count * count;
+    }
+    return (seen / n) / (n / cells);
+}
+
+
+
+// ----------------- //
+// !-- Cell Grid --! //
+// ----------------- //
+
+CellGrid::CellGrid(const ParticleSet& ps, double cell_size) : cell_size(cell_size), box(ps.getPeriodicBox()) {
+    if (!(cell_size > 0)) throw std::invalid_argument("CellGrid: the cell size must be positive.");
+    const int n = ps.size();
+
+    Eigen::Vector3d extent;
+    if (box) {
+        origin = box->origin;
+        extent = Eigen::Vector3d::Constant(box->side);
+    } else {
+        origin = n > 0 ? ps.getStatistics().bbox_min : Eigen::Vector3d::Zero();
+        extent = n > 0 ? Eigen::Vector3d(ps.getStatistics().bbox_max - origin) : Eigen::Vector3d::Zero();
+    }
+    // never more than max_cells_per_particle cells per particle: sparse sets get larger cells
+    const double max_cells = (double)NeighborSearch::max_cells_per_particle * std::max(n, 1);
+    double wanted = extent.prod() / (cell_size * cell_size * cell_size);
+    if (wanted > max_cells) this->cell_size *= std::cbrt(wanted / max_cells);
+    for (int dim = 0; dim < 3; dim++) {
+        dims[dim] = std::max(1.0, std::floor(extent[dim] / this->cell_size));
+    }
+    if (box) this->cell_size = box->side / dims[0]; // cells tile the periodic box exactly
+
+    // counting sort by cell
+    std::vector<int> cell_of(n);
+    positions.resize(n);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Eigen::Vector3d x = ps.get(i).position;
+            if (box) x = box->wrap(x);
+            cell_of[i] = cell(coordinate(x[0], 0), coordinate(x[1], 1), coordinate(x[2], 2));
+        }
+    });
+    starts.assign(cells() + 1, 0);
+    for (int i = 0; i < n; i++) {
+        starts[cell_of[i] + 1]++;
+    }
+    for (int c = 0; c < cells(); c++) {
+        starts[c + 1] += starts[c];
+    }
+    index.resize(n);
+    std::vector<int> fill(starts.begin(), starts.end() - 1);
+    for (int i = 0; i < n; i++) {
+        int k = fill[cell_of[i]]++;
+        index[k] = i;
+        positions[k] = box ? box->wrap(ps.get(i).position) : ps.get(i).position;
+    }
+}
+
+int CellGrid::coordinate(double x, int dim) const {
+    return std::clamp((int)std::floor((x - origin[dim]) / cell_size), 0, dims[dim] - 1);
+}
+
+void CellGrid::neighbors(const Eigen::Vector3d& x, double radius, std::vector<int>& out) const {
+    out.clear();
+    if (size() == 0) return;
+    if (box && 2 * radius >= box->side) throw std::invalid_argument("CellGrid::neighbors: the search radius must be smaller than half of the periodic box.");
+    const double r2 = radius * radius;
+
+    // range of cells along each axis, as at most two runs once wrapped around a periodic box
+    int runs[3][2][2], n_runs[3];
+    for (int dim = 0; dim < 3; dim++) {
+        int lo = (int)std::floor((x[dim] - radius - origin[dim]) / cell_size);
+        int hi = (int)std::floor((x[dim] + radius - origin[dim]) / cell_size);
+        if (!box || hi - lo + 1 >= dims[dim]) {
+            // particles beyond the last cell are stored in it: clamp rather than skip
+            lo = std::clamp(lo, 0, dims[dim] - 1);
+            hi = std::clamp(hi, 0, dims[dim] - 1);
+            runs[dim][0][0] = lo;
+            runs[dim][0][1] = hi;
+            n_runs[dim] = 1;
+            continue;
+        }
+        lo = ((lo % dims[dim]) + dims[dim]) % dims[dim];
+        hi = ((hi % dims[dim]) + dims[dim]) % dims[dim];
+        if (lo <= hi) {
+            runs[dim][0][0] = lo;
+            runs[dim][0][1] = hi;
+            n_runs[dim] = 1;
+        } else {
+            runs[dim][0][0] = lo;
+            runs[dim][0][1] = dims[dim] - 1;
+            runs[dim][1][0] = 0;
+            runs[dim][1][1] = hi;
+            n_runs[dim] = 2;
+        }
+    }
+
+    for (int rx = 0; rx < n_runs[0]; rx++) {
+        for (int ix = runs[0][rx][0]; ix <= runs[0][rx][1]; ix++) {
+            for (int ry = 0; ry < n_runs[1]; ry++) {
+                for (int iy = runs[1][ry][0]; iy <= runs[1][ry][1]; iy++) {
+                    for (int rz = 0; rz < n_runs[2]; rz++) {
+                        // cells along z are contiguous: one run of particles
+                        const int first = starts[cell(ix, iy, runs[2][rz][0])];
+                        const int last = starts[cell(ix, iy, runs[2][rz][1]) + 1];
+                        for (int k = first; k < last; k++) {
+                            Eigen::Vector3d d = positions[k] - x;
+                            if (box) d = box->minimumImage(d);
+                            if (d.squaredNorm() <= r2) out.push_back(index[k]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,288 @@
+#include "octree.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+
+/**
+ * -------------------
+ * !-- Morton Keys --!
+ * -------------------
+ */
+
+// spreads the 21 lowest bits of v so that there are two zeros between each of them
+static uint64_t spreadBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffff;
+    v = (v | v << 16) & 0x1f0000ff0000ff;
+    v = (v | v << 8) & 0x100f00f00f00f00f;
+    v = (v | v << 4) & 0x10c30c30c30c30c3;
+    v = (v | v << 2) & 0x1249249249249249;
+    return v;
+}
+
+uint64_t Octree::mortonKey(const Eigen::Vector3d& x, const Eigen::Vector3d& origin, double side) {
+    const double cells = double(1 << max_level);
+    uint64_t c[3];
+    for (int dim = 0; dim < 3; dim++) {
+        double u = (x[dim] - origin[dim]) / side * cells;
+        c[dim] = (uint64_t)std::clamp(u, 0.0, cells - 1);
+    }
+    return spreadBits(c[0]) << 2 | spreadBits(c[1]) << 1 | spreadBits(c[2]);
+}
+
+
+/**
+ * ----------------
+ * !-- Building --!
+ * ----------------
+ */
+
+Octree::Octree(const ParticleSet& ps, int leaf_size) : leaf_size(leaf_size), box(ps.getPeriodicBox()) {
+    if (leaf_size < 1) throw std::invalid_argument("Octree: leaf_size must be at least 1.");
+    Parallel::Phase phase("tree build");
+    const int n = ps.size();
+    if (n == 0) {
+        nodes.push_back(OctreeNode());
+        nodes[0].next = 1;
+        return;
+    }
+
+    // bounding cube, slightly enlarged so that no particle sits exactly on the upper faces, or the periodic box
+    Eigen::Vector3d center, origin;
+    double side;
+    if (box) {
+        side = box->side;
+        origin = box->origin;
+        center = box->center();
+    } else {
+        const ParticleSetStatistics& stats = ps.getStatistics();
+        center = 0.5 * (stats.bbox_min + stats.bbox_max);
+        side = (stats.bbox_max - stats.bbox_min).maxCoeff();
+        side = side > 0 ? side * (1 + 1e-9) : 1.0;
+        origin = center - Eigen::Vector3d::Constant(side / 2);
+    }
+    auto position = [&](int i) {return box ? box->wrap(ps.get(i).position) : ps.get(i).position;};
+
+    // sort the particles along the Morton curve
+    std::vector<uint64_t> unsorted(n);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            unsorted[i] = mortonKey(position(i), origin, side);
+        }
+    });
+    index = NumaVector<int>(n);
+    std::iota(index.begin(), index.end(), 0);
+    std::sort(index.begin(), index.end(), [&](int a, int b) {
+        return unsorted[a] < unsorted[b] || (unsorted[a] == unsorted[b] && a < b);
+    });
+
+    // placed as the static loops over the particles in tree order (this fill, the moment sweeps), not as the walks. A
+    // walk reads its own particle, then the nodes and the leaf particles it opens all over the tree, so no partition of
+    // the targets makes its reads local. TreeGravity also keeps its costs in set order, so its partition is only known
+    // once the tree is sorted, and it changes from step to step. With even costs its ranges start where the chunks do.
+    const std::vector<int> chunks = Parallel::chunkBounds(n);
+    keys = Memory::array<uint64_t>(chunks);
+    positions = Memory::array<Eigen::Vector3d>(chunks);
+    masses = Memory::array<real>(chunks);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            keys[k] = unsorted[index[k]];
+            positions[k] = position(index[k]);
+            masses[k] = ps.get(index[k]).mass;
+        }
+    });
+
+    nodes.reserve(2 * n / leaf_size + 1);
+    build(0, n, center, side / 2, 0);
+    computeMoments();
+}
+
+int Octree::build(int first, int count, const Eigen::Vector3d& center, double half_size, int level) {
+    int id = nodes.size();
+    nodes.push_back(OctreeNode());
+    nodes[id].center = center;
+    nodes[id].half_size = half_size;
+    nodes[id].first = first;
+    nodes[id].count = count;
+    nodes[id].level = level;
+
+    if (count > leaf_size && level < max_level) {
+        // the particles of each octant are contiguous since keys are sorted
+        int shift = 3 * (max_level - 1 - level);
+        int begin = first;
+        for (int octant = 0; octant < 8; octant++) {
+            int end = std::partition_point(keys.begin() + begin, keys.begin() + first + count, [&](uint64_t key) {
+                return (int)((key >> shift) & 7) <= octant;
+            }) - keys.begin();
+            if (end > begin) {
+                Eigen::Vector3d offset((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+                Eigen::Vector3d child_center = center + half_size * (offset - Eigen::Vector3d::Constant(0.5));
+                int child = build(begin, end - begin, child_center, half_size / 2, level + 1);
+                nodes[id].children[nodes[id].n_children++] = child;
+            }
+            begin = end;
+        }
+    }
+
+    nodes[id].next = nodes.size();
+    return id;
+}
+
+void Octree::computeMoments() {
+    // children are stored after their parent => a reverse sweep sees children first
+    for (int id = nodes.size() - 1; id >= 0; id--) {
+        OctreeNode& node = nodes[id];
+        node.mass = 0;
+        node.com = Eigen::Vector3d::Zero();
+        node.radius = 0;
+
+        if (node.isLeaf()) {
+            for (int k = node.first; k < node.first + node.count; k++) {
+                node.mass += masses[k];
+                node.com += double(masses[k]) * positions[k];
+            }
+            node.com = node.mass > 0 ? Eigen::Vector3d(node.com / node.mass) : node.center;
+            for (int k = node.first; k < node.first + node.count; k++) {
+                double r = (positions[k] - node.com).norm();
+                node.radius = std::max(node.radius, r);
+                double rn = masses[k];
+                for (int n = 0; n < 6; n++) {
+                    node.B[n] += rn;
+                    rn *= r;
+                }
+            }
+        } else {
+            for (int c = 0; c < node.n_children; c++) {
+                const OctreeNode& child = nodes[node.children[c]];
+                node.mass += child.mass;
+                node.com += child.mass * child.com;
+            }
+            node.com = node.mass > 0 ? Eigen::Vector3d(node.com / node.mass) : node.center;
+            for (int c = 0; c < node.n_children; c++) {
+                const OctreeNode& child = nodes[node.children[c]];
+                node.radius = std::max(node.radius, (child.com - node.com).norm() + child.radius);
+            }
+            // the cell itself gives another bound
+            node.radius = std::min(node.radius, (node.com - node.center).norm() + std::sqrt(3.0) * node.half_size);
+
+            // |x - com| <= |x - com_child| + d => B_n <= sum_k C(n, k) B_k(child) d^(n-k)
+            static const double binomial[6][6] = {{1}, {1, 1}, {1, 2, 1}, {1, 3, 3, 1}, {1, 4, 6, 4, 1}, {1, 5, 10, 10, 5, 1}};
+            for (int c = 0; c < node.n_children; c++) {
+                const OctreeNode& child = nodes[node.children[c]];
+                double d = (child.com - node.com).norm();
+                for (int n = 0; n < 6; n++) {
+                    double dn = 1;
+                    for (int k = n; k >= 0; k--) {
+                        node.B[n] += binomial[n][k] * child.B[k] * dn;
+                        dn *= d;
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * -----------------------
+ * !-- Neighbor Search --!
+ * -----------------------
+ */
+
+void Octree::neighbors(const Eigen::Vector3d& x, double radius, std::vector<int>& out) const {
+    out.clear();
+    if (size() == 0) return;
+    if (box && 2 * radius >= box->side) throw std::invalid_argument("Octree::neighbors: the search radius must be smaller than half of the periodic box.");
+
+    const double r2 = radius * radius;
+    int stack[8 * (max_level + 1)];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const OctreeNode& node = nodes[stack[--top]];
+
+        // distance between x and the cell (nearest image)
+        Eigen::Vector3d excess = (separation(x, node.center).cwiseAbs() - Eigen::Vector3d::Constant(node.half_size)).cwiseMax(0.0);
+        if (excess.squaredNorm() > r2) continue;
+
+        if (node.isLeaf()) {
+            for (int k = node.first; k < node.first + node.count; k++) {
+                if (separation(positions[k], x).squaredNorm() <= r2) out.push_back(index[k]);
+            }
+        } else {
+            for (int c = 0; c < node.n_children; c++) {
+                stack[top++] = node.children[c];
+            }
+        }
+    }
+}
+
+
+/**
+ * -----------------
+ * !-- Multipoles --!
+ * -----------------
+ */
+
+std::vector<int> Octree::subtrees(int target) const {
+    std::vector<int> front = {0};
+    while ((int)front.size() < target) {
+        // open the most populated non-leaf node
+        int best = -1;
+        for (int f = 0; f < (int)front.size(); f++) {
+            const OctreeNode& node = nodes[front[f]];
+            if (!node.isLeaf() && (best < 0 || node.count > nodes[front[best]].count)) best = f;
+        }
+        if (best < 0) break;
+        const OctreeNode& node = nodes[front[best]];
+        front.erase(front.begin() + best);
+        for (int c = 0; c < node.n_children; c++) {
+            front.push_back(node.children[c]);
+        }
+    }
+    std::sort(front.begin(), front.end());
+    return front;
+}
+
+void Octree::computeMultipoles(const Expansion& expansion) {
+    if (multipole_order == expansion.getOrder()) return;
+    Parallel::Phase phase("multipoles");
+    multipole_order = expansion.getOrder();
+    const int n_coef = expansion.count();
+    multipoles = NumaVector<double>(nodes.size() * n_coef, 0.0);
+
+    auto upward = [&](int id) {
+        const OctreeNode& node = nodes[id];
+        if (node.isLeaf()) {
+            for (int k = node.first; k < node.first + node.count; k++) {
+                expansion.addParticle(multipole(id), node.com, positions[k], masses[k]); // P2M
+            }
+        } else {
+            for (int c = 0; c < node.n_children; c++) {
+                expansion.translateMultipole(multipole(id), node.com, multipole(node.children[c]), nodes[node.children[c]].com); // M2M
+            }
+        }
+    };
+
+    // disjoint subtrees in parallel (children are stored after their parent => reverse sweeps see children first)
+    std::vector<int> front = subtrees(8 * Parallel::getThreads());
+    Parallel::forRange(front.size(), [&](int begin, int end) {
+        for (int f = begin; f < end; f++) {
+            for (int id = nodes[front[f]].next - 1; id >= front[f]; id--) {
+                upward(id);
+            }
+        }
+    }, 1);
+
+    // then the few nodes above them
+    std::vector<bool> done(nodes.size(), false);
+    for (int f : front) {
+        std::fill(done.begin() + f, done.begin() + nodes[f].next, true);
+    }
+    for (int id = nodes.size() - 1; id >= 0; id--) {
+        if (!done[id]) upward(id);
+    }
+}
@@ -0,0 +1,499 @@
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <optional>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    thread_local int current_worker = 0;
+    thread_local bool inside = false; // in a parallel loop: nested calls run serially
+    thread_local std::string current_phase;
+
+    std::mutex phases_mutex;
+    std::map<std::string, Parallel::PhaseStats> phases;
+
+    double seconds(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double>(to - from).count();
+    }
+
+#ifdef __linux__
+    /**
+     * @brief Cores the calling thread may run on.
+     */
+    std::vector<int> allowedCores() {
+        std::vector<int> cores;
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int c = 0; c < CPU_SETSIZE; c++) {
+                if (CPU_ISSET(c, &set)) cores.push_back(c);
+            }
+        }
+        if (cores.empty()) cores.push_back(0);
+        return cores;
+    }
+
+    void pin(int core) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    /**
+     * @brief Binds the calling thread to one core while it lives, then gives it back its previous affinity.
+     */
+    class Pinned {
+        private:
+            cpu_set_t previous;
+            bool saved;
+
+        public:
+            explicit Pinned(int core) : saved(pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) == 0) {
+                if (saved) pin(core);
+            }
+
+            ~Pinned() {
+                if (saved) pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+            }
+    };
+#else
+    // thread affinity is not available: pinning does nothing
+    std::vector<int> allowedCores() {return {0};}
+    void pin(int) {}
+    struct Pinned {
+        explicit Pinned(int) {}
+    };
+#endif
+
+    /**
+     * @brief Persistent workers 1 to size - 1, waiting for jobs. run(job) calls job(w) on every worker w, the calling
+     * thread being worker 0, and returns once all are done.
+     */
+    class Pool {
+        private:
+            std::vector<std::thread> threads;
+            std::mutex mutex;
+            std::condition_variable start, done;
+            const std::function<void(int)>* job = nullptr;
+            long long generation = 0;
+            int remaining = 0;
+            bool stop = false;
+            std::exception_ptr error;
+
+            void loop(int w) {
+                if (pinned) pin(cores[w % cores.size()]); // before any work, so that first touches land on the right node
+                current_worker = w;
+                inside = true;
+                long long seen = 0;
+                while (true) {
+                    const std::function<void(int)>* todo;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        start.wait(lock, [&] {return stop || generation != seen;});
+                        if (stop) return;
+                        seen = generation;
+                        todo = job;
+                    }
+                    std::exception_ptr thrown;
+                    try {
+                        (*todo)(w);
+                    } catch (...) {
+                        thrown = std::current_exception();
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (thrown && !error) error = thrown;
+                    if (--remaining == 0) done.notify_one();
+                }
+            }
+
+        public:
+            const int size;
+            const bool pinned;
+            const std::vector<int> cores; // worker w runs on cores[w % cores.size()] when pinned
+
+            Pool(int size, bool pinned) : size(size), pinned(pinned), cores(allowedCores()) {
+                for (int w = 1; w < size; w++) {
+                    threads.emplace_back(&Pool::loop, this, w);
+                }
+            }
+
+            ~Pool() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+                start.notify_all();
+                for (std::thread& t : threads) t.join();
+            }
+
+            void run(const std::function<void(int)>& f) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    job = &f;
+                    remaining = size - 1;
+                    error = nullptr;
+                    generation++;
+                }
+                start.notify_all();
+                std::exception_ptr thrown;
+                try {
+                    std::optional<Pinned> pinned_caller;
+                    if (pinned) pinned_caller.emplace(cores[0]);
+                    f(0);
+                } catch (...) {
+                    thrown = std::current_exception();
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [&] {return remaining == 0;});
+                if (thrown) std::rethrow_exception(thrown);
+                if (error) std::rethrow_exception(error);
+            }
+    };
+
+    std::mutex pool_mutex; // held while the pool runs a job
+    std::unique_ptr<Pool> pool;
+
+#ifdef __linux__
+    /**
+     * @brief A forked child only has the thread that called fork(): the workers of the pool stay in the parent, and a
+     * job run on the copied pool would wait for them forever. The child drops it (without joining threads it does not
+     * have) and starts a new pool at its first parallel loop.
+     */
+    [[maybe_unused]] const int fork_handler = pthread_atfork(nullptr, nullptr, [] {pool.release();});
+#endif
+
+    /**
+     * @brief Marks the calling thread as inside a parallel loop while it lives, and restores its previous state (worker
+     * index included) when it is destroyed, on exceptions too.
+     */
+    class Inside {
+        private:
+            int outer_worker;
+            bool outer_inside;
+
+        public:
+            Inside() : outer_worker(current_worker), outer_inside(inside) {
+                inside = true;
+            }
+
+            ~Inside() {
+                current_worker = outer_worker;
+                inside = outer_inside;
+            }
+    };
+
+    /**
+     * @brief Calls job(w) for every worker w in [0, workers), in parallel on the pool if it is free, serially otherwise.
+     */
+    void execute(int workers, const std::function<void(int)>& job) {
+        std::unique_lock<std::mutex> lock(pool_mutex, std::defer_lock);
+        if (workers > 1 && !inside && lock.try_lock()) {
+            const int threads = std::max(workers, Parallel::getThreads());
+            if (!pool || pool->size != threads || pool->pinned != Parallel::getPinning()) {
+                pool.reset();
+                pool = std::make_unique<Pool>(threads, Parallel::getPinning());
+            }
+            Inside guard;
+            pool->run([&](int w) {if (w < workers) job(w);});
+            return;
+        }
+
+        Inside guard;
+        for (int w = 0; w < workers; w++) {
+            current_worker = w;
+            job(w);
+        }
+    }
+
+    /**
+     * @brief Per-worker counters of one loop, padded against false sharing.
+     */
+    struct alignas(64) WorkerStats {
+        double busy = 0;
+        long long tasks = 0, steals = 0;
+    };
+
+    void record(Clock::time_point start, int workers, const std::vector<WorkerStats>& stats) {
+        if (current_phase.empty()) return;
+        const double wall = seconds(start, Clock::now());
+        std::lock_guard<std::mutex> lock(phases_mutex);
+        Parallel::PhaseStats& phase = phases[current_phase];
+        phase.wall += wall;
+        phase.capacity += wall * workers;
+        phase.loops++;
+        for (const WorkerStats& s : stats) {
+            phase.busy += s.busy;
+            phase.tasks += s.tasks;
+            phase.steals += s.steals;
+        }
+    }
+
+    /**
+     * @brief A work item: a range [begin, end), or a single task or tree item (begin only).
+     */
+    struct Item {
+        int begin, end;
+    };
+
+    struct alignas(64) Deque {
+        std::mutex mutex;
+        std::deque<Item> items;
+    };
+
+    /**
+     * @brief The work stealing loop. deques[w] holds the initial items of worker w; run(item, push) processes an item
+     * and may push new ones onto the deque of the worker running it. Owners take from the back, thieves from the front.
+     * Once an item has thrown, the items left are dropped without running, and the first exception is rethrown.
+     */
+    void steal(std::vector<Deque>& deques, const std::function<void(Item, const std::function<void(Item)>&)>& run) {
+        const int workers = deques.size();
+        const Clock::time_point start = Clock::now();
+        std::vector<WorkerStats> stats(workers);
+        std::atomic<long long> pending(0);
+        for (Deque& d : deques) pending += d.items.size();
+        std::atomic<bool> failed(false);
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+        execute(workers, [&](int w) {
+            Deque& own = deques[w];
+            auto push = [&](Item item) {
+                pending++;
+                std::lock_guard<std::mutex> lock(own.mutex);
+                own.items.push_back(item);
+            };
+            while (pending.load() > 0) {
+                Item item;
+                bool found = false;
+                {
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    if (!own.items.empty()) {
+                        item = own.items.back();
+                        own.items.pop_back();
+                        found = true;
+                    }
+                }
+                for (int k = 1; k < workers && !found; k++) {
+                    Deque& victim = deques[(w + k) % workers];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.items.empty()) {
+                        item = victim.items.front();
+                        victim.items.pop_front();
+                        found = true;
+                        stats[w].steals++;
+                    }
+                }
+                if (!found) {
+                    std::this_thread::yield(); // the last items are running elsewhere, and may still spawn
+                    continue;
+                }
+                if (!failed.load()) {
+                    const Clock::time_point begin = Clock::now();
+                    try {
+                        run(item, push);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error) error = std::current_exception();
+                        failed = true;
+                    }
+                    stats[w].busy += seconds(begin, Clock::now());
+                    stats[w].tasks++;
+                }
+                pending--; // whatever happened to the item, or the other workers would wait for it forever
+            }
+        });
+        record(start, workers, stats);
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+
+
+/**
+ * -----------------------
+ * !-- Static chunking --!
+ * -----------------------
+ */
+
+int Parallel::getThreads() {
+    if (n_threads > 0) return n_threads;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void Parallel::setThreads(int n) {
+    n_threads = std::max(0, n);
+}
+
+int Parallel::worker() {
+    return current_worker;
+}
+
+Parallel::Serial::Serial() : previous(inside) {
+    inside = true;
+}
+
+Parallel::Serial::~Serial() {
+    inside = previous;
+}
+
+int Parallel::chunks(int n, int grain) {
+    if (n <= 0) return 1;
+    return std::max(1, std::min(getThreads(), n / std::max(1, grain)));
+}
+
+std::vector<int> Parallel::chunkBounds(int n, int grain) {
+    // chunk c covers [c * n / n_chunks, (c+1) * n / n_chunks)
+    const int n_chunks = chunks(n, grain);
+    std::vector<int> bounds(n_chunks + 1);
+    for (int c = 0; c <= n_chunks; c++) bounds[c] = (int)((long long)c * std::max(n, 0) / n_chunks);
+    return bounds;
+}
+
+void Parallel::forChunks(int n, const std::function<void(int, int, int)>& f, int grain) {
+    int n_chunks = chunks(n, grain);
+    if (n_chunks == 1 && current_phase.empty()) {
+        f(0, 0, std::max(n, 0));
+        return;
+    }
+
+    // chunk c runs on worker c
+    const std::vector<int> bounds = chunkBounds(n, grain);
+    const Clock::time_point start = Clock::now();
+    std::vector<WorkerStats> stats(n_chunks);
+    execute(n_chunks, [&](int c) {
+        const Clock::time_point begin = Clock::now();
+        f(c, bounds[c], bounds[c + 1]);
+        stats[c].busy = seconds(begin, Clock::now());
+        stats[c].tasks = 1;
+    });
+    record(start, n_chunks, stats);
+}
+
+void Parallel::forRange(int n, const std::function<void(int, int)>& f, int grain) {
+    forChunks(n, [&](int, int begin, int end) {f(begin, end);}, grain);
+}
+
+
+
+/**
+ * ---------------------
+ * !-- Work stealing --!
+ * ---------------------
+ */
+
+void Parallel::forDynamic(int n, const std::function<void(int, int)>& f, int grain) {
+    grain = std::max(1, grain);
+    const int workers = std::max(1, std::min(getThreads(), n / grain));
+    if (n <= 0) return;
+    std::vector<Deque> deques(workers);
+    for (int w = 0; w < workers; w++) {
+        deques[w].items.push_back({(int)((long long)w * n / workers), (int)((long long)(w + 1) * n / workers)});
+    }
+    steal(deques, [&](Item item, const std::function<void(Item)>& push) {
+        // keep the lower half, offer the upper one: the owner then goes on with the piece next to the one it just did
+        while (item.end - item.begin > grain) {
+            int middle = item.begin + (item.end - item.begin) / 2;
+            push({middle, item.end});
+            item.end = middle;
+        }
+        f(item.begin, item.end);
+    });
+}
+
+void Parallel::forTasks(int n_tasks, const std::function<void(int)>& f) {
+    if (n_tasks <= 0) return;
+    const int workers = std::min(getThreads(), n_tasks);
+    std::vector<Deque> deques(workers);
+    for (int w = 0; w < workers; w++) {
+        // owners take from the back: the first task of the block goes last in
+        for (int t = (int)((long long)(w + 1) * n_tasks / workers) - 1; t >= (int)((long long)w * n_tasks / workers); t--) {
+            deques[w].items.push_back({t, t + 1});
+        }
+    }
+    steal(deques, [&](Item item, const std::function<void(Item)>&) {f(item.begin);});
+}
+
+void Parallel::forTree(const std::vector<int>& roots, const std::function<void(int, std::vector<int>&)>& f) {
+    if (roots.empty()) return;
+    std::vector<Deque> deques(getThreads());
+    for (int r = (int)roots.size() - 1; r >= 0; r--) {
+        deques[0].items.push_back({roots[r], roots[r] + 1});
+    }
+    steal(deques, [&](Item item, const std::function<void(Item)>& push) {
+        std::vector<int> spawn;
+        f(item.begin, spawn);
+        for (int s = (int)spawn.size() - 1; s >= 0; s--) {
+            push({spawn[s], spawn[s] + 1});
+        }
+    });
+}
+
+std::vector<int> Parallel::partition(const std::vector<double>& costs, int parts) {
+    parts = std::max(1, parts);
+    const int n = costs.size();
+    std::vector<double> prefix(n + 1, 0.0);
+    for (int i = 0; i < n; i++) {
+        prefix[i + 1] = prefix[i] + std::max(costs[i], 0.0);
+    }
+    std::vector<int> bounds(parts + 1, n);
+    bounds[0] = 0;
+    for (int p = 1; p < parts; p++) {
+        if (prefix[n] > 0) {
+            // the prefix sum closest to the target
+            const double target = prefix[n] * p / parts;
+            bounds[p] = std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin();
+            if (bounds[p] > 0 && target - prefix[bounds[p] - 1] < prefix[bounds[p]] - target) bounds[p]--;
+        } else {
+            bounds[p] = (int)((long long)p * n / parts); // no costs: equal counts
+        }
+        bounds[p] = std::clamp(bounds[p], bounds[p - 1], n);
+    }
+    return bounds;
+}
+
+
+
+/**
+ * -----------------
+ * !-- Profiling --!
+ * -----------------
+ */
+
+Parallel::Phase::Phase(const std::string& name) : previous(current_phase) {
+    current_phase = name;
+}
+
+Parallel::Phase::~Phase() {
+    current_phase = previous;
+}
+
+std::map<std::string, Parallel::PhaseStats> Parallel::getPhases() {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    return phases;
+}
+
+void Parallel::resetPhases() {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    phases.clear();
+}
+
+void Parallel::report() {
+    for (const auto& [name, stats] : getPhases()) {
+        Message(name + ": " + std::to_string(stats.wall * 1e3) + " ms in " + std::to_string(stats.loops) + " loops, efficiency " +
+                std::to_string(100 * stats.efficiency()) + " %, " + std::to_string(stats.tasks) + " tasks, " + std::to_string(stats.steals) + " steals");
+    }
+}
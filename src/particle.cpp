@@ -19,7 +19,17 @@ Particle::Particle(std::initializer_list<double> init) {
     } else {
         throw std::invalid_argument("Invalid number of arguments. Must be 3, 6 or 7.");
     }
-    id = id_counter++;
+    id = nextId();
+}
+
+int64_t Particle::nextId() {
+    thread_local int64_t next = 0, end = 0, generation = -1;
+    if (next == end || generation != id_generation.load(std::memory_order_relaxed)) {
+        generation = id_generation.load(std::memory_order_relaxed);
+        next = id_counter.fetch_add(id_block);
+        end = next + id_block;
+    }
+    return next++;
 }
 
 
@@ -27,12 +37,14 @@ Particle::Particle(const Particle& p) {
     position = p.position;
     velocity = p.velocity;
     mass = p.mass;
+    current_time = p.current_time;
+    smoothing_length = p.smoothing_length;
     id = p.id;
 }
 
 void Particle::display() {
     Message::print(
-        cstr("Particle").blue() + "<" + cstr(id).green() + ">:"
+        cstr("Particle").blue() + "<" + cstr(std::to_string(id)).green() + ">:"
     );
     Message::tab();
     Message::print(
@@ -47,5 +59,8 @@ void Particle::display() {
     Message::print(
         "- Time: " + std::to_string(current_time)
     );
+    Message::print(
+        "- Smoothing length: " + std::to_string(smoothing_length)
+    );
     Message::untab();
 }
\ No newline at end of file
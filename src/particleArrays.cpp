@@ -0,0 +1,69 @@
+#include "particleArrays.hpp"
+#include "parallel.hpp"
+#include <stdexcept>
+
+
+template <typename Real>
+void BasicParticleArrays<Real>::load(const ParticleSet& ps) {
+    const int n = ps.size();
+    if (n != size()) {
+        const std::vector<int> chunks = Parallel::chunkBounds(n);
+        positions = Memory::array<Eigen::Vector3d>(chunks);
+        velocities = Memory::array<Vector3>(chunks);
+        masses = Memory::array<Real>(chunks);
+        smoothing_lengths = Memory::array<Real>(chunks);
+    }
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Particle& p = ps.get(i);
+            positions[i] = p.position;
+            velocities[i] = p.velocity.cast<Real>();
+            masses[i] = p.mass;
+            smoothing_lengths[i] = p.smoothing_length;
+        }
+    });
+}
+
+template <typename Real>
+void BasicParticleArrays<Real>::store(ParticleSet& ps) const {
+    if (ps.size() != size()) throw std::invalid_argument("ParticleArrays::store: the set does not have the same size.");
+    Parallel::forRange(size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Particle& p = ps.particles[i];
+            p.position = positions[i];
+            p.velocity = velocities[i].template cast<double>();
+            p.mass = masses[i];
+            p.smoothing_length = smoothing_lengths[i];
+        }
+    });
+    ps.invalidate();
+}
+
+template <typename Real>
+std::vector<Real> BasicParticleArrays<Real>::densities(const BasicKernel<Real>& kernel, const NeighborList& list, const std::optional<PeriodicBox>& box) const {
+    if (list.size() != size()) throw std::invalid_argument("ParticleArrays::densities: the neighbor list was not built for these particles.");
+    std::vector<Real> rho(size());
+    Parallel::forRange(size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Real h = smoothing_lengths[i] > 0 ? smoothing_lengths[i] : kernel.getSmoothingRadius();
+            Real sum = 0;
+            for (int j : list.neighbors(i)) {
+                Eigen::Vector3d d = positions[j] - positions[i];
+                if (box) d = box->minimumImage(d);
+                sum += masses[j] * kernel.sample(Real(d.squaredNorm()), h).value;
+            }
+            rho[i] = sum;
+        }
+    }, 256);
+    return rho;
+}
+
+template <typename Real>
+size_t BasicParticleArrays<Real>::getMemory() const {
+    return positions.capacity() * sizeof(Eigen::Vector3d) + velocities.capacity() * sizeof(Vector3) +
+           masses.capacity() * sizeof(Real) + smoothing_lengths.capacity() * sizeof(Real);
+}
+
+
+template class BasicParticleArrays<float>;
+template class BasicParticleArrays<double>;
@@ -1,6 +1,15 @@
 
 #include "particleSet.hpp"
+#include "parallel.hpp"
+#include "initialConditions.hpp"
 #include <tintoretto.hpp>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <iterator>
 
 
 /**
@@ -10,28 +19,109 @@
  */
 
 ParticleSet::ParticleSet() {
-    particles = std::vector<Particle>();
+    particles = NumaVector<Particle>();
 }
 
 ParticleSet::ParticleSet(std::initializer_list<Particle> init) {
-    particles = std::vector<Particle>(init);
+    reserve(init.size());
+    particles.insert(particles.end(), init.begin(), init.end());
 }
 
 ParticleSet::ParticleSet(const ParticleSet& ps) {
-    this->particles = ps.particles; // this is indeed a deep copy because std::vector does deep copy on its own
+    reserve(ps.size());
+    particles.insert(particles.end(), ps.particles.begin(), ps.particles.end()); // deep copy, into placed storage
+    this->box = ps.box;
+}
+
+ParticleSet& ParticleSet::operator=(const ParticleSet& ps) {
+    if (this == &ps) return *this;
+    particles.clear();
+    reserve(ps.size());
+    particles.insert(particles.end(), ps.particles.begin(), ps.particles.end());
+    box = ps.box;
+    invalidate();
+    return *this;
+}
+
+ParticleSet::ParticleSet(ParticleSet&& ps) : particles(std::move(ps.particles)), box(ps.box) {
+    ps.particles.clear();
+    ps.invalidate();
+}
+
+ParticleSet& ParticleSet::operator=(ParticleSet&& ps) {
+    particles = std::move(ps.particles);
+    box = ps.box;
+    ps.particles.clear();
+    ps.invalidate();
+    invalidate();
+    return *this;
+}
+
+ParticleSet::ParticleSet(ConstParticleView view) {
+    reserve(view.size());
+    particles.insert(particles.end(), view.begin(), view.end());
+}
+
+ParticleSet::ParticleSet(const ParticleSnapshot& snapshot) {
+    reserve(snapshot.size());
+    for (ConstParticleView block : snapshot.views()) particles.insert(particles.end(), block.begin(), block.end());
 }
 
 void ParticleSet::add(Particle p) {
+    reserve(size() + 1); // grows (and places) the storage when full
     particles.push_back(p); // a copy is made since the particle is passed by value
+    invalidate(size() - 1, -1);
 }
 
-void ParticleSet::add(ParticleSet& ps) {
-    for (int i = 0; i < ps.size(); i++) {
-        add(ps.get(i)); // a copy is made since the particle is passed by value
+void ParticleSet::add(const ParticleSet& ps) {
+    add(ps.view());
+}
+
+void ParticleSet::add(ConstParticleView view) {
+    const int n = size();
+    const std::less_equal<const Particle*> before;
+    if (before(particles.data(), view.begin()) && before(view.end(), particles.data() + n)) {
+        // a view on this set: reserving may move the particles it points to, so go by index
+        const int offset = view.begin() - particles.data();
+        reserve(n + view.size());
+        for (int i = 0; i < view.size(); i++) particles.push_back(particles[offset + i]);
+    } else {
+        reserve(n + view.size());
+        particles.insert(particles.end(), view.begin(), view.end());
     }
+    invalidate(n, -1); // the particles already there are unchanged, so are their snapshot blocks
+}
+
+void ParticleSet::add(ParticleSet&& ps) {
+    const int n = size();
+    if (n == 0) {
+        particles = std::move(ps.particles); // just steal the storage
+    } else {
+        reserve(size() + ps.size());
+        particles.insert(particles.end(), std::make_move_iterator(ps.particles.begin()), std::make_move_iterator(ps.particles.end()));
+    }
+    ps.particles.clear();
+    ps.invalidate();
+    invalidate(n, -1);
+}
+
+void ParticleSet::reserve(int n) {
+    if (n <= (int)particles.capacity()) return;
+    // new storage, its pages placed as the static loops over a full set run, then the particles moved in
+    const size_t capacity = std::max<size_t>(n, 2 * particles.capacity()); // keep push_back amortized
+    NumaVector<Particle> grown;
+    grown.reserve(capacity);
+    Memory::firstTouch(grown.data(), sizeof(Particle), Parallel::chunkBounds(capacity));
+    grown.insert(grown.end(), std::make_move_iterator(particles.begin()), std::make_move_iterator(particles.end()));
+    particles.swap(grown);
 }
 
 Particle& ParticleSet::get(int i) {
+    invalidate(i, i + 1); // the caller may modify the particle
+    return particles[i];
+}
+
+const Particle& ParticleSet::get(int i) const {
     return particles[i];
 }
 
@@ -40,17 +130,144 @@ int ParticleSet::size() const {
 }
 
 
+/**
+ * --------------------------
+ * !-- Views and snapshots --!
+ * --------------------------
+ */
+
+ParticleView ParticleSet::view(int start, int end) {
+    invalidate(start, end); // the caller may modify the particles through the view
+    return ParticleView(particles.data(), size()).slice(start, end);
+}
+
+ConstParticleView ParticleSet::view(int start, int end) const {
+    return ConstParticleView(particles.data(), size()).slice(start, end);
+}
+
+ParticleSet ParticleSet::slice(int start, int end) const {
+    ParticleSet sliced(view(start, end));
+    sliced.box = box;
+    return sliced;
+}
+
+ParticleSet ParticleSet::slice(int n) const {
+    return slice(0, n);
+}
+
+ParticleSet ParticleSet::slice_m(int n) const {
+    if (n < 0) throw std::invalid_argument("ParticleSet::slice_m: n must be non-negative.");
+    n = std::min(n, size());
+    ParticleSet sliced;
+    sliced.box = box;
+    if (n == 0) return sliced;
+
+    auto picked = [&](int k) -> const Particle& {return particles[(long long)k * size() / n];};
+    double mass = Parallel::reduce<double>(n, 0.0, [&](int begin, int end) {
+        double m = 0;
+        for (int k = begin; k < end; k++) m += picked(k).mass;
+        return m;
+    }, [](double a, double b) {return a + b;});
+    const double mass_scale = mass > 0 ? getStatistics().total_mass / mass : 1.0;
+    const double h_scale = std::cbrt((double)size() / n);
+
+    sliced.particles.assign(n, particles[0]);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            Particle& p = sliced.particles[k];
+            p = picked(k);
+            p.mass *= mass_scale;
+            p.smoothing_length *= h_scale;
+        }
+    });
+    return sliced;
+}
+
+std::vector<ConstParticleView> ParticleSet::splitViews() const {
+    std::vector<ConstParticleView> groups;
+    int start = 0;
+    for (int i = 1; i <= size(); i++) {
+        if (i == size() || particles[i].current_time != particles[start].current_time) {
+            groups.push_back(view(start, i));
+            start = i;
+        }
+    }
+    return groups;
+}
+
+std::vector<ParticleView> ParticleSet::splitViews() {
+    invalidate();
+    std::vector<ParticleView> groups;
+    for (ConstParticleView group : std::as_const(*this).splitViews()) {
+        groups.push_back(ParticleView(particles.data() + (group.begin() - particles.data()), group.size()));
+    }
+    return groups;
+}
+
+std::vector<ParticleSet> ParticleSet::split() const {
+    std::vector<ParticleSet> sets;
+    for (ConstParticleView group : splitViews()) {
+        sets.push_back(ParticleSet(group));
+        sets.back().box = box;
+    }
+    return sets;
+}
+
+ParticleSnapshot ParticleSet::snapshot() const {
+    const int n = size();
+    const int blocks = (n + ParticleSnapshot::block_size - 1) / ParticleSnapshot::block_size;
+    std::lock_guard<std::mutex> lock(cache_mutex); // the first of several concurrent callers copies, the others share
+    snapshot_blocks.resize(blocks);
+    for (int b = 0; b < blocks; b++) {
+        const int begin = b * ParticleSnapshot::block_size;
+        const int end = std::min(n, begin + ParticleSnapshot::block_size);
+        ParticleSnapshot::Block& block = snapshot_blocks[b];
+        if (!block || (int)block->size() != end - begin) {
+            block = std::make_shared<const NumaVector<Particle>>(particles.begin() + begin, particles.begin() + end);
+        }
+    }
+    return ParticleSnapshot(snapshot_blocks, n);
+}
+
+void ParticleSet::dropSnapshotBlocks(int start, int end) {
+    const int n = size();
+    if (start < 0) start = 0;
+    if (end < start || end > n) end = n; // same conventions as slice()
+    const int block = ParticleSnapshot::block_size;
+    const int last = end == n ? snapshot_blocks.size() : std::min<int>(snapshot_blocks.size(), (end + block - 1) / block);
+    for (int b = start / block; b < last; b++) {
+        snapshot_blocks[b].reset(); // snapshots already handed out keep their own reference
+    }
+}
+
+std::vector<ConstParticleView> ParticleSnapshot::views() const {
+    std::vector<ConstParticleView> result;
+    for (const Block& block : blocks) result.push_back(ConstParticleView(block->data(), block->size()));
+    return result;
+}
+
+int ParticleSnapshot::sharedBlocks(const ParticleSnapshot& other) const {
+    int shared = 0;
+    for (size_t b = 0; b < std::min(blocks.size(), other.blocks.size()); b++) {
+        if (blocks[b] == other.blocks[b]) shared++;
+    }
+    return shared;
+}
+
+
 /**
  * ---------------
  * !-- Display --!
  * ---------------
  */
-void ParticleSet::display() {
+void ParticleSet::display() const {
+    const ParticleSetStatistics& stats = getStatistics();
     Message::print(cstr("ParticleSet").blue() + " <" + cstr("#").green() + cstr(size()).green() + ">:");
     Message::tab();
-    Message::print("- Total mass: " + std::to_string(getTotalMass()));
-    Message::print("- Center of mass: " + std::to_string(getCenterOfMass().norm()) + " (distance from origin)");
-    Message::print("- Center of mass velocity: " + std::to_string(getCenterOfMassVelocity().norm()));
+    Message::print("- Total mass: " + std::to_string(stats.total_mass));
+    Message::print("- Center of mass: " + std::to_string(stats.center_of_mass.norm()) + " (distance from origin)");
+    Message::print("- Center of mass velocity: " + std::to_string(stats.center_of_mass_velocity.norm()));
+    Message::print("- Kinetic energy: " + std::to_string(stats.kinetic_energy));
     Message::print("- Diameter: " + std::to_string(getDiameter()));
     Message::untab();
 }
@@ -64,57 +281,143 @@ void ParticleSet::display() {
 
 void ParticleSet::updateCurrentTime(double dt) {
     for (int i = 0; i < size(); i++) {
-        get(i).current_time += dt;
+        particles[i].current_time += dt; // time does not enter the statistics => no need to invalidate them
     }
+    dropSnapshotBlocks(0, -1); // but snapshots do record it
 }
 
 void ParticleSet::com() {
     Eigen::Vector3d com = getCenterOfMass();
     Eigen::Vector3d com_velocity = getCenterOfMassVelocity();
-    for (int i = 0; i < size(); i++) {
-        get(i).position -= com;
-        get(i).velocity -= com_velocity;
-    }
+    Parallel::forRange(size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            particles[i].position -= com;
+            particles[i].velocity -= com_velocity;
+        }
+    });
+    invalidate();
+}
+
+ParticleSet ParticleSet::random(int n, uint64_t seed) {
+    return InitialConditions::uniformCube(n, seed);
+}
+
+ParticleSet ParticleSet::random_sphere(int n, uint64_t seed) {
+    return InitialConditions::uniformSphere(n, seed);
 }
 
 
 /**
- * -------------------------
- * !-- Private Functions --!
- * -------------------------
+ * --------------------
+ * !-- Periodic Box --!
+ * --------------------
  */
 
-double ParticleSet::getTotalMass() {
-    double total_mass = 0;
-    for (int i = 0; i < size(); i++) {
-        total_mass += get(i).mass;
-    }
-    return total_mass;
+void ParticleSet::setPeriodicBox(const PeriodicBox& box) {
+    this->box = box;
 }
 
-Eigen::Vector3d ParticleSet::getCenterOfMass() {
-    double total_mass = getTotalMass();
-    Eigen::Vector3d center_of_mass = Eigen::Vector3d::Zero();
-    for (int i = 0; i < size(); i++) {
-        center_of_mass += get(i).mass * get(i).position;
-    }
-    return center_of_mass / total_mass;
+void ParticleSet::clearPeriodicBox() {
+    box.reset();
 }
 
-Eigen::Vector3d ParticleSet::getCenterOfMassVelocity() {
-    double total_mass = getTotalMass();
-    Eigen::Vector3d center_of_mass_velocity = Eigen::Vector3d::Zero();
-    for (int i = 0; i < size(); i++) {
-        center_of_mass_velocity += get(i).mass * get(i).velocity;
-    }
-    return center_of_mass_velocity / total_mass;
+void ParticleSet::wrap() {
+    if (!box) return;
+    Parallel::forRange(size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            particles[i].position = box->wrap(particles[i].position);
+        }
+    });
+    invalidate();
 }
 
-double ParticleSet::getDiameter() {
-    double diameter = 0;
-    Eigen::Vector3d com = getCenterOfMass();
-    for (int i = 0; i < size(); i++) {
-        diameter = std::max(diameter, (get(i).position - com).norm());
+
+/**
+ * ------------------
+ * !-- Statistics --!
+ * ------------------
+ */
+
+void ParticleSet::invalidate(int start, int end) {
+    statistics_valid = false;
+    diameter_valid = false;
+    dropSnapshotBlocks(start, end);
+}
+
+const ParticleSetStatistics& ParticleSet::getStatistics() const {
+    if (statistics_valid.load(std::memory_order_acquire)) return statistics;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (statistics_valid.load(std::memory_order_relaxed)) return statistics; // filled by another thread meanwhile
+
+    // raw sums, normalized once all chunks are combined
+    struct Sums {
+        double mass = 0;
+        Eigen::Vector3d mass_position = Eigen::Vector3d::Zero();
+        Eigen::Vector3d momentum = Eigen::Vector3d::Zero();
+        double kinetic_energy = 0;
+        Eigen::Vector3d bbox_min = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+        Eigen::Vector3d bbox_max = Eigen::Vector3d::Constant(-std::numeric_limits<double>::infinity());
+    };
+
+    Sums sums = Parallel::reduce<Sums>(size(), Sums(),
+        [&](int begin, int end) {
+            Sums s;
+            for (int i = begin; i < end; i++) {
+                const Particle& p = particles[i];
+                s.mass += p.mass;
+                s.mass_position += p.mass * p.position;
+                s.momentum += p.mass * p.velocity;
+                s.kinetic_energy += 0.5 * p.mass * p.velocity.squaredNorm();
+                s.bbox_min = s.bbox_min.cwiseMin(p.position);
+                s.bbox_max = s.bbox_max.cwiseMax(p.position);
+            }
+            return s;
+        },
+        [](const Sums& a, const Sums& b) {
+            Sums s;
+            s.mass = a.mass + b.mass;
+            s.mass_position = a.mass_position + b.mass_position;
+            s.momentum = a.momentum + b.momentum;
+            s.kinetic_energy = a.kinetic_energy + b.kinetic_energy;
+            s.bbox_min = a.bbox_min.cwiseMin(b.bbox_min);
+            s.bbox_max = a.bbox_max.cwiseMax(b.bbox_max);
+            return s;
+        }
+    );
+
+    ParticleSetStatistics result;
+    if (size() > 0) {
+        result.total_mass = sums.mass;
+        result.center_of_mass = sums.mass_position / sums.mass;
+        result.center_of_mass_velocity = sums.momentum / sums.mass;
+        result.momentum = sums.momentum;
+        result.kinetic_energy = sums.kinetic_energy;
+        result.bbox_min = sums.bbox_min;
+        result.bbox_max = sums.bbox_max;
     }
-    return diameter * 2;
-};
\ No newline at end of file
+    statistics = result;
+    statistics_valid.store(true, std::memory_order_release); // readers only ever see it complete
+    return statistics;
+}
+
+double ParticleSet::getDiameter() const {
+    if (diameter_valid.load(std::memory_order_acquire)) return diameter;
+
+    Eigen::Vector3d com = getCenterOfMass(); // before the lock, which getStatistics() takes too
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (diameter_valid.load(std::memory_order_relaxed)) return diameter;
+    double max_distance = Parallel::reduce<double>(size(), 0.0,
+        [&](int begin, int end) {
+            double d = 0;
+            for (int i = begin; i < end; i++) {
+                d = std::max(d, (particles[i].position - com).squaredNorm());
+            }
+            return d;
+        },
+        [](double a, double b) {return std::max(a, b);}
+    );
+
+    diameter = 2 * std::sqrt(max_distance);
+    diameter_valid.store(true, std::memory_order_release);
+    return diameter;
+}
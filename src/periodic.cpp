@@ -0,0 +1,83 @@
+#include "periodic.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <stdexcept>
+
+
+EwaldTable::EwaldTable(int resolution) : n(resolution) {
+    if (n < 1) throw std::invalid_argument("EwaldTable: resolution must be at least 1.");
+    const int side = n + 1;
+    table = std::vector<Eigen::Vector3d>(side * side * side, Eigen::Vector3d::Zero());
+
+    // correction = full periodic acceleration - nearest image, on [0, 1/2]^3 (zero at the origin by symmetry)
+    Parallel::forRange(table.size(), [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            if (t == 0) continue;
+            int i = t / (side * side), j = (t / side) % side, k = t % side;
+            Eigen::Vector3d x = Eigen::Vector3d(i, j, k) * 0.5 / n;
+            double r = x.norm();
+            table[t] = ewaldAcceleration(x) + x / (r * r * r);
+        }
+    }, 16);
+}
+
+const EwaldTable& EwaldTable::get() {
+    static const EwaldTable shared(default_resolution); // thread safe initialization
+    return shared;
+}
+
+Eigen::Vector3d EwaldTable::correction(const Eigen::Vector3d& d, double box_side) const {
+    // the correction is odd along its own component and even along the others => only [0, 1/2]^3 is stored
+    Eigen::Vector3d u = d.cwiseAbs() / box_side * 2 * n;
+    int idx[3];
+    double w[3];
+    for (int dim = 0; dim < 3; dim++) {
+        idx[dim] = std::min((int)u[dim], n - 1);
+        w[dim] = std::min(u[dim] - idx[dim], 1.0);
+    }
+
+    const int side = n + 1;
+    Eigen::Vector3d c = Eigen::Vector3d::Zero();
+    for (int corner = 0; corner < 8; corner++) {
+        int a = (corner >> 2) & 1, b = (corner >> 1) & 1, e = corner & 1;
+        double weight = (a ? w[0] : 1 - w[0]) * (b ? w[1] : 1 - w[1]) * (e ? w[2] : 1 - w[2]);
+        c += weight * table[((idx[0] + a) * side + idx[1] + b) * side + idx[2] + e];
+    }
+    for (int dim = 0; dim < 3; dim++) {
+        if (d[dim] < 0) c[dim] = -c[dim];
+    }
+    return c / (box_side * box_side);
+}
+
+Eigen::Vector3d EwaldTable::ewaldAcceleration(const Eigen::Vector3d& x) {
+    // Hernquist, Bouchet & Suto (1991), unit box, splitting parameter alpha = 2
+    const double alpha = 2.0;
+    Eigen::Vector3d a = Eigen::Vector3d::Zero();
+
+    // real space sum over the images
+    for (int i = -4; i <= 4; i++) {
+        for (int j = -4; j <= 4; j++) {
+            for (int k = -4; k <= 4; k++) {
+                Eigen::Vector3d dx = x - Eigen::Vector3d(i, j, k);
+                double r = dx.norm();
+                if (r == 0) continue;
+                double val = std::erfc(alpha * r) + 2 * alpha * r / std::sqrt(M_PI) * std::exp(-alpha * alpha * r * r);
+                a -= dx / (r * r * r) * val;
+            }
+        }
+    }
+
+    // Fourier space sum
+    for (int i = -4; i <= 4; i++) {
+        for (int j = -4; j <= 4; j++) {
+            for (int k = -4; k <= 4; k++) {
+                int h2 = i * i + j * j + k * k;
+                if (h2 == 0) continue;
+                Eigen::Vector3d h(i, j, k);
+                double val = 2.0 / h2 * std::exp(-M_PI * M_PI * h2 / (alpha * alpha)) * std::sin(2 * M_PI * h.dot(x));
+                a -= h * val;
+            }
+        }
+    }
+    return a;
+}
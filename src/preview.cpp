@@ -0,0 +1,108 @@
+#include "preview.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+    /**
+     * @brief Least squares fit of log t = log a + b log n, returns (log a, b). With a single point, b = 1.
+     */
+    std::pair<double, double> powerLaw(const std::vector<double>& n, const std::vector<double>& t) {
+        std::vector<double> x, y;
+        for (size_t i = 0; i < n.size(); i++) {
+            if (n[i] > 0 && t[i] > 0) {
+                x.push_back(std::log(n[i]));
+                y.push_back(std::log(t[i]));
+            }
+        }
+        if (x.empty()) return {-INFINITY, 1.0};
+        double mean_x = 0, mean_y = 0;
+        for (size_t i = 0; i < x.size(); i++) {
+            mean_x += x[i] / x.size();
+            mean_y += y[i] / x.size();
+        }
+        double sxx = 0, sxy = 0;
+        for (size_t i = 0; i < x.size(); i++) {
+            sxx += (x[i] - mean_x) * (x[i] - mean_x);
+            sxy += (x[i] - mean_x) * (y[i] - mean_y);
+        }
+        double b = sxx > 0 ? sxy / sxx : 1.0;
+        return {mean_y - b * mean_x, b};
+    }
+}
+
+
+Preview::Preview(std::function<void(ParticleSet&, int)> f, std::vector<int> factors, double min_seconds) : f(f), factors(factors), min_seconds(min_seconds) {
+    if (this->factors.empty()) throw std::invalid_argument("Preview: at least one downsampling factor is needed.");
+    for (int factor : this->factors) {
+        if (factor < 1) throw std::invalid_argument("Preview: downsampling factors must be at least 1.");
+    }
+    std::sort(this->factors.begin(), this->factors.end(), std::greater<int>());
+}
+
+PreviewReport Preview::run(const ParticleSet& full) const {
+    using Clock = std::chrono::steady_clock;
+    PreviewReport report;
+    report.n = full.size();
+
+    for (int factor : factors) {
+        PreviewRun run{factor, std::max(1, full.size() / factor), 0.0, {}};
+        const std::map<std::string, Parallel::PhaseStats> before = Parallel::getPhases();
+        double total = 0;
+        int repeats = 0;
+        do {
+            ParticleSet ps = full.slice_m(run.n);
+            const Clock::time_point start = Clock::now();
+            f(ps, factor);
+            total += std::chrono::duration<double>(Clock::now() - start).count();
+            repeats++;
+        } while (total < min_seconds && repeats < 1000);
+
+        run.seconds = total / repeats;
+        for (const auto& [name, stats] : Parallel::getPhases()) {
+            auto previous = before.find(name);
+            double wall = stats.wall - (previous != before.end() ? previous->second.wall : 0.0);
+            if (wall > 0) run.phases[name] = wall / repeats;
+        }
+        report.runs.push_back(run);
+    }
+
+    // the same law for the whole run and for each phase
+    std::vector<double> sizes, times;
+    std::map<std::string, std::vector<double>> phase_times;
+    for (const PreviewRun& run : report.runs) {
+        sizes.push_back(run.n);
+        times.push_back(run.seconds);
+        for (const auto& [name, seconds] : run.phases) phase_times[name];
+    }
+    for (auto& [name, phase] : phase_times) {
+        for (const PreviewRun& run : report.runs) {
+            auto found = run.phases.find(name);
+            phase.push_back(found != run.phases.end() ? found->second : 0.0);
+        }
+    }
+    auto [log_a, b] = powerLaw(sizes, times);
+    report.exponent = b;
+    report.seconds = std::exp(log_a + b * std::log((double)report.n));
+    for (const auto& [name, phase] : phase_times) {
+        auto [phase_log_a, phase_b] = powerLaw(sizes, phase);
+        report.phases[name] = std::exp(phase_log_a + phase_b * std::log((double)report.n));
+    }
+    return report;
+}
+
+void PreviewReport::print() const {
+    for (const PreviewRun& run : runs) {
+        Message("1/" + std::to_string(run.factor) + " (" + std::to_string(run.n) + " particles): " + std::to_string(run.seconds * 1e3) + " ms");
+    }
+    Message("Projected for " + std::to_string(n) + " particles: " + std::to_string(seconds) + " s (t ~ N^" + std::to_string(exponent) + ")");
+    Message::tab();
+    for (const auto& [name, projected] : phases) {
+        Message(name + ": " + std::to_string(projected) + " s");
+    }
+    Message::untab();
+}
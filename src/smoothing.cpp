@@ -0,0 +1,114 @@
+#include "smoothing.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+
+SmoothingLengthSolver::SmoothingLengthSolver(const Kernel& kernel, double n_neighbors, double tolerance, int max_iterations)
+    : kernel(kernel), n_neighbors(n_neighbors), tolerance(tolerance), max_iterations(max_iterations) {
+    if (n_neighbors < 1) throw std::invalid_argument("SmoothingLengthSolver: at least one neighbor is needed.");
+}
+
+void SmoothingLengthSolver::solve(ParticleSet& ps) {
+    Octree tree(ps);
+    solve(ps, tree);
+}
+
+void SmoothingLengthSolver::solve(ParticleSet& ps, const Octree& tree) {
+    if (tree.size() != ps.size()) throw std::invalid_argument("SmoothingLengthSolver::solve: the tree was not built on this set.");
+    Parallel::Phase phase("smoothing lengths");
+    const ParticleSet& set = ps; // read-only access does not invalidate the cache of the set
+    const int n = set.size();
+    const double max_radius = tree.isPeriodic() ? 0.49 * tree.getPeriodicBox()->side : std::numeric_limits<double>::infinity();
+
+    // initial guess: the current h, or the density of the leaf
+    std::vector<double> h(n);
+    for (const OctreeNode& node : tree.nodes) {
+        if (!node.isLeaf()) continue;
+        double side = 2 * node.half_size;
+        double rho = node.mass / (side * side * side);
+        for (int k = node.first; k < node.first + node.count; k++) {
+            double guess = set.get(tree.index[k]).smoothing_length;
+            h[k] = guess > 0 ? guess : std::cbrt(3 * n_neighbors * tree.masses[k] / (4 * M_PI * rho));
+            h[k] = std::min(h[k], max_radius / margin);
+        }
+    }
+
+    struct Counters {long long iterations = 0, queries = 0; int failures = 0;};
+    std::vector<double> rho(n);
+
+    // tree order => consecutive particles fetch overlapping parts of the tree
+    Counters total = Parallel::reduce<Counters>(n, Counters(),
+        [&](int begin, int end) {
+            Counters c;
+            std::vector<int> ids;
+            std::vector<double> r2, m;
+            for (int k = begin; k < end; k++) {
+                const Eigen::Vector3d& x = tree.positions[k];
+                const double target = n_neighbors * tree.masses[k];
+                double fetched = 0; // radius of the current candidate list
+                double lo = 0, hi = std::numeric_limits<double>::infinity();
+                double hk = h[k], density = 0;
+                double h_density = hk; // the h density was computed with
+                bool converged = false;
+
+                for (int it = 0; it < max_iterations; it++) {
+                    c.iterations++;
+                    if (hk > fetched) {
+                        fetched = std::min(margin * hk, max_radius);
+                        tree.neighbors(x, fetched, ids);
+                        r2.resize(ids.size());
+                        m.resize(ids.size());
+                        for (int a = 0; a < (int)ids.size(); a++) {
+                            const Particle& p = set.get(ids[a]);
+                            r2[a] = tree.separation(p.position, x).squaredNorm();
+                            m[a] = p.mass;
+                        }
+                        c.queries++;
+                    }
+
+                    double drho = 0;
+                    density = 0;
+                    for (int a = 0; a < (int)r2.size(); a++) {
+                        const KernelSample<real> s = kernel.sample(real(r2[a]), real(hk)); // sums in double
+                        density += m[a] * s.value;
+                        drho += m[a] * s.dh;
+                    }
+                    h_density = hk;
+
+                    // f(h) = enclosed mass - target
+                    double volume = 4.0 / 3.0 * M_PI * hk * hk * hk;
+                    double f = volume * density - target;
+                    if (std::abs(f) < tolerance * target) {
+                        converged = true;
+                        break;
+                    }
+                    if (f < 0) lo = hk;
+                    else hi = hk;
+
+                    double df = 4 * M_PI * hk * hk * density + volume * drho;
+                    double next = df > 0 ? hk - f / df : -1;
+                    if (!(next > lo && next < hi)) next = std::isinf(hi) ? 2 * hk : 0.5 * (lo + hi); // leave Newton for bisection
+                    hk = std::min(next, max_radius / margin); // a periodic box bounds the search radius
+                }
+
+                if (!converged) c.failures++;
+                h[k] = h_density; // the last iterate, if it did not converge: h and rho still belong together
+                rho[k] = density;
+            }
+            return c;
+        },
+        [](Counters a, Counters b) {return Counters{a.iterations + b.iterations, a.queries + b.queries, a.failures + b.failures};},
+        64
+    );
+
+    densities = tree.toSetOrder(rho);
+    for (int k = 0; k < n; k++) {
+        ps.particles[tree.index[k]].smoothing_length = h[k];
+    }
+    ps.invalidate();
+    iterations = total.iterations;
+    queries = total.queries;
+    failures = total.failures;
+}
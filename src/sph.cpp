@@ -0,0 +1,253 @@
+#include "sph.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+SphSolver::SphSolver(const Kernel& kernel, double K, double gamma, double alpha, double beta)
+    : kernel(kernel), K(K), gamma(gamma), alpha(alpha), beta(beta) {
+    if (K <= 0 || gamma < 1) throw std::invalid_argument("SphSolver: the equation of state needs K > 0 and gamma >= 1.");
+}
+
+long long SphSolver::getPairs() const {
+    long long total = 0;
+    for (const std::vector<SphPair>& chunk : pairs) total += chunk.size();
+    return total;
+}
+
+
+
+/**
+ * ---------------
+ * !-- Density --!
+ * ---------------
+ */
+
+const std::vector<double>& SphSolver::computeDensities(const ParticleSet& ps, const NeighborList& list) {
+    const int n = ps.size();
+    if (list.size() != n) throw std::invalid_argument("SphSolver::computeDensities: the neighbor list was not built for this set.");
+    Parallel::Phase phase("sph density");
+    const std::optional<PeriodicBox>& box = ps.getPeriodicBox();
+    const bool deterministic = Parallel::getDeterministic();
+    arrays.load(ps);
+    const NumaVector<Eigen::Vector3d>& x = arrays.positions;
+    const NumaVector<real>& m = arrays.masses;
+
+    const int n_chunks = Parallel::chunks(n, 256);
+    pairs.resize(n_chunks);
+    touched.resize(n_chunks);
+    density_buffers.resize(n_chunks);
+
+    Parallel::forChunks(n, [&](int chunk, int begin, int end) {
+        std::vector<SphPair>& found = pairs[chunk];
+        found.clear();
+        int first = begin, last = end;
+        for (int i = begin; i < end; i++) {
+            const real hi = smoothingLength(i);
+            for (int j : list.neighbors(i)) {
+                if (j == i) continue;
+                // each pair once: from the list of i < j, or from the list of j > i if it is missing from the list of i
+                if (j < i) {
+                    NeighborRange other = list.neighbors(j);
+                    if (std::binary_search(other.begin(), other.end(), i)) continue;
+                }
+                Eigen::Vector3d d = x[i] - x[j];
+                if (box) d = box->minimumImage(d);
+                const real hij = real(0.5) * (hi + smoothingLength(j));
+                const KernelSample<real> s = kernel.sample(real(d.squaredNorm()), hij);
+                if (s.value == 0) continue;
+                found.push_back({std::min(i, j), std::max(i, j), s.value, s.gradient_factor});
+                first = std::min(first, j);
+                last = std::max(last, j + 1);
+            }
+        }
+        touched[chunk] = {first, last};
+        if (deterministic) return;
+
+        // contributions of the chunk, to the particles it touches only
+        std::vector<real>& rho = density_buffers[chunk];
+        rho.assign(last - first, 0);
+        for (int i = begin; i < end; i++) rho[i - first] += m[i] * kernel.sample(0, smoothingLength(i)).value;
+        for (const SphPair& pair : found) {
+            rho[pair.i - first] += m[pair.j] * pair.w;
+            rho[pair.j - first] += m[pair.i] * pair.w;
+        }
+    }, 256);
+
+    densities.assign(n, 0.0);
+    pressures.resize(n);
+    std::vector<real> contributions;
+    if (deterministic) {
+        assignSlots(n);
+        contributions.resize(slot_offsets[n]);
+        Parallel::forChunks(n_chunks, [&](int, int begin, int end) {
+            for (int chunk = begin; chunk < end; chunk++) {
+                for (size_t k = 0; k < pairs[chunk].size(); k++) {
+                    const SphPair& pair = pairs[chunk][k];
+                    contributions[slots[chunk][k][0]] = m[pair.j] * pair.w;
+                    contributions[slots[chunk][k][1]] = m[pair.i] * pair.w;
+                }
+            }
+        }, 1);
+    }
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (deterministic) {
+                real rho = m[i] * kernel.sample(0, smoothingLength(i)).value;
+                for (int k = slot_offsets[i]; k < slot_offsets[i + 1]; k++) rho += contributions[k];
+                densities[i] = rho;
+            } else {
+                real rho = 0;
+                for (int chunk = 0; chunk < n_chunks; chunk++) {
+                    const auto [first, last] = touched[chunk];
+                    if (i >= first && i < last) rho += density_buffers[chunk][i - first];
+                }
+                densities[i] = rho;
+            }
+            pressures[i] = K * std::pow(densities[i], gamma);
+        }
+    });
+    kernel_evaluations = n + getPairs();
+    return densities;
+}
+
+
+
+/**
+ * --------------
+ * !-- Forces --!
+ * --------------
+ */
+
+std::vector<Eigen::Vector3d> SphSolver::accelerations(const ParticleSet& ps, const NeighborList& list) {
+    computeDensities(ps, list);
+    Parallel::Phase phase("sph forces");
+    const int n = ps.size();
+    const std::optional<PeriodicBox>& box = ps.getPeriodicBox();
+    const NumaVector<Eigen::Vector3d>& x = arrays.positions;
+    const NumaVector<Vector3r>& v = arrays.velocities;
+    const NumaVector<real>& m = arrays.masses;
+    const real a = alpha, b = beta;
+
+    std::vector<real> sound(n), pressure_term(n), rho(n);
+    for (int i = 0; i < n; i++) {
+        sound[i] = soundSpeed(i);
+        pressure_term[i] = pressures[i] / (densities[i] * densities[i]);
+        rho[i] = densities[i];
+    }
+
+    const bool deterministic = Parallel::getDeterministic();
+    const int n_chunks = pairs.size();
+    force_buffers.resize(n_chunks);
+    std::vector<Vector3r> contributions(deterministic ? slot_offsets[n] : 0);
+    Parallel::forChunks(n_chunks, [&](int, int begin, int end) {
+        for (int chunk = begin; chunk < end; chunk++) {
+            std::vector<Vector3r>& acc = force_buffers[chunk];
+            const int first = touched[chunk][0];
+            if (!deterministic) acc.assign(touched[chunk][1] - first, Vector3r::Zero());
+            for (size_t k = 0; k < pairs[chunk].size(); k++) {
+                const SphPair& pair = pairs[chunk][k];
+                Eigen::Vector3d separation = x[pair.i] - x[pair.j];
+                if (box) separation = box->minimumImage(separation);
+                const Vector3r d = separation.cast<real>();
+
+                // Monaghan (1992) viscosity, only between approaching particles
+                real viscosity = 0;
+                const real vr = (v[pair.i] - v[pair.j]).dot(d);
+                if (vr < 0) {
+                    const real h = real(0.5) * (smoothingLength(pair.i) + smoothingLength(pair.j));
+                    const real mu = h * vr / (d.squaredNorm() + real(0.01) * h * h);
+                    const real c = real(0.5) * (sound[pair.i] + sound[pair.j]);
+                    viscosity = (-a * c * mu + b * mu * mu) / (real(0.5) * (rho[pair.i] + rho[pair.j]));
+                }
+
+                const Vector3r f = (pressure_term[pair.i] + pressure_term[pair.j] + viscosity) * pair.gradient_factor * d;
+                if (deterministic) {
+                    contributions[slots[chunk][k][0]] = -m[pair.j] * f;
+                    contributions[slots[chunk][k][1]] = m[pair.i] * f;
+                } else {
+                    acc[pair.i - first] -= m[pair.j] * f;
+                    acc[pair.j - first] += m[pair.i] * f;
+                }
+            }
+        }
+    }, 1);
+
+    std::vector<Eigen::Vector3d> acc(n);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Vector3r sum = Vector3r::Zero();
+            if (deterministic) {
+                for (int k = slot_offsets[i]; k < slot_offsets[i + 1]; k++) sum += contributions[k];
+            } else {
+                for (int chunk = 0; chunk < n_chunks; chunk++) {
+                    const auto [first, last] = touched[chunk];
+                    if (i >= first && i < last) sum += force_buffers[chunk][i - first];
+                }
+            }
+            acc[i] = sum.cast<double>();
+        }
+    });
+    return acc;
+}
+
+
+
+/**
+ * ---------------------
+ * !-- Deterministic --!
+ * ---------------------
+ */
+
+void SphSolver::assignSlots(int n) {
+    const int n_chunks = pairs.size();
+    // pairs of each particle touched by each chunk, then its next slot in that chunk
+    std::vector<std::vector<int>> next(n_chunks);
+    Parallel::forChunks(n_chunks, [&](int, int begin, int end) {
+        for (int chunk = begin; chunk < end; chunk++) {
+            const int first = touched[chunk][0];
+            next[chunk].assign(touched[chunk][1] - first, 0);
+            for (const SphPair& pair : pairs[chunk]) {
+                next[chunk][pair.i - first]++;
+                next[chunk][pair.j - first]++;
+            }
+        }
+    }, 1);
+
+    slot_offsets.assign(n + 1, 0);
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            for (int chunk = 0; chunk < n_chunks; chunk++) {
+                const auto [first, last] = touched[chunk];
+                if (i >= first && i < last) slot_offsets[i + 1] += next[chunk][i - first];
+            }
+        }
+    });
+    for (int i = 0; i < n; i++) {
+        slot_offsets[i + 1] += slot_offsets[i];
+    }
+    Parallel::forRange(n, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int slot = slot_offsets[i];
+            for (int chunk = 0; chunk < n_chunks; chunk++) {
+                const auto [first, last] = touched[chunk];
+                if (i < first || i >= last) continue;
+                const int count = next[chunk][i - first];
+                next[chunk][i - first] = slot;
+                slot += count;
+            }
+        }
+    });
+
+    slots.resize(n_chunks);
+    Parallel::forChunks(n_chunks, [&](int, int begin, int end) {
+        for (int chunk = begin; chunk < end; chunk++) {
+            const int first = touched[chunk][0];
+            slots[chunk].resize(pairs[chunk].size());
+            for (size_t k = 0; k < pairs[chunk].size(); k++) {
+                slots[chunk][k] = {next[chunk][pairs[chunk][k].i - first]++, next[chunk][pairs[chunk][k].j - first]++};
+            }
+        }
+    }, 1);
+}
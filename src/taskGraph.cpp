@@ -0,0 +1,175 @@
+#include "taskGraph.hpp"
+#include "parallel.hpp"
+#include <tintoretto.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+
+
+/**
+ * ----------------
+ * !-- Building --!
+ * ----------------
+ */
+
+void TaskGraph::depend(int task, int dependency) {
+    if (dependency == task) return;
+    std::vector<int>& dependencies = nodes[task].dependencies;
+    if (std::find(dependencies.begin(), dependencies.end(), dependency) != dependencies.end()) return;
+    dependencies.push_back(dependency);
+    nodes[dependency].successors.push_back(task);
+}
+
+int TaskGraph::add(const std::string& name, std::function<void()> f, const std::vector<std::string>& reads, const std::vector<std::string>& writes) {
+    const int task = nodes.size();
+    nodes.push_back({name, std::move(f), {}, {}});
+
+    // read after write
+    for (const std::string& data : reads) {
+        auto writer = last_writer.find(data);
+        if (writer != last_writer.end()) depend(task, writer->second);
+    }
+    // write after write, write after read
+    for (const std::string& data : writes) {
+        auto writer = last_writer.find(data);
+        if (writer != last_writer.end()) depend(task, writer->second);
+        for (int reader : readers[data]) depend(task, reader);
+    }
+
+    for (const std::string& data : reads) {
+        readers[data].push_back(task);
+    }
+    for (const std::string& data : writes) {
+        last_writer[data] = task;
+        readers[data].clear();
+    }
+    return task;
+}
+
+void TaskGraph::after(int task, int dependency) {
+    if (task < 0 || task >= size() || dependency < 0 || dependency >= task) throw std::invalid_argument("TaskGraph::after: a task can only wait for a task added before it.");
+    depend(task, dependency);
+}
+
+void TaskGraph::clear() {
+    nodes.clear();
+    last_writer.clear();
+    readers.clear();
+}
+
+
+
+/**
+ * -----------------
+ * !-- Execution --!
+ * -----------------
+ */
+
+void TaskGraph::run(int lanes) {
+    using Clock = std::chrono::steady_clock;
+    const int n = size();
+    timeline.clear();
+    if (n == 0) return;
+    if (lanes <= 0) lanes = Parallel::getThreads();
+    lanes = std::min(lanes, n);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<int> ready;
+    std::vector<int> waiting(n);
+    for (int t = 0; t < n; t++) {
+        waiting[t] = nodes[t].dependencies.size();
+        if (waiting[t] == 0) ready.push_back(t);
+    }
+    int finished = 0, running = 0;
+    std::exception_ptr error;
+    const Clock::time_point start = Clock::now();
+
+    auto lane = [&](int id) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            // done once everything ran, or once a task failed and the others are over
+            changed.wait(lock, [&] {return !ready.empty() || finished == n || (error && running == 0);});
+            if (finished == n || error) return;
+            const int task = ready.front();
+            ready.pop_front();
+            running++;
+            lock.unlock();
+
+            const double begin = std::chrono::duration<double>(Clock::now() - start).count();
+            std::exception_ptr thrown;
+            try {
+                Parallel::Phase phase(nodes[task].name);
+                nodes[task].f();
+            } catch (...) {
+                thrown = std::current_exception();
+            }
+            const double end = std::chrono::duration<double>(Clock::now() - start).count();
+
+            lock.lock();
+            running--;
+            finished++;
+            timeline.push_back({task, nodes[task].name, begin, end, id});
+            if (thrown) {
+                if (!error) error = thrown;
+            } else {
+                for (int successor : nodes[task].successors) {
+                    if (--waiting[successor] == 0) ready.push_back(successor);
+                }
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int id = 1; id < lanes; id++) {
+        threads.emplace_back(lane, id);
+    }
+    lane(0);
+    for (std::thread& t : threads) t.join();
+
+    std::sort(timeline.begin(), timeline.end(), [](const TimelineEntry& a, const TimelineEntry& b) {return a.start < b.start;});
+    if (error) std::rethrow_exception(error);
+}
+
+
+
+/**
+ * ----------------
+ * !-- Timeline --!
+ * ----------------
+ */
+
+bool TaskGraph::ranConcurrently(int a, int b) const {
+    const TimelineEntry* first = nullptr;
+    const TimelineEntry* second = nullptr;
+    for (const TimelineEntry& entry : timeline) {
+        if (entry.task == a) first = &entry;
+        if (entry.task == b) second = &entry;
+    }
+    if (!first || !second || a == b) return false;
+    return first->start < second->end && second->start < first->end;
+}
+
+void TaskGraph::printTimeline(int width) const {
+    if (timeline.empty()) return;
+    double total = 0;
+    size_t name_width = 0;
+    for (const TimelineEntry& entry : timeline) {
+        total = std::max(total, entry.end);
+        name_width = std::max(name_width, entry.name.size());
+    }
+    for (const TimelineEntry& entry : timeline) {
+        const int from = std::min(width - 1, (int)(entry.start / total * width));
+        const int to = std::max(from + 1, (int)(entry.end / total * width));
+        std::string bar = std::string(from, ' ') + std::string(to - from, '#') + std::string(std::max(0, width - to), ' ');
+        Message(entry.name + std::string(name_width - entry.name.size(), ' ') + " |" + bar + "| lane " + std::to_string(entry.lane) + ", " +
+                std::to_string((entry.end - entry.start) * 1e3) + " ms");
+    }
+}